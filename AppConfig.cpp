@@ -31,6 +31,7 @@ AppConfig::AppConfig(QWidget *parent) : QObject(parent)
 
     UiPrefs.cbActiveOpt->setCurrentIndex(optIndex);
     UiPrefs.chkIterateUntilNoChange->setChecked(untilNoChange);
+    UiPrefs.chkWarmStart->setChecked(warmStart);
     UiPrefs.sbXRangeSharpness->setValue(xRangeSharpness);
     UiPrefs.sbYRangeSharpness->setValue(yRangeSharpness);
     UiPrefs.sbXRangeSymmetry->setValue(xRangeSymmetry);
@@ -41,10 +42,15 @@ AppConfig::AppConfig(QWidget *parent) : QObject(parent)
     UiPrefs.sbRadiusRange->setValue(radiusRange*1000.0);
     UiPrefs.sbIntWidth->setValue(intWidth*1000.0);
     UiPrefs.sbMachineOffset->setValue(machineOffset);
+    UiPrefs.cbIntMode->setCurrentIndex(intMode);
+    UiPrefs.sbClipSigma->setValue(clipSigma);
+    UiPrefs.chkExportEsd->setChecked(exportEsd);
+    UiPrefs.chkAutoFindCenters->setChecked(autoFindCenters);
 
     connect(UiPrefs.buttonBox->button(QDialogButtonBox::Save), SIGNAL(clicked()), this, SLOT(saveConfig()));
     connect(UiPrefs.buttonBox->button(QDialogButtonBox::Cancel), SIGNAL(clicked()), prefsDialog, SLOT(hide()));
     connect(UiPrefs.chkIterateUntilNoChange, SIGNAL(toggled(bool)), this, SLOT(updateNoChange(bool)));
+    connect(UiPrefs.chkWarmStart, SIGNAL(toggled(bool)), this, SLOT(updateWarmStart(bool)));
     connect(UiPrefs.sbBinSize, SIGNAL(valueChanged(double)), this, SLOT(updateIntStep(double)));
     connect(UiPrefs.cbActiveOpt, SIGNAL(currentIndexChanged(int)), this, SLOT(updateOptIndex(int)));
     connect(UiPrefs.cbSource, SIGNAL(currentIndexChanged(int)), this, SLOT(updateSourceIndex(int)));
@@ -59,6 +65,10 @@ AppConfig::AppConfig(QWidget *parent) : QObject(parent)
     connect(UiPrefs.sbRadiusRange, SIGNAL(valueChanged(double)), this, SLOT(updateRadiusRange(double)));
     connect(UiPrefs.sbIntWidth, SIGNAL(valueChanged(double)), this, SLOT(updateIntWidth(double)));
     connect(UiPrefs.sbMachineOffset, SIGNAL(valueChanged(double)), this, SLOT(updateMachineOffset(double)));
+    connect(UiPrefs.cbIntMode, SIGNAL(currentIndexChanged(int)), this, SLOT(updateIntMode(int)));
+    connect(UiPrefs.sbClipSigma, SIGNAL(valueChanged(double)), this, SLOT(updateClipSigma(double)));
+    connect(UiPrefs.chkExportEsd, SIGNAL(toggled(bool)), this, SLOT(updateExportEsd(bool)));
+    connect(UiPrefs.chkAutoFindCenters, SIGNAL(toggled(bool)), this, SLOT(updateAutoFindCenters(bool)));
     connect(UiPrefs.tbAdd, SIGNAL(clicked()), this, SLOT(addRegion()));
     connect(UiPrefs.tbDelete, SIGNAL(clicked()), this, SLOT(deleteRegion()));
 
@@ -118,12 +128,11 @@ void AppConfig::saveRegionsFromTable()
    !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!*/
 
 /* ****************************************************************************
- * method: loadConfig
- * description: uses ConfigFile to load configuration from current directory
- *   in windows/linux or from package sub-directory in osx.  Default values
- *   that will be used if a configuration file is not found are located here.
+ * method: configFileName
+ * description: DIIS.cfg in the current directory in windows/linux or in the
+ *   package sub-directory in osx.
  * ***************************************************************************/
-void AppConfig::loadConfig()
+QString AppConfig::configFileName()
 {
     QString cdir = QDir::currentPath();
 #ifdef __APPLE__
@@ -132,12 +141,24 @@ void AppConfig::loadConfig()
     else
         cdir = QDir::currentPath() + QString("/DIIS.app/Contents/MacOS");
 #endif
-    ConfigFile config( cdir.toStdString() + "/DIIS.cfg" );
+    return cdir + QString("/DIIS.cfg");
+}
+
+/* ****************************************************************************
+ * method: loadConfig
+ * description: uses ConfigFile to load configuration from current directory
+ *   in windows/linux or from package sub-directory in osx.  Default values
+ *   that will be used if a configuration file is not found are located here.
+ * ***************************************************************************/
+void AppConfig::loadConfig()
+{
+    ConfigFile config( configFileName().toStdString() );
 
     config.readInto(lastPath, "path", QDir::currentPath().toStdString());
     config.readInto(cameraRadius, "camera_radius", 0.1146/2.0);
     config.readInto(intStepSize, "integration_resolution", 0.025);
     config.readInto(untilNoChange, "iterate_until_no_change", false);
+    config.readInto(warmStart, "optimization_warm_start", true);
     config.readInto(optIndex, "optimization_scheme_index", 1);
     config.readInto(sourceIndex, "source_index", 1);
     config.readInto(circleRadius, "circle_radius", 2.0);
@@ -150,6 +171,10 @@ void AppConfig::loadConfig()
     config.readInto(radiusRange, "optimization_radiusrange_sharpness", 1.0);
     config.readInto(machineOffset, "machine_offset", 0.0);
     config.readInto(intWidth, "integration_width", 0.0254);
+    config.readInto(intMode, "integration_mode", 0);
+    config.readInto(clipSigma, "integration_clip_sigma", 3.0);
+    config.readInto(exportEsd, "export_esd", false);
+    config.readInto(autoFindCenters, "auto_find_centers", true);
     config.readInto(normalizeOpt, "optimization_normalize", false);
     config.readInto(useSearchGrid, "optimization_searchgrid", false);
 
@@ -189,6 +214,30 @@ void AppConfig::loadConfig()
         config.readInto(mm.autoSave, "macro_" + QString::number(i).toStdString() + "_autosave", false);
         mineralMacros[mm.title] = mm;
     }
+
+    int calibrationCount = 0;
+    config.readInto(calibrationCount, "calibration_count", 0);
+
+    for (int i = 0; i < calibrationCount; i++)
+    {
+        CalibrationProfile cp;
+        string tempName;
+        int x, y;
+        string cfgkey = "calibration_" + QString::number(i).toStdString() + "_";
+        config.readInto(tempName, cfgkey + "name", tr("Calibration").toStdString());
+        cp.name = QString::fromStdString(tempName);
+        config.readInto(cp.radius, cfgkey + "radius", cameraRadius);
+        config.readInto(cp.phi, cfgkey + "phi", 0.0);
+        config.readInto(cp.alpha, cfgkey + "alpha", 0.0);
+        config.readInto(x, cfgkey + "zero_dx", 0);
+        config.readInto(y, cfgkey + "zero_dy", 0);
+        cp.zeroOffset = QPoint(x, y);
+        config.readInto(x, cfgkey + "oneeighty_dx", 0);
+        config.readInto(y, cfgkey + "oneeighty_dy", 0);
+        cp.oneEightyOffset = QPoint(x, y);
+        config.readInto(cp.dpm, cfgkey + "dpm", 0.0);
+        calibrations[cp.name] = cp;
+    }
 }
 
 /* ****************************************************************************
@@ -199,19 +248,13 @@ void AppConfig::loadConfig()
  * ***************************************************************************/
 void AppConfig::saveConfig()
 {
-    QString cdir = QDir::currentPath();
-#ifdef __APPLE__
-    if (QDir::currentPath().contains("DIIS.app/Contents/MacOS"))
-        cdir = QDir::currentPath();
-    else
-        cdir = QDir::currentPath() + QString("/DIIS.app/Contents/MacOS");
-#endif
-    ConfigFile config( cdir.toStdString() + "/DIIS.cfg" );
+    ConfigFile config( configFileName().toStdString() );
 
     config.add("path", lastPath);
     config.add("camera_radius", cameraRadius);
     config.add("integration_resolution", intStepSize);
     config.add("iterate_until_no_change", untilNoChange);
+    config.add("optimization_warm_start", warmStart);
     config.add("optimization_scheme_index", optIndex);
     config.add("source_index", sourceIndex);
     config.add("circle_radius", circleRadius);
@@ -224,6 +267,10 @@ void AppConfig::saveConfig()
     config.add("optimization_radiusrange_sharpness", radiusRange);
     config.add("integration_width", intWidth);
     config.add("machine_offset", machineOffset);
+    config.add("integration_mode", intMode);
+    config.add("integration_clip_sigma", clipSigma);
+    config.add("export_esd", exportEsd);
+    config.add("auto_find_centers", autoFindCenters);
     config.add("optimization_searchgrid", useSearchGrid);
     config.add("optimization_normalize", normalizeOpt);
 
@@ -259,11 +306,76 @@ void AppConfig::saveConfig()
 
     config.add("macro_count", macroCount);
 
-    QString outFile = cdir + QString("/DIIS.cfg");
-    ofstream cfgFile(outFile.toStdString().c_str());
+    addCalibrations(config);
+
+    ofstream cfgFile(configFileName().toStdString().c_str());
     if (cfgFile.good())
         cfgFile << config;
 
     emit valuesChanged();
     prefsDialog->hide();
 }
+
+/* ****************************************************************************
+ * method: addCalibrations
+ * description: adds the calibration profiles to config, numbered from 0.
+ * ***************************************************************************/
+void AppConfig::addCalibrations(ConfigFile &config)
+{
+    QMapIterator<QString, CalibrationProfile> calibrationIter(calibrations);
+    int calibrationCount = 0;
+    while (calibrationIter.hasNext()) {
+        calibrationIter.next();
+        const CalibrationProfile &cp = calibrationIter.value();
+
+        string cfgkey = "calibration_" + QString::number(calibrationCount).toStdString() + "_";
+        config.add(cfgkey + "name", cp.name.toStdString());
+        config.add(cfgkey + "radius", cp.radius);
+        config.add(cfgkey + "phi", cp.phi);
+        config.add(cfgkey + "alpha", cp.alpha);
+        config.add(cfgkey + "zero_dx", cp.zeroOffset.x());
+        config.add(cfgkey + "zero_dy", cp.zeroOffset.y());
+        config.add(cfgkey + "oneeighty_dx", cp.oneEightyOffset.x());
+        config.add(cfgkey + "oneeighty_dy", cp.oneEightyOffset.y());
+        config.add(cfgkey + "dpm", cp.dpm);
+        calibrationCount++;
+    }
+
+    config.add("calibration_count", calibrationCount);
+}
+
+/* ****************************************************************************
+ * method: saveCalibrations
+ * description: rewrites only the calibration profiles in the configuration
+ *   file and leaves every other key as it was last saved.  The preferences
+ *   take effect as they are edited, so saveConfig would also store edits
+ *   the dialog was then cancelled on.
+ * ***************************************************************************/
+void AppConfig::saveCalibrations()
+{
+    QString fileName = configFileName();
+    ConfigFile config;
+    if (QFile::exists(fileName))
+        config = ConfigFile(fileName.toStdString());
+
+    static const char *keys[] = { "name", "radius", "phi", "alpha", "zero_dx", "zero_dy",
+                                  "oneeighty_dx", "oneeighty_dy", "dpm" };
+
+    int oldCount = 0;
+    config.readInto(oldCount, "calibration_count", 0);
+    for (int i = 0; i < oldCount; i++)
+    {
+        string cfgkey = "calibration_" + QString::number(i).toStdString() + "_";
+        for (unsigned int k = 0; k < sizeof(keys)/sizeof(keys[0]); k++)
+        {
+            if (config.keyExists(cfgkey + keys[k]))
+                config.remove(cfgkey + keys[k]);
+        }
+    }
+
+    addCalibrations(config);
+
+    ofstream cfgFile(fileName.toStdString().c_str());
+    if (cfgFile.good())
+        cfgFile << config;
+}
@@ -13,6 +13,8 @@
 #include <QDialog>
 #include <QPushButton>
 #include <QDir>
+#include <QFile>
+#include <QPoint>
 #include <QVarLengthArray>
 
 #include <iostream>
@@ -50,6 +52,22 @@ struct MineralMacro
     bool autoSave;
 };
 
+/* Geometry of a camera refined once on a standard, to be applied to later
+ * films.  The centers are kept relative to the 0 degree guess (the beam
+ * hole), in pixels at dpm. */
+struct CalibrationProfile
+{
+    QString name;
+    double radius;              /* [m] */
+    double phi;                 /* [deg] */
+    double alpha;               /* [deg] */
+    QPoint zeroOffset;          /* 0 degree center from the guess */
+    QPoint oneEightyOffset;     /* 180 degree center from the 0 degree center */
+    double dpm;
+
+    CalibrationProfile() : radius(0.0), phi(0.0), alpha(0.0), dpm(0.0) {}
+};
+
 /* !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
  * Main class definition
  * !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!*/
@@ -71,6 +89,7 @@ public:
     string getLastPath() { return lastPath; }
 
     bool getUntilNoChange() { return untilNoChange; }
+    bool getWarmStart() { return warmStart; }
     bool getNormalizeOpt() { return normalizeOpt; }
     bool getUseSearchGrid() { return useSearchGrid; }
 
@@ -88,6 +107,10 @@ public:
     double getIntStepSize() { return intStepSize; }
     double getIntWidth() { return intWidth; }
     double getMachineOffset() { return machineOffset; }
+    int getIntMode() { return intMode; }
+    double getClipSigma() { return clipSigma; }
+    bool getExportEsd() { return exportEsd; }
+    bool getAutoFindCenters() { return autoFindCenters; }
 
     double getLambda() { return (sourceIndex == CuIndex) ? CuLambda : CoLambda; }
 
@@ -95,13 +118,19 @@ public:
     OptimizationRegion getOptRegion(QString name) { return optRegions[name]; }
     QMap<QString, MineralMacro> getMineralMacros() { return mineralMacros; }
     MineralMacro getMineralMacro(QString title) { return mineralMacros[title]; }
+    QMap<QString, CalibrationProfile> getCalibrations() { return calibrations; }
+    CalibrationProfile getCalibration(QString name) { return calibrations[name]; }
 
     /* Storing methods */
     void saveOptRegion(QString name, OptimizationRegion oreg) { optRegions[name] = oreg; populateRegions(); }
     void saveMineralMacro(QString title, MineralMacro mm) {  mineralMacros[title] = mm;  }
     void setLastPath(string p) { lastPath = p; }
 
+    void saveCalibration(QString name, CalibrationProfile cp) { calibrations[name] = cp; }
+
     void deleteMacro(QString title) { mineralMacros.remove(title); }
+    void deleteCalibration(QString name) { calibrations.remove(name); }
+    bool hasCalibration(QString name) { return calibrations.contains(name); }
 
     void populateRegions();
     void saveRegionsFromTable();
@@ -113,12 +142,14 @@ signals:
 public slots:
     void loadConfig();
     void saveConfig();
+    void saveCalibrations();
     void showPrefs() { prefsDialog->show(); populateRegions(); }
     void addRegion();
     void deleteRegion();
 
 private slots:
     void updateNoChange(bool b) { untilNoChange = b; }
+    void updateWarmStart(bool b) { warmStart = b; }
     void updateIntStep(double d) { intStepSize = d; }
     void updateOptIndex(int i) { optIndex = i; }
     void updateSourceIndex(int i) { sourceIndex = i; }
@@ -133,10 +164,17 @@ private slots:
     void updateCameraRadius(double r) { cameraRadius = r/1000.0; }
     void updateIntWidth(double w) { intWidth = w/1000.0; }
     void updateMachineOffset(double m) { machineOffset = m; }
+    void updateIntMode(int i) { intMode = i; }
+    void updateClipSigma(double s) { clipSigma = s; }
+    void updateExportEsd(bool b) { exportEsd = b; }
+    void updateAutoFindCenters(bool b) { autoFindCenters = b; }
     void updateUseSearchGrid(bool b) { useSearchGrid = b; }
     void updateNormalizeOpt(bool b) { normalizeOpt = b; }
 
 private:
+    QString configFileName();
+    void addCalibrations(ConfigFile &config);
+
     Ui::PreferencesDialog UiPrefs;
     QDialog *prefsDialog;
     ConfigFile *cfgFile;
@@ -144,6 +182,7 @@ private:
     /* General */
     int sourceIndex;
     double cameraRadius;
+    bool autoFindCenters;
 
     /* Optimization */
     int optIndex;    
@@ -152,6 +191,7 @@ private:
     int xRangeSharpness;
     int yRangeSharpness;
     bool untilNoChange;
+    bool warmStart;
     bool normalizeOpt;
     bool useSearchGrid;
     double phiRange;
@@ -163,11 +203,15 @@ private:
     double circleRadius;
     double intWidth;
     double machineOffset;
+    int intMode;
+    double clipSigma;
+    bool exportEsd;
 
     /* Other */
     string lastPath;
     QMap<QString, OptimizationRegion> optRegions;
     QMap<QString, MineralMacro> mineralMacros;
+    QMap<QString, CalibrationProfile> calibrations;
 };
 
 #endif
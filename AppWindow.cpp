@@ -53,8 +53,10 @@ AppWindow::AppWindow(AppConfig &_appConfig)
     UiImage.setupUi(imageDialog);
 
     connect(UiImage.hsBrightness, SIGNAL(valueChanged(int)), this, SLOT(updateImageDialog()));
+    connect(UiImage.hsBrightness, SIGNAL(valueChanged(int)), this, SLOT(updateImage()));
 
     connect(UiImage.hsGamma, SIGNAL(valueChanged(int)), this, SLOT(updateImageDialog()));
+    connect(UiImage.hsGamma, SIGNAL(valueChanged(int)), this, SLOT(updateImage()));
     connect(UiImage.buttonBox->button(QDialogButtonBox::Ok), SIGNAL(clicked()), this, SLOT(updateImage()));
 
     connect(UiGeo.buttonBox->button(QDialogButtonBox::Reset), SIGNAL(clicked()), this, SLOT(resetGeometry()));
@@ -87,6 +89,14 @@ AppWindow::AppWindow(AppConfig &_appConfig)
     this->addDockWidget(Qt::BottomDockWidgetArea, logDockWidget);
     logDockWidget->hide();
 
+    timings = new InstrumentationWidget(this);
+    timingsDockWidget = new QDockWidget("Timings", this);
+    timingsDockWidget->setAllowedAreas(Qt::LeftDockWidgetArea | Qt::RightDockWidgetArea | Qt::TopDockWidgetArea | Qt::BottomDockWidgetArea);
+    timingsDockWidget->setWidget(timings);
+    timingsDockWidget->setMinimumHeight(100);
+    this->addDockWidget(Qt::BottomDockWidgetArea, timingsDockWidget);
+    timingsDockWidget->hide();
+
     /* Create menus and buttons for main window */
     createActions();
     createMenus();
@@ -194,8 +204,8 @@ void AppWindow::zoomOut()
  * ***************************************************************************/
 void AppWindow::normalSize()
 {
-    gandolfiFilm->adjustSize();
     gandolfiFilm->setScaleFactor(1.0);
+    gandolfiFilm->adjustSize();
     log->addMessage("Zoomed to full size (100%).");
 }
 
@@ -212,10 +222,10 @@ void AppWindow::fitToWindow()
     //    }
     //    updateActions();
 
-    Q_ASSERT(gandolfiFilm->pixmap());
+    Q_ASSERT(gandolfiFilm->hasFilm());
 
     gandolfiFilm->setScaleFactor(this->width()/gandolfiFilm->width());
-    gandolfiFilm->resize(gandolfiFilm->getScaleFactor() * gandolfiFilm->pixmap()->size());
+    gandolfiFilm->resize(gandolfiFilm->getScaleFactor() * gandolfiFilm->getViewSize());
 
     //adjustScrollBar(scrollArea->horizontalScrollBar(), factor);
     // adjustScrollBar(scrollArea->verticalScrollBar(), factor);
@@ -251,20 +261,13 @@ void AppWindow::integrate()
  * ***************************************************************************/
 void AppWindow::changeDPI()
 {
-    QImage film = gandolfiFilm->pixmap()->toImage();
-    int currentWidth = film.width();
     int currentDPI = gandolfiFilm->getDPI();
 
     bool ok;
     int newDPI = QInputDialog::getInt(this, tr("Change DPI"), tr("New DPI:"), currentDPI, 100, 5000, 25, &ok);
 
     if (ok) {
-        double ratio = (double)newDPI/(double)currentDPI;
-        int newWidth = int(ratio*currentWidth);
-
-        gandolfiFilm->setPixmap(QPixmap::fromImage(film.scaledToWidth(newWidth, Qt::SmoothTransformation)));
-        gandolfiFilm->setData(film.scaledToWidth(newWidth, Qt::SmoothTransformation));
-        gandolfiFilm->setDPM(newDPI/0.0254);
+        gandolfiFilm->changeDPM(newDPI/0.0254);
 
         log->addMessage(tr("[GandolfiFilm] Old DPI %1, new DPI %2.").arg(QString::number(currentDPI), QString::number(newDPI)));
     }
@@ -288,140 +291,93 @@ void AppWindow::deskew() { gandolfiFilm->startDeskew(); }
  * ***************************************************************************/
 void AppWindow::optimize()
 {
-    int optSteps = (UiGeo.cbOpt0Center->isChecked()*2 + UiGeo.cbOpt180Center->isChecked()*2 + UiGeo.cbOptAlpha->isChecked() + UiGeo.cbOptPhi->isChecked() + UiGeo.cbOptRadius->isChecked());
-    QProgressDialog progress("Performing optimization", "Abort", 0, optSteps, this);
+    OptimizerStrategy strategy;
+    strategy.sharpness = (appConfig->getOptIndex() == SharpnessOpt);
+    strategy.untilNoChange = appConfig->getUntilNoChange();
+    strategy.warmStart = appConfig->getWarmStart() && gandolfiFilm->getGeometry()->converged;
+    strategy.steps = (UiGeo.cbOpt0Center->isChecked() ? OptimizeZeroCenter : 0) |
+                     (UiGeo.cbOpt180Center->isChecked() ? OptimizeOneEightyCenter : 0) |
+                     (UiGeo.cbOptAlpha->isChecked() ? OptimizeAlpha : 0) |
+                     (UiGeo.cbOptRadius->isChecked() ? OptimizeRadius : 0) |
+                     (UiGeo.cbOptPhi->isChecked() ? OptimizePhi : 0);
+
+    QList<int> steps = strategy.stepList();
+    QProgressDialog progress("Performing optimization", "Abort", 0, steps.size(), this);
     progress.setWindowModality(Qt::ApplicationModal);
     progress.setMinimumDuration(0.0);
-    progress.setValue(1);
-
-    bool sharpOpt;
 
-    if (appConfig->getOptIndex() == SharpnessOpt)
-        sharpOpt = true;
-    else
-        sharpOpt = false;
+    if (strategy.warmStart)
+        log->addMessage("[Main] Starting from the last optimized geometry.");
 
-    if (UiGeo.cbOpt0Center->isChecked())
+    for (int i = 0; i < steps.size() && !progress.wasCanceled(); i++)
     {
-        log->addMessage("Optimzing 0 degree center...");
-        progress.setWindowTitle(tr("Iteration: %1").arg(1));
-
-
-        if (sharpOpt)
-        {
-            QPoint lastPoint = gandolfiFilm->getGeometry()->zeroDegreeCenter;
-            QPoint newPoint;
-            int newX = gandolfiFilm->optimizeCenterXSharpness(ZERO_DEGREES).x();
-            progress.setValue(progress.value() + 1);
-            cout << "Calling y opt routine..." << endl;
-            int newY = gandolfiFilm->optimizeCenterYSharpness(ZERO_DEGREES).y();
-            progress.setValue(progress.value() + 1);
-            newPoint = QPoint(newX, newY);
-
-            while (newPoint != lastPoint && appConfig->getUntilNoChange())
-            {
-                progress.setValue(progress.value() - 2);
-                newX = gandolfiFilm->optimizeCenterXSharpness(ZERO_DEGREES).x();
-                progress.setValue(progress.value() + 1);
-                newY = gandolfiFilm->optimizeCenterYSharpness(ZERO_DEGREES).y();
-                progress.setValue(progress.value() + 1);
-                lastPoint = newPoint;
-                newPoint = QPoint(newX, newY);
-            }
-        } else
-        {
-            QPoint lastPoint = gandolfiFilm->getGeometry()->zeroDegreeCenter;
-            QPoint newPoint;
-            int newX = gandolfiFilm->optimizeCenterXSymmetry(ZERO_DEGREES).x();
-            int newY = gandolfiFilm->optimizeCenterYSymmetry(ZERO_DEGREES).y();
-            newPoint = QPoint(newX, newY);
-
-            while (newPoint != lastPoint && appConfig->getUntilNoChange())
-            {
-                newX = gandolfiFilm->optimizeCenterXSymmetry(ZERO_DEGREES).x();
-                newY = gandolfiFilm->optimizeCenterYSymmetry(ZERO_DEGREES).y();
-                lastPoint = newPoint;
-                newPoint = QPoint(newX, newY);
-            }
-
-        }
-
-
+        progress.setValue(i);
+        log->addMessage(optimizerStepName(steps.at(i)));
+        gandolfiFilm->optimizeStep(steps.at(i), strategy);
     }
 
-    if (UiGeo.cbOpt180Center->isChecked())
-    {
-        log->addMessage("Optimizing 180 degree center...");
-        if (sharpOpt)
-        {
-            QPoint lastPoint = gandolfiFilm->getGeometry()->oneEightyDegreeCenter;
-            QPoint newPoint;
-            int newX = gandolfiFilm->optimizeCenterXSharpness(ONEEIGHTY_DEGREES).x();
-            int newY = gandolfiFilm->optimizeCenterYSharpness(ONEEIGHTY_DEGREES).y();
-            newPoint = QPoint(newX, newY);
-
-            while (newPoint != lastPoint && appConfig->getUntilNoChange())
-            {
-                newX = gandolfiFilm->optimizeCenterXSharpness(ONEEIGHTY_DEGREES).x();
-                newY = gandolfiFilm->optimizeCenterYSharpness(ONEEIGHTY_DEGREES).y();
-                lastPoint = newPoint;
-                newPoint = QPoint(newX, newY);
-            }
-        } else
-        {
-            QPoint lastPoint = gandolfiFilm->getGeometry()->oneEightyDegreeCenter;
-            QPoint newPoint;
-            int newX = gandolfiFilm->optimizeCenterXSymmetry(ONEEIGHTY_DEGREES).x();
-            int newY = gandolfiFilm->optimizeCenterYSymmetry(ONEEIGHTY_DEGREES).y();
-            newPoint = QPoint(newX, newY);
-
-            while (newPoint != lastPoint && appConfig->getUntilNoChange())
-            {
-                newX = gandolfiFilm->optimizeCenterXSymmetry(ONEEIGHTY_DEGREES).x();
-                newY = gandolfiFilm->optimizeCenterYSymmetry(ONEEIGHTY_DEGREES).y();
-                lastPoint = newPoint;
-                newPoint = QPoint(newX, newY);
-            }
-        }
-        progress.setValue(progress.value() + 1);
-
-    }
+    if (!progress.wasCanceled())
+        gandolfiFilm->getGeometry()->converged = true;
 
-    if (UiGeo.cbOptAlpha->isChecked())
-    {
-        log->addMessage("Optimizing alpha rotation...");
-        if (sharpOpt)
-            gandolfiFilm->optimizeAlphaSharpness();
-        else
-            gandolfiFilm->optimizeRotationSymmetry();
-        progress.setValue(progress.value() + 1);
+    progress.setValue(steps.size());
+    this->updateGeometryValues();
+}
 
+/* ****************************************************************************
+ * populateCalibrations
+ * Lists the saved calibration profiles in the apply and delete calibration
+ * menus
+ * ***************************************************************************/
+void AppWindow::populateCalibrations()
+{
+    calibrationMenu->clear();
+    deleteCalibrationMenu->clear();
+
+    QMap<QString, CalibrationProfile> calibrations = appConfig->getCalibrations();
+    QMapIterator<QString, CalibrationProfile> calibrationIter(calibrations);
+    while (calibrationIter.hasNext()) {
+        calibrationIter.next();
+        QAction *a = calibrationMenu->addAction(calibrationIter.key());
+        a->setData(calibrationIter.key());
+        a->setEnabled(gandolfiFilm->hasFilm());
+        deleteCalibrationMenu->addAction(calibrationIter.key())->setData(calibrationIter.key());
     }
 
-    if (UiGeo.cbOptRadius->isChecked())
+    if (calibrations.isEmpty())
     {
-        log->addMessage("Optimizing camera radius...");
-        if (sharpOpt)
-            gandolfiFilm->optimizeRadiusSharpness();
-        else
-            gandolfiFilm->optimizeRadiusSymmetry();
-
-        progress.setValue(progress.value() + 1);
-
+        calibrationMenu->addAction(tr("No calibrations saved"))->setEnabled(false);
+        deleteCalibrationMenu->addAction(tr("No calibrations saved"))->setEnabled(false);
     }
+}
 
+/* ****************************************************************************
+ * applyCalibration
+ * Applies a calibration profile in place of a full optimization
+ * ***************************************************************************/
+void AppWindow::applyCalibration(QAction *a)
+{
+    if (!a->data().isValid()) return;
 
+    if (gandolfiFilm->applyCalibration(appConfig->getCalibration(a->data().toString())))
+        this->updateGeometryValues();
+}
 
-    if (UiGeo.cbOptPhi->isChecked())
-    {
-        log->addMessage("Optimizing phi rotation...");
-        gandolfiFilm->optimizePhiSharpness();
-        progress.setValue(progress.value() + 1);
+/* ****************************************************************************
+ * deleteCalibration
+ * Removes a calibration profile from the configuration after confirmation
+ * ***************************************************************************/
+void AppWindow::deleteCalibration(QAction *a)
+{
+    if (!a->data().isValid()) return;
 
-    }
+    QString name = a->data().toString();
+    if (QMessageBox::question(this, tr("Delete calibration"), tr("Delete the calibration %1?").arg(name),
+                              QMessageBox::Ok | QMessageBox::Cancel, QMessageBox::Cancel) != QMessageBox::Ok)
+        return;
 
-    progress.setValue(optSteps);
-    this->updateGeometryValues();
+    appConfig->deleteCalibration(name);
+    appConfig->saveCalibrations();
+    log->addMessage(tr("[AppWindow] Calibration %1 deleted.").arg(name));
 }
 
 /* !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
@@ -460,10 +416,23 @@ void AppWindow::createActions()
     prefsAct = new QAction(tr("Preferences"), this);
     connect(prefsAct, SIGNAL(triggered()), this, SLOT(showPrefs()));
 
+    // Edit menu actions...
+
+    undoAct = new QAction(tr("&Undo"), this);
+    undoAct->setShortcut(tr("Ctrl+Z"));
+    connect(undoAct, SIGNAL(triggered()), gandolfiFilm, SLOT(undo()));
+
+    redoAct = new QAction(tr("&Redo"), this);
+    redoAct->setShortcut(tr("Ctrl+Y"));
+    connect(redoAct, SIGNAL(triggered()), gandolfiFilm, SLOT(redo()));
+
+    connect(gandolfiFilm, SIGNAL(historyChanged()), this, SLOT(updateEditActions()));
+    updateEditActions();
+
     // View menu actions...
 
     zoomInAct = new QAction(tr("Zoom &In (25%)"), this);
-    zoomInAct->setShortcut(tr("Ctrl+z"));
+    zoomInAct->setShortcut(tr("Ctrl++"));
     zoomInAct->setEnabled(false);
     connect(zoomInAct, SIGNAL(triggered()), this, SLOT(zoomIn()));
 
@@ -488,6 +457,9 @@ void AppWindow::createActions()
     cropAct = new QAction(tr("Crop"), this);
     connect(cropAct, SIGNAL(triggered()), this, SLOT(crop()));
 
+    resetCropAct = new QAction(tr("Reset crop"), this);
+    connect(resetCropAct, SIGNAL(triggered()), gandolfiFilm, SLOT(resetCrop()));
+
     deskewAct = new QAction(tr("Deskew"), this);
     connect(deskewAct, SIGNAL(triggered()), this, SLOT(deskew()));
 
@@ -503,12 +475,18 @@ void AppWindow::createActions()
     dpiAct = new QAction(tr("&Change DPI"), this);
     connect(dpiAct, SIGNAL(triggered()), this, SLOT(changeDPI()));
 
+    findCentersAct = new QAction(tr("&Find centers"), this);
+    connect(findCentersAct, SIGNAL(triggered()), gandolfiFilm, SLOT(findCenters()));
+
     optimizeAct = new QAction(tr("&Optimize"), this);
     connect(optimizeAct, SIGNAL(triggered()), this, SLOT(optimize()));
 
     integrateAct = new QAction(tr("&Integrate"), this);
     connect(integrateAct, SIGNAL(triggered()), this, SLOT(integrate()));
 
+    saveCalibrationAct = new QAction(tr("Save calibration..."), this);
+    connect(saveCalibrationAct, SIGNAL(triggered()), gandolfiFilm, SLOT(saveCalibration()));
+
     // Window menu actions...
     showAppWindowAct = new QAction(tr("Main Window"), this);
     connect(showAppWindowAct, SIGNAL(triggered()), this, SLOT(show()));
@@ -543,6 +521,10 @@ void AppWindow::createMenus()
     fileMenu->addAction(closeAct);
     fileMenu->addAction(exitAct);
 
+    editMenu = new QMenu(tr("&Edit"), this);
+    editMenu->addAction(undoAct);
+    editMenu->addAction(redoAct);
+
     viewMenu = new QMenu(tr("&View"), this);
     viewMenu->addAction(zoomInAct);
     viewMenu->addAction(zoomOutAct);
@@ -553,23 +535,35 @@ void AppWindow::createMenus()
     imageMenu->addAction(invertAct);
     imageMenu->addSeparator();
     imageMenu->addAction(cropAct);
+    imageMenu->addAction(resetCropAct);
     imageMenu->addAction(deskewAct);
     imageMenu->addAction(rotateAct);
     imageMenu->addSeparator();
     imageMenu->addAction(dpiAct);
 
     toolsMenu = new QMenu(tr("&Tools"), this);
+    toolsMenu->addAction(findCentersAct);
     toolsMenu->addAction(optimizeAct);
     toolsMenu->addAction(integrateAct);
+    toolsMenu->addSeparator();
+    calibrationMenu = toolsMenu->addMenu(tr("Apply calibration"));
+    connect(calibrationMenu, SIGNAL(aboutToShow()), this, SLOT(populateCalibrations()));
+    connect(calibrationMenu, SIGNAL(triggered(QAction*)), this, SLOT(applyCalibration(QAction*)));
+    toolsMenu->addAction(saveCalibrationAct);
+    deleteCalibrationMenu = toolsMenu->addMenu(tr("Delete calibration"));
+    connect(deleteCalibrationMenu, SIGNAL(aboutToShow()), this, SLOT(populateCalibrations()));
+    connect(deleteCalibrationMenu, SIGNAL(triggered(QAction*)), this, SLOT(deleteCalibration(QAction*)));
 
     windowMenu = new QMenu(tr("&Window"), this);
     //windowMenu->addAction(showAppWindowAct);
     windowMenu->addAction(geoDockWidget->toggleViewAction());
     windowMenu->addAction(showTwoThetaWindowAct);
     windowMenu->addAction(showLogDockAct);
+    windowMenu->addAction(timingsDockWidget->toggleViewAction());
     windowMenu->addAction(showAboutWindowAct);
 
     menuBar()->addMenu(fileMenu);
+    menuBar()->addMenu(editMenu);
     menuBar()->addMenu(viewMenu);
     menuBar()->addMenu(imageMenu);
     menuBar()->addMenu(toolsMenu);
@@ -865,38 +859,11 @@ void AppWindow::updateImageDialog()
 
 void AppWindow::updateImage()
 {
-    cout << "Modifying image brightness and stuff." << endl;
-    QImage tempFilm = gandolfiFilm->getFilm();
-
     double b = pow(2.0,UiImage.hsBrightness->value());
     double g = double(UiImage.hsGamma->value())/10.0;
 
-    for (int x = 0; x < tempFilm.width(); x++)
-    {
-        for (int y = 0; y < tempFilm.height(); y++)
-        {
-            double gv = qGray(tempFilm.pixel(x,y));
-            QRgb pv = tempFilm.pixel(x,y);
-
-
-            //if (gv*b > 255)
-            //    tempFilm.setPixel(x,y, qRgb(255, 255, 255));
-            //else
-                tempFilm.setPixel(x,y, qRgb(qRed(pv)*b, qGreen(pv)*b, qBlue(pv)*b ));
-                 gv = qGray(tempFilm.pixel(x,y));
-                 pv = tempFilm.pixel(x,y);
-            //if (gv + o > 255)
-            //    tempFilm.setPixel(x,y, qRgb(255, 255, 255));
-            //else
-            //    tempFilm.setPixel(x,y, qRgb(qRed(pv) + o, qGreen(pv) + o, qBlue(pv) + o ));
-
-            tempFilm.setPixel(x,y, qRgb(255.0*pow(gv/255.0,g), 255.0*pow(gv/255.0, g), 255.0*pow(gv/255.0,g)));
-
-        }
-    }
-
-    gandolfiFilm->setImage(tempFilm);
-    gandolfiFilm->repaint();
+    // Only the displayed film changes, through a lookup table
+    gandolfiFilm->setDisplayLevels(b, g);
 }
 
 void AppWindow::updateGeometryValues()
@@ -989,6 +956,19 @@ void AppWindow::updateActions()
     }
 }
 
+/* ****************************************************************************
+ * updateEditActions
+ * Names the edit that undo/redo would revert and enables them accordingly
+ * ***************************************************************************/
+void AppWindow::updateEditActions()
+{
+    undoAct->setEnabled(gandolfiFilm->canUndo());
+    undoAct->setText(gandolfiFilm->canUndo() ? tr("&Undo %1").arg(gandolfiFilm->undoName()) : tr("&Undo"));
+
+    redoAct->setEnabled(gandolfiFilm->canRedo());
+    redoAct->setText(gandolfiFilm->canRedo() ? tr("&Redo %1").arg(gandolfiFilm->redoName()) : tr("&Redo"));
+}
+
 /* ****************************************************************************
  * scaleImage
  * Scale the image by <factor>
@@ -998,9 +978,9 @@ void AppWindow::scaleImage(double factor)
     int w,h;
     h = this->height();
 
-    Q_ASSERT(gandolfiFilm->pixmap());
+    Q_ASSERT(gandolfiFilm->hasFilm());
     gandolfiFilm->setScaleFactor(gandolfiFilm->getScaleFactor()*factor);
-    gandolfiFilm->resize(gandolfiFilm->getScaleFactor() * gandolfiFilm->pixmap()->size());
+    gandolfiFilm->resize(gandolfiFilm->getScaleFactor() * gandolfiFilm->getViewSize());
 
     adjustScrollBar(scrollArea->horizontalScrollBar(), factor);
     adjustScrollBar(scrollArea->verticalScrollBar(), factor);
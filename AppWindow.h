@@ -17,6 +17,7 @@
 #include "FilmWidget.h"
 #include "AppConfig.h"
 #include "LogWidget.h"
+#include "InstrumentationWidget.h"
 #include "ui_GeometryDialog.h"
 #include "ui_ImageDialog.h"
 
@@ -51,9 +52,14 @@ private slots:
     void normalSize();
     void fitToWindow();
 
+    void updateEditActions();
+
     void changeDPI();
     void integrate();
     void optimize();
+    void populateCalibrations();
+    void applyCalibration(QAction *a);
+    void deleteCalibration(QAction *a);
     void crop();
     void deskew();
 
@@ -80,6 +86,7 @@ private:
     FilmWidget *gandolfiFilm;
     QScrollArea *scrollArea;
     LogWidget *log;
+    InstrumentationWidget *timings;
     QPrinter printer;
 
     //QToolButton *btnRegion;
@@ -100,6 +107,10 @@ private:
     QAction *exitAct;
     QAction *prefsAct;
 
+    // Edit menu actions
+    QAction *undoAct;
+    QAction *redoAct;
+
     // View menu actions
     QAction *zoomInAct;
     QAction *zoomOutAct;
@@ -108,6 +119,7 @@ private:
 
     // Image menu actions
     QAction *cropAct;
+    QAction *resetCropAct;
     QAction *deskewAct;
     QAction *invertAct;
     QAction *rotateAct;
@@ -116,7 +128,9 @@ private:
 
     // Tools menu actions
     QAction *integrateAct;
+    QAction *findCentersAct;
     QAction *optimizeAct;
+    QAction *saveCalibrationAct;
 
     // Window menu actions
     QAction *showAppWindowAct;
@@ -125,8 +139,11 @@ private:
     QAction *showAboutWindowAct;
 
     QMenu *fileMenu;
+    QMenu *editMenu;
     QMenu *viewMenu;
     QMenu *toolsMenu;
+    QMenu *calibrationMenu;
+    QMenu *deleteCalibrationMenu;
     QMenu *windowMenu;
 
     QToolBar *toolbar;
@@ -134,6 +151,7 @@ private:
     Ui::ImageDialog UiImage;
     QDockWidget *geoDockWidget;
     QDockWidget *logDockWidget;
+    QDockWidget *timingsDockWidget;
     QDialog *geoDialog;
     QDialog *imageDialog;
 
@@ -0,0 +1,91 @@
+/* ***************************************************************************
+ * Background.cpp: implements the rolling circle background subtraction
+ * ***************************************************************************/
+
+/* !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+ * Headers, definitions, etc.
+ * !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!*/
+
+#include "Background.h"
+
+#include <cmath>
+
+/* Range of points [first, last] covered by a circle centred at cX */
+static void circleRange(const double *x, int n, double cX, double cR, int &first, int &last)
+{
+    double dx = x[1] - x[0];
+
+    first = int(floor((cX - cR - x[0])/dx + 0.5));
+    if (first < 0) first = 0;
+    if (first > n-1) first = n-1;
+
+    last = int(floor((cX + cR - x[0])/dx + 0.5));
+    if (last > n-1) last = n-1;
+    if (last < 0) last = 0;
+}
+
+/* ***************************************************************************
+ * function: circleY
+ * description: height at which a circle centred at cX just touches the data
+ *   from below.
+ * ***************************************************************************/
+static double circleY(const double *x, const double *y, int n, double cX, double cR)
+{
+    int first, last;
+    circleRange(x, n, cX, cR, first, last);
+
+    double mindiff = 1e20;
+    for (int i = first; i <= last; i++)
+    {
+        double diff = y[i] - (sqrt(cR*cR - (x[i] - cX)*(x[i] - cX)) - cR);
+        if (diff < mindiff)
+            mindiff = diff;
+    }
+
+    return mindiff - cR;
+}
+
+QVector<double> subtractCircleBackground(const double *x, const double *y, int n, double cR)
+{
+    QVector<double> out(n, 1e20);
+    if (n < 2) return QVector<double>(n, 0.0);
+
+    /* Normalize data so that h/w = 1 for minimal useful signal */
+    double minY = 1e20;
+    double maxY = 0.0;
+    for (int i = 0; i < n; i++)
+    {
+        minY = qMin(minY, y[i]);
+        maxY = qMax(maxY, y[i]);
+    }
+
+    double sP = (maxY - minY)/maxY;
+    double oP = minY;
+
+    QVector<double> scaled(n);
+    for (int i = 0; i < n; i++)
+        scaled[i] = sP*(y[i] - oP);
+
+    /* Lowest distance of each point above any circle that covers it */
+    for (int i = 0; i < n; i++)
+    {
+        double cX = x[i];
+        double cY = circleY(x, scaled.constData(), n, cX, cR);
+
+        int first, last;
+        circleRange(x, n, cX, cR, first, last);
+
+        for (int xi = first; xi <= last; xi++)
+        {
+            double diff = scaled[xi] - (sqrt(cR*cR - (x[xi] - cX)*(x[xi] - cX)) + cY);
+
+            if (diff < out[xi])
+                out[xi] = diff;
+        }
+    }
+
+    for (int i = 0; i < n; i++)
+        out[i] = out[i]/sP;
+
+    return out;
+}
@@ -0,0 +1,25 @@
+/* ***************************************************************************
+ * Background.h: defines the rolling circle background subtraction used on
+ *   integrated diffractograms
+ * ***************************************************************************/
+#ifndef Background_H
+#define Background_H
+
+/* !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+ * Headers, definitions, etc.
+ * !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!*/
+
+/* Qt related headers */
+#include <QVector>
+
+/* !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+ * Functions
+ * !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!*/
+
+/* Subtracts the background of (x, y), x equally spaced, by rolling a circle
+ * of radius cR (in x units) under the curve.  The data is first scaled so
+ * that its height relative to its maximum is about one, and the result is
+ * scaled back.  Returns the background subtracted y values. */
+QVector<double> subtractCircleBackground(const double *x, const double *y, int n, double cR);
+
+#endif
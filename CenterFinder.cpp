@@ -0,0 +1,306 @@
+/* ***************************************************************************
+ * CenterFinder.cpp: implements the detection of the film centers
+ * ***************************************************************************/
+
+/* !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+ * Headers, definitions, etc.
+ * !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!*/
+
+#include "CenterFinder.h"
+#include "Instrumentation.h"
+
+#include <complex>
+#include <math.h>
+
+typedef std::complex<double> Complex;
+
+/* !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+ * Projections
+ * !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!*/
+
+/* Mean gray value of each row over columns [x0, x1), every step'th column */
+static QVector<double> rowProfile(const FilmSampler &s, int x0, int x1, int step)
+{
+    QVector<double> p(s.height(), 0.0);
+
+    for (int y = 0; y < s.height(); y++)
+    {
+        double sum = 0.0;
+        int n = 0;
+        for (int x = qMax(x0, 0); x < qMin(x1, s.width()); x += step)
+        {
+            int g = s.gray(x, y);
+            if (g < 0) continue;
+            sum += g;
+            n++;
+        }
+        if (n > 0) p[y] = sum/n;
+    }
+
+    return p;
+}
+
+/* p less its running mean over width points, leaving the lines, holes and
+ * shadows on a zero background.  The ends, where the mean is one sided,
+ * are set to zero. */
+static QVector<double> highPass(const QVector<double> &p, int width)
+{
+    int n = p.size();
+    int half = qMax(width/2, 1);
+
+    QVector<double> prefix(n + 1, 0.0);
+    for (int i = 0; i < n; i++)
+        prefix[i + 1] = prefix[i] + p[i];
+
+    QVector<double> q(n, 0.0);
+    for (int i = half; i < n - half; i++)
+        q[i] = p[i] - (prefix[i + half + 1] - prefix[i - half])/(2*half + 1);
+
+    return q;
+}
+
+/* !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+ * Correlation
+ * !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!*/
+
+/* In place radix 2 FFT of a; a.size() must be a power of two.  The inverse
+ * is left unscaled. */
+static void fft(QVector<Complex> &a, bool inverse)
+{
+    int n = a.size();
+
+    for (int i = 1, j = 0; i < n; i++)
+    {
+        int bit = n >> 1;
+        for (; j & bit; bit >>= 1)
+            j ^= bit;
+        j ^= bit;
+        if (i < j) qSwap(a[i], a[j]);
+    }
+
+    for (int len = 2; len <= n; len <<= 1)
+    {
+        double angle = 2.0*M_PI/len*(inverse ? 1.0 : -1.0);
+        Complex wlen(cos(angle), sin(angle));
+
+        for (int i = 0; i < n; i += len)
+        {
+            Complex w(1.0, 0.0);
+            for (int j = 0; j < len/2; j++)
+            {
+                Complex u = a[i + j];
+                Complex v = a[i + j + len/2]*w;
+                a[i + j] = u + v;
+                a[i + j + len/2] = u - v;
+                w *= wlen;
+            }
+        }
+    }
+}
+
+/* Transform length for correlating n points without wrapping around */
+static int paddedSize(int n)
+{
+    int size = 1;
+    while (size < 2*n) size <<= 1;
+    return size;
+}
+
+/* Adds the squared transform of p, zero padded to sum.size(), to sum */
+static void addSquaredTransform(const QVector<double> &p, QVector<Complex> &sum)
+{
+    QVector<Complex> a(sum.size(), Complex(0.0, 0.0));
+    for (int i = 0; i < p.size(); i++)
+        a[i] = Complex(p[i], 0.0);
+
+    fft(a, false);
+    for (int i = 0; i < a.size(); i++)
+        sum[i] += a[i]*a[i];
+}
+
+/* The correlation of n points from the summed squared transforms */
+static QVector<double> correlationFromTransform(QVector<Complex> &sum, int n)
+{
+    fft(sum, true);
+
+    QVector<double> c(2*n - 1);
+    for (int s = 0; s < c.size(); s++)
+        c[s] = sum[s].real()/sum.size();
+
+    return c;
+}
+
+/* ***************************************************************************
+ * function: mirrorCorrelation
+ * description: correlating p with its mirror image is convolving p with
+ *   itself, so c is the inverse transform of the squared transform of p.
+ * ***************************************************************************/
+QVector<double> mirrorCorrelation(const QVector<double> &p)
+{
+    if (p.isEmpty()) return QVector<double>();
+
+    QVector<Complex> sum(paddedSize(p.size()), Complex(0.0, 0.0));
+    addSquaredTransform(p, sum);
+    return correlationFromTransform(sum, p.size());
+}
+
+/* ***************************************************************************
+ * function: rowMirrorCorrelation
+ * description: the mirror correlations of rows [y0, y1), every step'th,
+ *   each high passed, added up; transforms are linear, so this takes one
+ *   inverse transform.  A row near a center crosses each ring at two
+ *   points mirrored about the center column, where a projection of the
+ *   rows would see the whole ring in every column.  energy is set to the
+ *   sum of the squared high passed rows.
+ * ***************************************************************************/
+static QVector<double> rowMirrorCorrelation(const FilmSampler &s, int y0, int y1, int step, int smooth, double &energy)
+{
+    int w = s.width();
+    QVector<Complex> sum(paddedSize(w), Complex(0.0, 0.0));
+    QVector<double> p(w);
+    energy = 0.0;
+
+    for (int y = qMax(y0, 0); y < qMin(y1, s.height()); y += step)
+    {
+        for (int x = 0; x < w; x++)
+            p[x] = qMax(s.gray(x, y), 0);
+
+        QVector<double> q = highPass(p, smooth);
+        for (int x = 0; x < w; x++)
+        {
+            if (s.gray(x, y) < 0) q[x] = 0.0;
+            energy += q[x]*q[x];
+        }
+
+        addSquaredTransform(q, sum);
+    }
+
+    return correlationFromTransform(sum, w);
+}
+
+static double energy(const QVector<double> &p)
+{
+    double e = 0.0;
+    for (int i = 0; i < p.size(); i++)
+        e += p[i]*p[i];
+    return e;
+}
+
+/* The mirror axis (c index) in [first, last] correlating best */
+static int bestAxis(const QVector<double> &c, int first, int last)
+{
+    first = qMax(first, 0);
+    last = qMin(last, c.size() - 1);
+
+    int best = first;
+    for (int s = first; s <= last; s++)
+        if (c[s] > c[best]) best = s;
+
+    return best;
+}
+
+/* !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+ * Functions
+ * !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!*/
+
+/* ***************************************************************************
+ * function: findCenters
+ * description: the rings are mirror symmetric about the column of the
+ *   centers, and about the row of each center as far as the film reaches
+ *   on either side, and so are the beam holes and beam stop shadows.
+ *   Each projection is taken at about CENTER_FINDER_DPM across its length,
+ *   high passed, and correlated with its mirror image:
+ *   1. the rows of the whole film give the center column, its axis kept
+ *      to the middle half so the mirror overlaps half the film;
+ *   2. the row profile of an inch wide strip down that column gives the
+ *      rows: the pair of axes about pi*radius*dpm apart whose correlations
+ *      add up the most, the upper one correlating at least
+ *      CENTER_FINDER_MIN_AXIS (the low angle lines are the strongest);
+ *   3. the column is found again from the rows near the two centers only,
+ *      where the rings curve most.
+ * ***************************************************************************/
+CenterEstimate findCenters(const FilmSampler &film, double dpm, double cameraRadius)
+{
+    ScopedTimer timer("centers");
+
+    CenterEstimate e;
+    int w = film.width();
+    int h = film.height();
+    if (w < 8 || h < 8 || dpm <= 0.0) return e;
+
+    int step = qMax(1, qRound(dpm/CENTER_FINDER_DPM));
+    int smooth = qMax(3, qRound(CENTER_FINDER_SMOOTH*dpm));
+
+    /* 1. */
+    double ex;
+    QVector<double> cx = rowMirrorCorrelation(film, 0, h, 4*step, smooth, ex);
+    int sx = bestAxis(cx, w/2, 3*w/2);
+    int x = (sx + 1)/2;
+
+    /* 2. */
+    int half = qRound(0.0254*dpm/2.0);
+    QVector<double> py = highPass(rowProfile(film, x - half, x + half + 1, step), smooth);
+    QVector<double> cy = mirrorCorrelation(py);
+
+    double separation = M_PI*cameraRadius*dpm;
+    int minGap = qRound(2.0*separation*(1.0 - CENTER_FINDER_SEPARATION));
+    int maxGap = qRound(2.0*separation*(1.0 + CENTER_FINDER_SEPARATION));
+
+    /* Axes without room for a 180 degree center below are only tried on
+     * films too short to have one: the shadows of both centers are also
+     * mirror images of each other about their midpoint */
+    int last = (minGap < cy.size()) ? cy.size() - minGap - 1 : cy.size() - 1;
+
+    double ey = energy(py);
+    double least = CENTER_FINDER_MIN_AXIS*ey;
+
+    int s0 = 0, s180 = -1;
+    double best = -1.0e300;
+    for (int s = 0; s <= last; s++)
+    {
+        if (cy[s] < least) continue;
+
+        int t = (s + minGap < cy.size()) ? bestAxis(cy, s + minGap, s + maxGap) : -1;
+        double c = cy[s] + (t < 0 ? 0.0 : cy[t]);
+        if (c > best)
+        {
+            s0 = s;
+            s180 = t;
+            best = c;
+        }
+    }
+
+    if (best < least) return e;
+
+    bool has180 = (s180 >= 0 && cy[s180] >= least);
+    if (!has180) best = cy[s0];
+
+    int y0 = (s0 + 1)/2;
+    int y180 = has180 ? (s180 + 1)/2 : y0 + qRound(separation);
+
+    /* 3. */
+    int band = qRound(CENTER_FINDER_BAND*dpm);
+    cx = rowMirrorCorrelation(film, y0 - band, y0 + band + 1, step, smooth, ex);
+    if (has180)
+    {
+        double ex180;
+        QVector<double> cx180 = rowMirrorCorrelation(film, y180 - band, y180 + band + 1, step, smooth, ex180);
+        for (int i = 0; i < cx.size(); i++)
+            cx[i] += cx180[i];
+        ex += ex180;
+    }
+    sx = bestAxis(cx, w/2, 3*w/2);
+    x = (sx + 1)/2;
+
+    e.xSymmetry = (ex > 0.0) ? cx[sx]/ex : 0.0;
+    /* best adds the correlations about both rows when the 180 degree one
+     * was found, so it is averaged to stay relative to the energy */
+    double ySum = has180 ? 2.0*ey : ey;
+    e.ySymmetry = (ySum > 0.0) ? best/ySum : 0.0;
+    e.zeroDegreeCenter = QPoint(x, y0);
+    e.oneEightyDegreeCenter = QPoint(x, y180);
+    e.oneEightyFound = has180;
+    e.found = (e.xSymmetry >= CENTER_FINDER_MIN_SYMMETRY && e.ySymmetry >= CENTER_FINDER_MIN_SYMMETRY);
+
+    return e;
+}
@@ -0,0 +1,73 @@
+/* ***************************************************************************
+ * CenterFinder.h: defines the detection of the 0 and 180 degree centers of
+ *   a film from the mirror symmetry of its projections
+ * ***************************************************************************/
+#ifndef CenterFinder_H
+#define CenterFinder_H
+
+/* !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+ * Headers, definitions, etc.
+ * !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!*/
+
+/* Qt related headers */
+#include <QPoint>
+#include <QVector>
+
+#include "FilmSampler.h"
+
+/* Resolution the film is sampled at across the projections, and between the
+ * rows whose correlations are added [dots/m]; along them it keeps its own */
+#define CENTER_FINDER_DPM 4000.0
+
+/* Width of the running mean taken off the projections [m], removing the
+ * background and air scatter but not the lines */
+#define CENTER_FINDER_SMOOTH 0.005
+
+/* Rows either side of the centers the x axis is refined on [m] */
+#define CENTER_FINDER_BAND 0.04
+
+/* Fraction by which the center separation may differ from pi*radius*dpm
+ * (film shrinkage, an approximate camera radius) */
+#define CENTER_FINDER_SEPARATION 0.05
+
+/* Least correlation about a center's row, relative to the energy of the row
+ * profile, for it to be taken from the film */
+#define CENTER_FINDER_MIN_AXIS 0.05
+
+/* Least symmetry (see CenterEstimate) for the centers to count as found */
+#define CENTER_FINDER_MIN_SYMMETRY 0.2
+
+/* !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+ * Structures
+ * !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!*/
+
+/* Centers in view pixels.  The symmetries are the correlations of the
+ * projections with their mirror images at the centers, relative to their
+ * own energy: 1 for a perfectly symmetric film, about 0 for none.
+ * oneEightyFound is false when the 180 degree center was placed from the
+ * camera radius rather than found. */
+struct CenterEstimate
+{
+    QPoint zeroDegreeCenter;
+    QPoint oneEightyDegreeCenter;
+    double xSymmetry;
+    double ySymmetry;
+    bool oneEightyFound;
+    bool found;
+
+    CenterEstimate() : xSymmetry(0.0), ySymmetry(0.0), oneEightyFound(false), found(false) {}
+};
+
+/* !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+ * Functions
+ * !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!*/
+
+/* c[s] = sum over x of p[x]*p[s - x], for s from 0 to 2*p.size() - 2: the
+ * correlation of p with its mirror image about s/2.  Computed by FFT. */
+QVector<double> mirrorCorrelation(const QVector<double> &p);
+
+/* The 0 degree center (top) and 180 degree center of the film, about
+ * pi*cameraRadius*dpm apart, without a guess */
+CenterEstimate findCenters(const FilmSampler &film, double dpm, double cameraRadius);
+
+#endif
@@ -4,6 +4,8 @@ QMAKE_CXXFLAGS += -O3 \
     -DHAVE_STD \
     -DHAVE_NAMESPACES
 QT += network
+# Debug traces (see Log.h) compile out of release builds; uncomment to keep them
+# DEFINES += DIIS_TRACE
 ICON = resources/icon.icns
 
 HEADERS = ConfigFile/ConfigFile.h \
@@ -12,14 +14,41 @@ HEADERS = ConfigFile/ConfigFile.h \
     AppWindow.h \
     AppConfig.h \
     LogWidget.h \
-    TwoThetaWindow.h
+    Log.h \
+    TwoThetaWindow.h \
+    SearchMatch.h \
+    PeakFinder.h \
+    TwoThetaHistogram.h \
+    IntegrationKernel.h \
+    FilmSampler.h \
+    FilmImage.h \
+    DisplayLevels.h \
+    FilmPyramid.h \
+    Background.h \
+    SyntheticFilm.h \
+    GeometryOptimizer.h \
+    CenterFinder.h \
+    Instrumentation.h \
+    InstrumentationWidget.h
 SOURCES = main.cpp \
     ConfigFile/ConfigFile.cpp \
     TwoThetaPlot.cpp \
     AppWindow.cpp \
     FilmWidget.cpp \
     AppConfig.cpp \
-    TwoThetaWindow.cpp
+    TwoThetaWindow.cpp \
+    SearchMatch.cpp \
+    PeakFinder.cpp \
+    TwoThetaHistogram.cpp \
+    FilmImage.cpp \
+    DisplayLevels.cpp \
+    FilmPyramid.cpp \
+    Background.cpp \
+    SyntheticFilm.cpp \
+    GeometryOptimizer.cpp \
+    CenterFinder.cpp \
+    Instrumentation.cpp \
+    Log.cpp
 DESTDIR = ../bin
 
 # install
@@ -0,0 +1,94 @@
+/* ***************************************************************************
+ * DisplayLevels.cpp: implements the display levels and rendering
+ * ***************************************************************************/
+
+/* !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+ * Headers, definitions, etc.
+ * !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!*/
+
+#include "DisplayLevels.h"
+
+#include <cmath>
+
+/* ***************************************************************************
+ * function: mapRow
+ * description: takes row y of an image through the levels into dst.  Indexed
+ *   images are mapped through their colour table folded into the levels
+ *   (indexMap), 32 bit images through qGray, anything else through pixel().
+ * ***************************************************************************/
+static void mapRow(const QImage &image, int y, const QRgb *lut, const QRgb *indexMap, QRgb *dst)
+{
+    int n = image.width();
+
+    switch (image.format())
+    {
+    case QImage::Format_Indexed8:
+    {
+        const uchar *src = image.constScanLine(y);
+        for (int x = 0; x < n; x++)
+            dst[x] = indexMap[src[x]];
+        break;
+    }
+    case QImage::Format_RGB32:
+    case QImage::Format_ARGB32:
+    case QImage::Format_ARGB32_Premultiplied:
+    {
+        const QRgb *src = reinterpret_cast<const QRgb*>(image.constScanLine(y));
+        for (int x = 0; x < n; x++)
+            dst[x] = lut[qGray(src[x])];
+        break;
+    }
+    default:
+        for (int x = 0; x < n; x++)
+            dst[x] = lut[qGray(image.pixel(x, y))];
+        break;
+    }
+}
+
+/* Colour table of an indexed image taken through the levels */
+static QVector<QRgb> indexMapFor(const QImage &image, const QRgb *lut)
+{
+    QVector<QRgb> map;
+    if (image.format() != QImage::Format_Indexed8) return map;
+
+    QVector<QRgb> colors = image.colorTable();
+    map.fill(lut[0], 256);
+    for (int i = 0; i < colors.size() && i < 256; i++)
+        map[i] = lut[qGray(colors[i])];
+
+    return map;
+}
+
+/* ***************************************************************************
+ * method: set
+ * description: builds the lookup table.  Brightness saturates at white
+ *   rather than wrapping around as per pixel scaling of qRgb values did.
+ * ***************************************************************************/
+void DisplayLevels::set(double brightness, double gamma)
+{
+    this->brightness = brightness;
+    this->gamma = gamma;
+
+    for (int v = 0; v < 256; v++)
+    {
+        double b = qMin(brightness*v, 255.0);
+        int g = int(255.0*pow(b/255.0, gamma) + 0.5);
+        g = qBound(0, g, 255);
+        lut[v] = qRgb(g, g, g);
+    }
+}
+
+/* A single tile is small enough to render on the calling thread */
+QImage DisplayLevels::render(const QImage &image) const
+{
+    if (image.isNull())
+        return QImage();
+
+    QImage out(image.width(), image.height(), QImage::Format_RGB32);
+    QVector<QRgb> indexMap = indexMapFor(image, lut);
+
+    for (int y = 0; y < image.height(); y++)
+        mapRow(image, y, lut, indexMap.constData(), reinterpret_cast<QRgb*>(out.scanLine(y)));
+
+    return out;
+}
@@ -0,0 +1,48 @@
+/* ***************************************************************************
+ * DisplayLevels.h: defines the display pipeline that turns film pixels into
+ *   the image shown on screen, separate from the data used for analysis
+ * ***************************************************************************/
+#ifndef DisplayLevels_H
+#define DisplayLevels_H
+
+/* !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+ * Headers, definitions, etc.
+ * !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!*/
+
+/* Qt related headers */
+#include <QImage>
+#include <QVector>
+
+/* !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+ * Main class definition
+ * !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!*/
+
+/* ***************************************************************************
+ * class: DisplayLevels
+ * description: brightness and gamma of the displayed film as a 256 entry
+ *   lookup table from gray level to display colour.  A gray level v is shown
+ *   as 255*(min(b*v, 255)/255)^g.
+ * ***************************************************************************/
+class DisplayLevels
+{
+public:
+    DisplayLevels(double brightness = 1.0, double gamma = 1.0) { set(brightness, gamma); }
+
+    void set(double brightness, double gamma);
+    double getBrightness() const { return brightness; }
+    double getGamma() const { return gamma; }
+    bool isIdentity() const { return brightness == 1.0 && gamma == 1.0; }
+
+    QRgb map(int gray) const { return lut[gray]; }
+    const QRgb *table() const { return lut; }
+
+    /* Renders one image (a tile or mipmap tile) into a new RGB32 image */
+    QImage render(const QImage &image) const;
+
+private:
+    double brightness;
+    double gamma;
+    QRgb lut[256];
+};
+
+#endif
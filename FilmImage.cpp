@@ -0,0 +1,96 @@
+/* ***************************************************************************
+ * FilmImage.cpp: implements the tiled film store
+ * ***************************************************************************/
+
+/* !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+ * Headers, definitions, etc.
+ * !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!*/
+
+#include "FilmImage.h"
+
+#include <cstring>
+
+/* ***************************************************************************
+ * method: FilmImage
+ * description: cuts image into tiles, row by row.  Images of less than 8 bits
+ *   per pixel are stored as Indexed8 so that tiles can be copied by bytes.
+ * ***************************************************************************/
+FilmImage::FilmImage(const QImage &image) : w(image.width()), h(image.height()), columns(0)
+{
+    if (image.isNull())
+    {
+        w = 0;
+        h = 0;
+        return;
+    }
+
+    QImage source = image;
+    if (source.depth() < 8)
+        source = source.convertToFormat(QImage::Format_Indexed8);
+
+    columns = (w + FILM_TILE_SIZE - 1) >> FILM_TILE_SHIFT;
+    int rows = (h + FILM_TILE_SIZE - 1) >> FILM_TILE_SHIFT;
+
+    tiles.resize(columns*rows);
+    for (int t = 0; t < tiles.size(); t++)
+        tiles[t] = source.copy(tileRect(t));
+}
+
+QRect FilmImage::tileRect(int t) const
+{
+    int x = (t % columns) << FILM_TILE_SHIFT;
+    int y = (t / columns) << FILM_TILE_SHIFT;
+
+    return QRect(x, y, qMin(FILM_TILE_SIZE, w - x), qMin(FILM_TILE_SIZE, h - y));
+}
+
+/* Images share data exactly when their cache keys match */
+int FilmImage::tilesDifferentFrom(const FilmImage &other) const
+{
+    if (other.tiles.size() != tiles.size())
+        return tiles.size();
+
+    int n = 0;
+    for (int t = 0; t < tiles.size(); t++)
+    {
+        if (tiles.at(t).cacheKey() != other.tiles.at(t).cacheKey())
+            n++;
+    }
+
+    return n;
+}
+
+void FilmImage::invertPixels()
+{
+    for (int t = 0; t < tiles.size(); t++)
+        tiles[t].invertPixels();
+}
+
+/* ***************************************************************************
+ * method: toImage
+ * description: copies the tile scan lines into a single image of the tiles'
+ *   format (and colour table, for indexed films).
+ * ***************************************************************************/
+QImage FilmImage::toImage() const
+{
+    if (isNull())
+        return QImage();
+
+    const QImage &first = tiles.at(0);
+    QImage out(w, h, first.format());
+    if (first.format() == QImage::Format_Indexed8)
+        out.setColorTable(first.colorTable());
+
+    int bytesPerPixel = first.depth()/8;
+
+    for (int t = 0; t < tiles.size(); t++)
+    {
+        QRect r = tileRect(t);
+        const QImage &tile = tiles.at(t);
+
+        for (int y = 0; y < r.height(); y++)
+            memcpy(out.scanLine(r.y() + y) + r.x()*bytesPerPixel, tile.constScanLine(y), r.width()*bytesPerPixel);
+    }
+
+    return out;
+}
@@ -0,0 +1,79 @@
+/* ***************************************************************************
+ * FilmImage.h: defines a tiled, copy-on-write store for the film pixels
+ * ***************************************************************************/
+#ifndef FilmImage_H
+#define FilmImage_H
+
+/* !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+ * Headers, definitions, etc.
+ * !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!*/
+
+/* Qt related headers */
+#include <QImage>
+#include <QVector>
+#include <QRect>
+#include <QSize>
+
+/* Films are split into square tiles of 2^FILM_TILE_SHIFT pixels */
+#define FILM_TILE_SHIFT 8
+#define FILM_TILE_SIZE (1 << FILM_TILE_SHIFT)
+#define FILM_TILE_MASK (FILM_TILE_SIZE - 1)
+
+/* !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+ * Main class definition
+ * !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!*/
+
+/* ***************************************************************************
+ * class: FilmImage
+ * description: the film as a grid of QImage tiles.  QImage is implicitly
+ *   shared, so copying a FilmImage only copies the tile list and an edit
+ *   detaches (duplicates) just the tiles it writes to.  Snapshots kept for
+ *   undo therefore cost memory in proportion to what was changed.
+ *
+ *   Reads mirror the parts of QImage the analysis uses; pixel() expects
+ *   coordinates inside the film.
+ * ***************************************************************************/
+class FilmImage
+{
+public:
+    FilmImage() : w(0), h(0), columns(0) {}
+    explicit FilmImage(const QImage &image);
+
+    bool isNull() const { return w == 0 || h == 0; }
+    int width() const { return w; }
+    int height() const { return h; }
+    QSize size() const { return QSize(w, h); }
+    QRect rect() const { return QRect(0, 0, w, h); }
+
+    QRgb pixel(int x, int y) const
+    {
+        return tiles.at((y >> FILM_TILE_SHIFT)*columns + (x >> FILM_TILE_SHIFT)).pixel(x & FILM_TILE_MASK, y & FILM_TILE_MASK);
+    }
+
+    void setPixel(int x, int y, QRgb v)
+    {
+        tiles[(y >> FILM_TILE_SHIFT)*columns + (x >> FILM_TILE_SHIFT)].setPixel(x & FILM_TILE_MASK, y & FILM_TILE_MASK, v);
+    }
+
+    /* Tile access for edits that work a tile at a time.  tile() detaches. */
+    int tileCount() const { return tiles.size(); }
+    QRect tileRect(int t) const;
+    QImage &tile(int t) { return tiles[t]; }
+    const QImage &constTile(int t) const { return tiles.at(t); }
+
+    /* Tiles holding different pixel data from other (of the same size) */
+    int tilesDifferentFrom(const FilmImage &other) const;
+
+    void invertPixels();
+
+    /* Assembles the tiles into one image (for display and export) */
+    QImage toImage() const;
+
+private:
+    int w;
+    int h;
+    int columns;
+    QVector<QImage> tiles;
+};
+
+#endif
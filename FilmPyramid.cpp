@@ -0,0 +1,240 @@
+/* ***************************************************************************
+ * FilmPyramid.cpp: implements the tiled, level-of-detail film rendering
+ * ***************************************************************************/
+
+/* !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+ * Headers, definitions, etc.
+ * !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!*/
+
+#include "FilmPyramid.h"
+
+#include <QPixmapCache>
+#include <QtConcurrentMap>
+
+#include <cmath>
+
+int FilmPyramid::nextKey = 1;
+
+/* ***************************************************************************
+ * class: HalfRowReducer
+ * description: function object used with QtConcurrent::map.  Computes one
+ *   row of a reduced level as the average of the (up to) 2x2 pixels of the
+ *   level above it: the film for level 1, the previous gray level otherwise.
+ * ***************************************************************************/
+struct HalfRowReducer
+{
+    typedef void result_type;
+
+    const FilmImage *film;
+    const QImage *source;
+    uchar *bits;
+    int bytesPerLine;
+    int width;
+
+    int gray(int x, int y) const
+    {
+        if (film != NULL) return qGray(film->pixel(x, y));
+        return source->constScanLine(y)[x];
+    }
+
+    void operator()(const int &y) const
+    {
+        int sw = (film != NULL) ? film->width() : source->width();
+        int sh = (film != NULL) ? film->height() : source->height();
+        int y0 = 2*y;
+        int y1 = qMin(y0 + 1, sh - 1);
+        uchar *dst = bits + y*bytesPerLine;
+
+        for (int x = 0; x < width; x++)
+        {
+            int x0 = 2*x;
+            int x1 = qMin(x0 + 1, sw - 1);
+            dst[x] = uchar((gray(x0, y0) + gray(x1, y0) + gray(x0, y1) + gray(x1, y1) + 2)/4);
+        }
+    }
+};
+
+/* ***************************************************************************
+ * class: TileRenderer
+ * description: function object used with QtConcurrent::mapped.  Takes one
+ *   source tile through the display levels; the pixmaps are made from the
+ *   results on the GUI thread.
+ * ***************************************************************************/
+struct TileRenderer
+{
+    typedef QImage result_type;
+
+    const DisplayLevels *levels;
+
+    QImage operator()(const QImage &source) const { return levels->render(source); }
+};
+
+/* ***************************************************************************
+ * method: build
+ * description: halves the film until a level fits in a single tile.
+ * ***************************************************************************/
+void FilmPyramid::build(const FilmImage *film)
+{
+    this->film = film;
+    reduced.clear();
+    invalidate();
+
+    if (film == NULL || film->isNull())
+    {
+        this->film = NULL;
+        return;
+    }
+
+    if (QPixmapCache::cacheLimit() < PYRAMID_CACHE_KB)
+        QPixmapCache::setCacheLimit(PYRAMID_CACHE_KB);
+
+    QVector<QRgb> grays(256);
+    for (int i = 0; i < 256; i++)
+        grays[i] = qRgb(i, i, i);
+
+    QSize s = film->size();
+    while (s.width() > FILM_TILE_SIZE || s.height() > FILM_TILE_SIZE)
+    {
+        s = QSize((s.width() + 1)/2, (s.height() + 1)/2);
+
+        QImage level(s, QImage::Format_Indexed8);
+        level.setColorTable(grays);
+
+        HalfRowReducer reducer;
+        reducer.film = reduced.isEmpty() ? film : NULL;
+        reducer.source = reduced.isEmpty() ? NULL : &reduced.last();
+        reducer.bits = level.bits();
+        reducer.bytesPerLine = level.bytesPerLine();
+        reducer.width = s.width();
+
+        QVector<int> rows(s.height());
+        for (int y = 0; y < rows.size(); y++)
+            rows[y] = y;
+
+        QtConcurrent::blockingMap(rows, reducer);
+        reduced.append(level);
+    }
+}
+
+QSize FilmPyramid::levelSize(int level) const
+{
+    if (film == NULL) return QSize();
+    if (level == 0) return film->size();
+
+    return reduced.at(level - 1).size();
+}
+
+/* Coarsest level with at least one pixel per device pixel at scale */
+int FilmPyramid::levelFor(double scale) const
+{
+    int level = 0;
+    while (level + 1 < levelCount() && scale <= pow(0.5, level + 1))
+        level++;
+
+    return level;
+}
+
+QImage FilmPyramid::sourceTile(int level, int tx, int ty) const
+{
+    if (level == 0)
+    {
+        int columns = (film->width() + FILM_TILE_SIZE - 1) >> FILM_TILE_SHIFT;
+        return film->constTile(ty*columns + tx);
+    }
+
+    const QImage &image = reduced.at(level - 1);
+    QRect r(tx << FILM_TILE_SHIFT, ty << FILM_TILE_SHIFT, FILM_TILE_SIZE, FILM_TILE_SIZE);
+
+    return image.copy(r & image.rect());
+}
+
+/* ***************************************************************************
+ * method: tile
+ * description: the rendered tile from the pixmap cache, rendering it on a
+ *   miss.  Keys carry the pyramid key, so tiles of a previous film or of
+ *   previous display levels are never found again and age out of the cache.
+ * ***************************************************************************/
+QString FilmPyramid::tileName(int level, int tx, int ty) const
+{
+    return QString("FilmPyramid_%1_%2_%3_%4").arg(key).arg(level).arg(tx).arg(ty);
+}
+
+QPixmap FilmPyramid::tile(int level, int tx, int ty, const DisplayLevels &levels)
+{
+    QString name = tileName(level, tx, ty);
+
+    QPixmap pixmap;
+    if (!QPixmapCache::find(name, &pixmap))
+    {
+        pixmap = QPixmap::fromImage(levels.render(sourceTile(level, tx, ty)));
+        QPixmapCache::insert(name, pixmap);
+    }
+
+    return pixmap;
+}
+
+/* ***************************************************************************
+ * method: renderMissing
+ * description: renders the tiles [tx0, tx1] x [ty0, ty1] of level that are
+ *   not in the cache in parallel, as after a change of the display levels
+ *   every visible tile is missing at once.
+ * ***************************************************************************/
+void FilmPyramid::renderMissing(int level, int tx0, int ty0, int tx1, int ty1, const DisplayLevels &levels)
+{
+    QVector<QString> names;
+    QVector<QImage> sources;
+    QPixmap cached;
+
+    for (int ty = ty0; ty <= ty1; ty++)
+    {
+        for (int tx = tx0; tx <= tx1; tx++)
+        {
+            QString name = tileName(level, tx, ty);
+            if (QPixmapCache::find(name, &cached)) continue;
+
+            names.append(name);
+            sources.append(sourceTile(level, tx, ty));
+        }
+    }
+
+    if (sources.isEmpty()) return;
+
+    TileRenderer renderer;
+    renderer.levels = &levels;
+    QVector<QImage> rendered = QtConcurrent::blockingMapped<QVector<QImage> >(sources, renderer);
+
+    for (int i = 0; i < rendered.size(); i++)
+        QPixmapCache::insert(names.at(i), QPixmap::fromImage(rendered.at(i)));
+}
+
+void FilmPyramid::draw(QPainter &painter, const QRectF &exposed, double scale, const DisplayLevels &levels)
+{
+    if (film == NULL) return;
+
+    int level = levelFor(scale);
+    int step = FILM_TILE_SIZE << level;
+
+    QRectF r = exposed & QRectF(film->rect());
+    if (r.isEmpty()) return;
+
+    QSize s = levelSize(level);
+    int columns = (s.width() + FILM_TILE_SIZE - 1) >> FILM_TILE_SHIFT;
+    int rows = (s.height() + FILM_TILE_SIZE - 1) >> FILM_TILE_SHIFT;
+
+    int tx0 = int(r.left())/step;
+    int ty0 = int(r.top())/step;
+    int tx1 = qMin(int(ceil(r.right()))/step, columns - 1);
+    int ty1 = qMin(int(ceil(r.bottom()))/step, rows - 1);
+
+    renderMissing(level, tx0, ty0, tx1, ty1, levels);
+
+    for (int ty = ty0; ty <= ty1; ty++)
+    {
+        for (int tx = tx0; tx <= tx1; tx++)
+        {
+            QPixmap pixmap = tile(level, tx, ty, levels);
+            QRectF target(tx*step, ty*step, pixmap.width() << level, pixmap.height() << level);
+            painter.drawPixmap(target, pixmap, QRectF(pixmap.rect()));
+        }
+    }
+}
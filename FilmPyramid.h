@@ -0,0 +1,76 @@
+/* ***************************************************************************
+ * FilmPyramid.h: defines the tiled, level-of-detail rendering of the film
+ *   for display
+ * ***************************************************************************/
+#ifndef FilmPyramid_H
+#define FilmPyramid_H
+
+/* !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+ * Headers, definitions, etc.
+ * !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!*/
+
+/* Qt related headers */
+#include <QImage>
+#include <QPixmap>
+#include <QPainter>
+#include <QRectF>
+#include <QString>
+#include <QVector>
+
+#include "FilmImage.h"
+#include "DisplayLevels.h"
+
+/* Display tiles are kept in QPixmapCache, which is raised to at least this
+ * size [kB] (the Qt default holds only a few dozen tiles) */
+#define PYRAMID_CACHE_KB 65536
+
+/* !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+ * Main class definition
+ * !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!*/
+
+/* ***************************************************************************
+ * class: FilmPyramid
+ * description: mipmap of the film for drawing it at any zoom.  Level 0 is
+ *   the film itself; each further level halves the previous one (averaging
+ *   2x2 gray values) and is kept as an 8 bit gray image, a third of the
+ *   film's pixel count for all of them together.  Every level is cut into
+ *   tiles of FILM_TILE_SIZE pixels, which are rendered through the display
+ *   levels and converted to pixmaps only when they are first drawn.
+ *
+ *   draw() picks the coarsest level that still has at least one pixel per
+ *   screen pixel and draws only the tiles that cover the exposed area,
+ *   rendering those not yet cached in parallel first.
+ * ***************************************************************************/
+class FilmPyramid
+{
+public:
+    FilmPyramid() : film(NULL), key(0) {}
+
+    /* Rebuilds the reduced levels after the film pixels changed, NULL to
+     * release them */
+    void build(const FilmImage *film);
+    /* Drops the rendered tiles, e.g. after the display levels changed */
+    void invalidate() { key = nextKey++; }
+
+    int levelCount() const { return 1 + reduced.size(); }
+    QSize levelSize(int level) const;
+    int levelFor(double scale) const;
+
+    /* Draws the tiles covering exposed (in film pixels) with the painter's
+     * current transform, which takes film pixels to the device at scale */
+    void draw(QPainter &painter, const QRectF &exposed, double scale, const DisplayLevels &levels);
+
+private:
+    QImage sourceTile(int level, int tx, int ty) const;
+    QString tileName(int level, int tx, int ty) const;
+    QPixmap tile(int level, int tx, int ty, const DisplayLevels &levels);
+    void renderMissing(int level, int tx0, int ty0, int tx1, int ty1, const DisplayLevels &levels);
+
+    const FilmImage *film;
+    QVector<QImage> reduced;
+    int key;
+
+    static int nextKey;
+};
+
+#endif
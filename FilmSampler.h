@@ -0,0 +1,158 @@
+/* ***************************************************************************
+ * FilmSampler.h: defines read access to a film through the rotation, deskew
+ *   and crop recorded in the geometry, without copying or resampling it
+ * ***************************************************************************/
+#ifndef FilmSampler_H
+#define FilmSampler_H
+
+/* !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+ * Headers, definitions, etc.
+ * !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!*/
+
+/* Qt related headers */
+#include <QImage>
+#include <QMatrix>
+#include <QRect>
+#include <QSize>
+
+#include "FilmImage.h"
+
+/* !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+ * Main class definition
+ * !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!*/
+
+/* ***************************************************************************
+ * class: FilmSampler
+ * description: the film is kept exactly as loaded.  Rotating or deskewing
+ *   only changes the matrix taking film pixels to view coordinates (the
+ *   frame the film is displayed in, and in which centers, areas and regions
+ *   are given), and cropping only sets a region of interest of that frame:
+ *   view pixel (x, y) is (x + roi.x, y + roi.y) of the transformed film.
+ *   View pixels are read back through the inverse matrix with bilinear
+ *   interpolation, or directly when the matrix is the identity.
+ * ***************************************************************************/
+class FilmSampler
+{
+public:
+    FilmSampler(const FilmImage *film, const QMatrix &transform = QMatrix(), const QRect &roi = QRect())
+        : film(film), identity(transform.isIdentity()), inverse(transform.inverted()),
+          ox(roi.isNull() ? 0 : roi.x()), oy(roi.isNull() ? 0 : roi.y())
+    {
+        QSize s = roi.isNull() ? viewSize(transform, film->size()) : roi.size();
+        w = s.width();
+        h = s.height();
+    }
+
+    /* Rotation by angle [deg] of a view of the given size, shifted back into
+     * positive coordinates the same way QImage::transformed does */
+    static QMatrix rotation(double angle, const QSize &view)
+    {
+        return QImage::trueMatrix(QMatrix().rotate(angle), view.width(), view.height());
+    }
+
+    /* The view extends to cover everything the film maps to */
+    static QSize viewSize(const QMatrix &transform, const QSize &film)
+    {
+        if (transform.isIdentity()) return film;
+
+        QRect r = transform.mapRect(QRect(QPoint(0,0), film));
+        return QSize(qMax(r.x() + r.width(), 0), qMax(r.y() + r.height(), 0));
+    }
+
+    const FilmImage *image() const { return film; }
+    /* True when view pixels are film pixels, offset by (offsetX, offsetY) */
+    bool isIdentity() const { return identity; }
+    int offsetX() const { return ox; }
+    int offsetY() const { return oy; }
+    int width() const { return w; }
+    int height() const { return h; }
+
+    /* Gray value of view pixel (x, y), -1 if it is not on the film */
+    int gray(int x, int y) const
+    {
+        if (x < 0 || y < 0 || x >= w || y >= h) return -1;
+        if (identity) return qGray(film->pixel(x + ox, y + oy));
+
+        return grayAt(x, y);
+    }
+
+    /* Gray value at a fractional view position, -1 if it is not on the film
+     * or outside the view */
+    int grayAt(qreal x, qreal y) const
+    {
+        if (x < 0.0 || y < 0.0 || x > w - 1 || y > h - 1) return -1;
+
+        qreal fx = x + ox;
+        qreal fy = y + oy;
+        if (!identity) inverse.map(x + ox, y + oy, &fx, &fy);
+
+        if (fx < 0.0 || fy < 0.0 || fx > film->width() - 1 || fy > film->height() - 1)
+            return -1;
+
+        int x0 = int(fx);
+        int y0 = int(fy);
+        int x1 = qMin(x0 + 1, film->width() - 1);
+        int y1 = qMin(y0 + 1, film->height() - 1);
+        qreal tx = fx - x0;
+        qreal ty = fy - y0;
+
+        qreal top = (1.0 - tx)*qGray(film->pixel(x0, y0)) + tx*qGray(film->pixel(x1, y0));
+        qreal bottom = (1.0 - tx)*qGray(film->pixel(x0, y1)) + tx*qGray(film->pixel(x1, y1));
+
+        return int((1.0 - ty)*top + ty*bottom + 0.5);
+    }
+
+private:
+    const FilmImage *film;
+    bool identity;
+    QMatrix inverse;
+    int ox;
+    int oy;
+    int w;
+    int h;
+};
+
+/* !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+ * Functions
+ * !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!*/
+
+/* Mean gray value of view rectangle r, pixels off the film counting as 0 */
+inline double regionMean(const FilmSampler &s, const QRect &r)
+{
+    double sum = 0;
+
+    for (int x = r.x(); x < r.x() + r.width(); x++)
+        for (int y = r.y(); y < r.y() + r.height(); y++)
+            sum += qMax(s.gray(x, y), 0);
+
+    return sum/(r.width()*r.height());
+}
+
+/* ***************************************************************************
+ * function: symmetryResidual
+ * description: intensity weighted squared difference between region a and
+ *   region b reflected through the center of their union (a above b).  a is
+ *   scaled to the mean intensity of b first.
+ * ***************************************************************************/
+inline double symmetryResidual(const FilmSampler &s, const QRect &a, const QRect &b)
+{
+    double res = 0;
+    int xmin = a.x();
+    int xmax = a.x() + a.width();
+    int ymin = a.y();
+    int ymax = b.y() + b.height();
+
+    double scale = regionMean(s, b)/regionMean(s, a);
+
+    for (int x = xmin; x < xmax; x++) {
+        for (int y = ymin; y < ymin + a.height(); y++) {
+            int ga = qMax(s.gray(x, y), 0);
+            int gb = qMax(s.gray(xmax-(x-xmin), ymax - (y-ymin)), 0);
+            res += 0.5*(gb + ga)*(scale*ga - gb)*(scale*ga - gb);
+        }
+    }
+
+    return res;
+}
+
+#endif
@@ -80,13 +80,15 @@ void FilmWidget::updateIntArea()
  */
 void FilmWidget::setFilm(QString fileName)
 {
+    ScopedTimer timer("load");
+
     /* Load the film in to a temporary QImage. */
     QImage *tempData = new QImage( fileName );
 
     /* Give an error if the film couldn't be loaded. */
     if (tempData->isNull()) {
         QMessageBox::information(this, tr("Gandolfi"), tr("Could not load film: %1.").arg(fileName));
-        log->addMessage(tr("[FilmWidget] Could not load film: %1.").arg(fileName));
+        log->addMessage(LogWarning, tr("[FilmWidget] Could not load film: %1.").arg(fileName));
         return;
     }
 
@@ -106,8 +108,11 @@ void FilmWidget::setFilm(QString fileName)
     //filmDPM = 450;
 
     /* Set film data to the roughly rotated and cropped film. */
-    filmData = new QImage( tempData->copy() );
+    filmData = new FilmImage( *tempData );
     delete tempData;
+    currentGeometry.transform = QMatrix();
+    currentGeometry.roi = QRect();
+    clearHistory();
 
     /* If for some reason filmData == NULL, give an error. */
     if (filmData->isNull()) {
@@ -119,23 +124,92 @@ void FilmWidget::setFilm(QString fileName)
     filmData->invertPixels();
 
     /* Finally, set the QImage as the image to use for this widget. */
-    this->setPixmap(QPixmap::fromImage(*filmData));
+    updatePixmap();
 
     log->addMessage("[Main] Film has been loaded.");
     twoThetaWindow->setSuggestedName(fileName);
     suggestedName = fileName.split(".").at(0);
     //suggestedName.chop(4);
+
+    /* Place the centers (and guesses) where the film is symmetric */
+    if (appConfig->getAutoFindCenters())
+        findCenters(true);
+}
+
+/* The film is drawn by paintEvent rather than as the label's pixmap, so the
+ * size is that of the view at the current zoom */
+QSize FilmWidget::sizeHint() const
+{
+    if (filmData == NULL) return QLabel::sizeHint();
+
+    FilmSampler s(filmData, currentGeometry.transform, currentGeometry.roi);
+    return scaleFactor*QSize(s.width(), s.height());
+}
+
+static QPoint scaledPoint(const QPoint &p, double r)
+{
+    return QPoint(qRound(p.x()*r), qRound(p.y()*r));
 }
 
-void FilmWidget::setImage(QImage newImage)
+static QRect scaledRect(const QRect &q, double r)
 {
-    this->setPixmap(QPixmap::fromImage(newImage));
+    if (q.isNull()) return q;
+    return QRect(scaledPoint(q.topLeft(), r), QSize(qRound(q.width()*r), qRound(q.height()*r)));
+}
+
+/* ***************************************************************************
+ * method: changeDPM
+ * description: resamples the film to dpm.  Everything given in view pixels
+ *   (the transform's shift, the crop, centers, guesses and regions) scales
+ *   with it, so the same part of the film is viewed and analysed; the
+ *   camera radius is in meters and stays.  Undo restores the film at its
+ *   old resolution.
+ * ***************************************************************************/
+void FilmWidget::changeDPM(double dpm)
+{
+    if (filmData == NULL || dpm <= 0.0 || dpm == filmDPM) return;
+
+    double r = dpm/filmDPM;
+    QImage scaled = filmData->toImage().scaled(qRound(filmData->width()*r), qRound(filmData->height()*r),
+                                               Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+
+    pushUndo("Change DPI");
+    delete filmData;
+    filmData = new FilmImage(scaled);
+    filmDPM = dpm;
+
+    Geometry &g = currentGeometry;
+    g.transform = QMatrix().scale(1.0/r, 1.0/r) * g.transform * QMatrix().scale(r, r);
+    g.roi = scaledRect(g.roi, r);
+    g.zeroDegreeCenter = scaledPoint(g.zeroDegreeCenter, r);
+    g.oneEightyDegreeCenter = scaledPoint(g.oneEightyDegreeCenter, r);
+    g.zeroDegreeGuess = scaledPoint(g.zeroDegreeGuess, r);
+    g.oneEightyDegreeGuess = scaledPoint(g.oneEightyDegreeGuess, r);
+    previousGeometry = currentGeometry;
+
+    guessCenter0 = scaledPoint(guessCenter0, r);
+    guessCenter180 = scaledPoint(guessCenter180, r);
+    optRegion0A = scaledRect(optRegion0A, r);
+    optRegion0B = scaledRect(optRegion0B, r);
+    optRegion180A = scaledRect(optRegion180A, r);
+    optRegion180B = scaledRect(optRegion180B, r);
+    optRegionSh = scaledRect(optRegionSh, r);
+    for (int i = 0; i < excludeRegions.size(); i++)
+        excludeRegions[i] = scaledRect(excludeRegions[i], r);
+    updateIntArea();
+
+    updatePixmap();
+    this->resize(scaleFactor*getViewSize());
+    this->update();
+    emit geometryUpdated();
 }
 
 void FilmWidget::invert()
 {
+    ScopedTimer timer("invert");
+    pushUndo("Invert");
     filmData->invertPixels();
-    this->setPixmap(QPixmap::fromImage(*filmData));
+    updatePixmap();
 }
 
 void FilmWidget::startCrop()
@@ -145,6 +219,23 @@ void FilmWidget::startCrop()
     cropPhase = 1;
 }
 
+/* ***************************************************************************
+ * method: resetCrop
+ * description: shows the whole film again.  Crops never discard pixels, so
+ *   any number of them can be undone this way.
+ * ***************************************************************************/
+void FilmWidget::resetCrop()
+{
+    if (filmData == NULL) return;
+
+    log->addMessage("[FilmWidget] Crop reset.");
+    pushUndo("Reset crop");
+    currentGeometry.roi = QRect();
+
+    this->resize(scaleFactor*getViewSize());
+    this->update();
+}
+
 void FilmWidget::startDeskew()
 {
     sb->showMessage("Click the upper deskew point.");
@@ -165,27 +256,13 @@ void FilmWidget::rotate()
 
 QPoint FilmWidget::rotatePoint(QPoint in, double a)
 {
-    QPoint out(0,0);
-
-    double cosa = cos(a*M_PI/180.0);
-    double sina = sin(a*M_PI/180.0);
-
-    if (a >= 0)
-    {
-        out.setX( cosa*in.x() - sina*in.y() + sina*filmData->height() );
-        out.setY( cosa*in.y() + sina*in.x() );
-    } else
-    {
-        out.setX( cosa*in.x() - sina*in.y() );
-        out.setY( cosa*in.y() + sina*in.x() - sina*filmData->width() );
-    }
-
-    return out;
+    return FilmSampler::rotation(a, getViewSize()).map(in);
 }
 
 void FilmWidget::rotate(double a)
 {
     log->addMessage(tr("[FilmWidget] Rotating by %1 degrees.").arg(QString::number(a)));
+    pushUndo("Rotate");
     previousGeometry = currentGeometry;
     currentGeometry.zeroDegreeCenter = rotatePoint(currentGeometry.zeroDegreeCenter, a);
     currentGeometry.oneEightyDegreeCenter = rotatePoint(currentGeometry.oneEightyDegreeCenter, a);
@@ -193,874 +270,520 @@ void FilmWidget::rotate(double a)
 
     updateGeometry();
 
-    QMatrix rotTrans;
-    rotTrans.rotate(a);
-    QImage * oldFilmData = filmData;
-    filmData = new QImage( filmData->transformed(rotTrans, Qt::SmoothTransformation) );
-    delete oldFilmData;
-
-    this->setPixmap(QPixmap::fromImage(*filmData));
-    this->repaint();
+    applyRotation(a);
 }
 
-void FilmWidget::darken()
+/* ***************************************************************************
+ * method: applyRotation
+ * description: rotates the view of the film by a [deg].  Only the transform
+ *   in the geometry changes; the film itself is never resampled.  A crop is
+ *   folded into the transform and the view becomes the rotated crop.
+ * ***************************************************************************/
+void FilmWidget::applyRotation(double a)
 {
-    for (int x = 0; x < filmData->width(); x++)
+    QSize view = getViewSize();
+    QMatrix rot = FilmSampler::rotation(a, view);
+    Geometry &g = currentGeometry;
+
+    if (g.roi.isNull())
     {
-        for (int y = 0; y < filmData->height(); y++)
-        {
-            QRgb pv = filmData->pixel(x,y);
-            filmData->setPixel(x,y,qRgb(qRed(pv)/2, qGreen(pv)/2, qBlue(pv)/2));
-        }
+        g.transform = g.transform * rot;
+    } else
+    {
+        g.transform = g.transform * QMatrix().translate(-g.roi.x(), -g.roi.y()) * rot;
+        g.roi = QRect(QPoint(0,0), rot.mapRect(QRect(QPoint(0,0), view)).size());
     }
 
-    this->setPixmap(QPixmap::fromImage(*filmData));
+    this->resize(scaleFactor*getViewSize());
+    this->update();
 }
 
-void FilmWidget::lighten()
+/* ***************************************************************************
+ * method: setDisplayLevels
+ * description: brightness and gamma only change how the film is shown; the
+ *   data used for analysis is left as it is.
+ * ***************************************************************************/
+void FilmWidget::setDisplayLevels(double brightness, double gamma)
 {
-    for (int x = 0; x < filmData->width(); x++)
-    {
-        for (int y = 0; y < filmData->height(); y++)
-        {
-            QRgb pv = filmData->pixel(x,y);
-            filmData->setPixel(x,y,qRgb(qRed(pv)*2, qGreen(pv)*2, qBlue(pv)*2));
+    displayLevels.set(brightness, gamma);
 
-            if (qGray(filmData->pixel(x,y)) > 256)
-                filmData->setPixel(x,y, qRgb(255,255,255));
-        }
+    if (filmData != NULL)
+    {
+        pyramid.invalidate();
+        this->update();
     }
+}
 
-    this->setPixmap(QPixmap::fromImage(*filmData));
+void FilmWidget::darken()
+{
+    setDisplayLevels(displayLevels.getBrightness()/2.0, displayLevels.getGamma());
+}
+
+void FilmWidget::lighten()
+{
+    setDisplayLevels(displayLevels.getBrightness()*2.0, displayLevels.getGamma());
 }
 
 void FilmWidget::closeFilm()
 {
-    this->setPixmap(NULL);
+    pyramid.build(NULL);
+    clearHistory();
     delete filmData;
+    filmData = NULL;
+    this->update();
 }
 
-void FilmWidget::updateGeometry()
+/* ***************************************************************************
+ * method: captureState
+ * description: snapshot of the film and view geometry.  Copying the film
+ *   only shares its tiles; they are duplicated when an edit writes to them.
+ * ***************************************************************************/
+FilmState FilmWidget::captureState(const QString &name)
 {
-    // Update integration area and redraw
-    updateIntArea();
-
-    int x0shift = currentGeometry.zeroDegreeCenter.x() - previousGeometry.zeroDegreeCenter.x();
-    int y0shift = currentGeometry.zeroDegreeCenter.y() - previousGeometry.zeroDegreeCenter.y();
-    cout << "x0shift = " << x0shift << ", y0shift = " << y0shift << endl;
-
-    optRegion0A.moveCenter(QPoint(optRegion0A.center().x() + x0shift, optRegion0A.center().y() + y0shift));
-    optRegion0B.moveCenter(QPoint(optRegion0B.center().x() + x0shift, optRegion0B.center().y() + y0shift));
-
-    optRegionSh.moveCenter(QPoint(optRegionSh.center().x() + x0shift, optRegionSh.center().y() + y0shift));
-
-    int x180shift = currentGeometry.oneEightyDegreeCenter.x() - previousGeometry.oneEightyDegreeCenter.x();
-    int y180shift = currentGeometry.oneEightyDegreeCenter.y() - previousGeometry.oneEightyDegreeCenter.y();
-    cout << "x180shift = " << x180shift << ", y180shift = " << y180shift << endl;
-
-    optRegion180A.moveCenter(QPoint(optRegion180A.center().x() + x180shift, optRegion180A.center().y() + y180shift));
-    optRegion180B.moveCenter(QPoint(optRegion180B.center().x() + x180shift, optRegion180B.center().y() + y180shift));
-
-    this->repaint();
+    FilmState s;
+    s.name = name;
+    s.film = *filmData;
+    s.dpm = filmDPM;
+    s.transform = currentGeometry.transform;
+    s.roi = currentGeometry.roi;
+    s.zeroDegreeCenter = currentGeometry.zeroDegreeCenter;
+    s.oneEightyDegreeCenter = currentGeometry.oneEightyDegreeCenter;
+    s.radius = currentGeometry.radius;
+    s.phi = currentGeometry.phi;
+    s.alpha = currentGeometry.alpha;
+    s.converged = currentGeometry.converged;
+    s.guessCenter0 = guessCenter0;
+    s.guessCenter180 = guessCenter180;
+    s.regions << optRegion0A << optRegion0B << optRegion180A << optRegion180B << optRegionSh;
+    s.excludeRegions = excludeRegions;
+
+    return s;
 }
 
-QPoint FilmWidget::optimizeCenterXSharpness(int location)
+void FilmWidget::restoreState(const FilmState &s)
 {
-    previousGeometry = currentGeometry;
-    QRect reg;
-    if (location == ZERO_DEGREES)
-        reg = this->optRegionSh;
-    else
-        reg = this->optRegionSh;
-
-    int iter = 0;
-    int delta = 1;
-    int y = 0;
-
-    double gamma = (sqrt(5.0) - 1.0)/2.0;
-
-    int x1 = -appConfig->getXRangeSharpness();
-    int x2 =  appConfig->getXRangeSharpness();
-    int x3 = int(floor(x2 - gamma*(x2-x1)));
-    int x4 = int(floor(x1 + gamma*(x2-x1)));
-
-
-    //double r1 = -integrateRegion(0.025,x1,y,reg);
-    //double r2 = -integrateRegion(0.025,x2,y,reg);
-    double r3 = -integrateRegion(0.025,x3,y,reg);
-    double r4 = -integrateRegion(0.025,x4,y,reg);
-
-    do
-    {
-        cout << "Iter[" << iter << "] x1 = " << x1 << ", x2 = " << x2 << ", x3 = " << x3 << ", x4 = " << x4 << endl;
-        if (r3 <= r4)
-        {
-            x2 = x4;
-            x4 = x3;
-            r4 = r3;
-
-            x3 = int(floor(x2 - gamma*(x2-x1) + 0.5));
-            r3 = -integrateRegion(0.025,x3,y,reg);
-        } else
-        {
-            x1 = x3;
-            x3 = x4;
-            r3 = r4;
-
-            x4 = int(floor(x1 + gamma*(x2-x1) + 0.5));
-            r4 = -integrateRegion(0.025,x4,y,reg);
-        }
-
-        iter++;
-        delta = abs(x2-x1);
-
-    } while (iter < 500 && delta > 1 );//&& abs(x1) < 20);
-
-    int optx = 0;
+    bool pixelsChanged = (filmData->tilesDifferentFrom(s.film) != 0);
+
+    *filmData = s.film;
+    filmDPM = s.dpm;
+    currentGeometry.transform = s.transform;
+    currentGeometry.roi = s.roi;
+    currentGeometry.zeroDegreeCenter = s.zeroDegreeCenter;
+    currentGeometry.oneEightyDegreeCenter = s.oneEightyDegreeCenter;
+    currentGeometry.radius = s.radius;
+    currentGeometry.phi = s.phi;
+    currentGeometry.alpha = s.alpha;
+    currentGeometry.converged = s.converged;
+    guessCenter0 = s.guessCenter0;
+    guessCenter180 = s.guessCenter180;
+    optRegion0A = s.regions.at(0);
+    optRegion0B = s.regions.at(1);
+    optRegion180A = s.regions.at(2);
+    optRegion180B = s.regions.at(3);
+    optRegionSh = s.regions.at(4);
+    excludeRegions = s.excludeRegions;
+
+    if (pixelsChanged) updatePixmap();
+    updateIntArea();
 
-    if ( (-integrateRegion(0.025,x1,y,reg)) <= (-integrateRegion(0.025,x2,y,reg)) )
-    {
-        cout << "Optimized x point is x = " << x1 << endl;
-        optx = x1;
-    } else
-    {
-        cout << "Optimized x point is x = " << x2 << endl;
-        optx = x2;
-    }
+    this->resize(scaleFactor*getViewSize());
+    this->update();
+    emit geometryUpdated();
+}
 
-    if (location == ZERO_DEGREES)
-        currentGeometry.zeroDegreeCenter.setX(currentGeometry.zeroDegreeCenter.x() - optx);
-    else
-        currentGeometry.oneEightyDegreeCenter.setX(currentGeometry.oneEightyDegreeCenter.x() - optx);
+/* Records the state before an edit; any redo history is dropped */
+void FilmWidget::pushUndo(const QString &name)
+{
+    if (filmData == NULL) return;
 
-    this->updateGeometry();
+    undoStack.append(captureState(name));
+    if (undoStack.size() > FILM_UNDO_DEPTH)
+        undoStack.removeFirst();
 
-    if (location == ZERO_DEGREES)
-        return currentGeometry.zeroDegreeCenter;
-    else
-        return currentGeometry.oneEightyDegreeCenter;
+    redoStack.clear();
+    emit historyChanged();
 }
 
-double FilmWidget::optimizeAlphaSharpness()
+void FilmWidget::clearHistory()
 {
-    previousGeometry = currentGeometry;
-    QRect reg = optRegionSh;
-
-    int iter = 0;
-    double deltaa = 1e20;
-    double deltash = 1e20;
-    int y = 0;
-    int x = 0;
-
-    double gamma = (sqrt(5.0) - 1.0)/2.0;
-
-    double a1 = -appConfig->getAlphaRange();
-    double a2 =  appConfig->getAlphaRange();
-    double a3 = a2 - gamma*(a2-a1);
-    double a4 = a1 + gamma*(a2-a1);
-/*
-    for (double a = -0.5; a <= 0.5; a = a + 0.02)
-    {
-        currentGeometry.alpha = a;
-        double r = -integrateRegion(0.05, x, y, reg);
-        cout << a << ", " << r << endl;
-    }*/
-/*
-    for (double p = -0.5; p <= 0.5; p = p + 0.02)
-    {
-        currentGeometry.phi = p;
-        double r = -integrateRegion(0.05, x, y, reg);
-        cout << p << ", " << r << endl;
-    }*/
-
-    double r1; //-integrateRegion(0.025,x,y,reg);
-    double r2; // = -integrateRegion(0.025,x,y,reg);
-    currentGeometry.alpha = a3;
-    double r3 = -integrateRegion(0.025,x,y,reg);
-    currentGeometry.alpha = a4;
-    double r4 = -integrateRegion(0.025,x,y,reg);
-
-    do
-    {
-
-        if (r3 <= r4)
-        {
-            a2 = a4;
-            r2 = r4;
-            a4 = a3;
-            r4 = r3;
-
-            a3 = a2 - gamma*(a2-a1);
-            currentGeometry.alpha = a3;
-            r3 = -integrateRegion(0.025,x,y,reg);
-        } else
-        {
-            a1 = a3;
-            r1 = r3;
-            a3 = a4;
-            r3 = r4;
-
-            a4 = a1 + gamma*(a2-a1);
-            currentGeometry.alpha = a4;
-            r4 = -integrateRegion(0.025,x,y,reg);
-        }
-
-        iter++;
-        deltaa = abs(a2-a1);
-        deltash = abs(r2-r1);
-        //cout << "Iter[" << iter << "] p1 = " << p1 << ", p2 = " << p2 << ", p3 = " << p3 << ", p4 = " << p4 << endl;
-    } while (iter < 500 && deltaa > 0.0001 && deltash > 0.00001 );//&& abs(x1) < 20);
+    undoStack.clear();
+    redoStack.clear();
+    emit historyChanged();
+}
 
-    currentGeometry.alpha = (a1 + a2)/2.0;
+void FilmWidget::undo()
+{
+    if (filmData == NULL || undoStack.isEmpty()) return;
 
-    log->addMessage(tr("Alpha optimized to %1").arg(currentGeometry.alpha));
+    FilmState s = undoStack.takeLast();
+    log->addMessage(tr("[FilmWidget] Undo %1 (%2 of %3 tiles differ).").arg(s.name).arg(filmData->tilesDifferentFrom(s.film)).arg(filmData->tileCount()));
 
-    return currentGeometry.alpha;
+    redoStack.append(captureState(s.name));
+    restoreState(s);
+    emit historyChanged();
 }
 
-double FilmWidget::optimizePhiSharpness()
+void FilmWidget::redo()
 {
-    previousGeometry = currentGeometry;
-    QRect reg = optRegionSh;
+    if (filmData == NULL || redoStack.isEmpty()) return;
 
-    int iter = 0;
-    double deltap = 1e20;
-    double deltash = 1e20;
-    int y = 0;
-    int x = 0;
+    FilmState s = redoStack.takeLast();
+    log->addMessage(tr("[FilmWidget] Redo %1.").arg(s.name));
 
-    double gamma = (sqrt(5.0) - 1.0)/2.0;
+    undoStack.append(captureState(s.name));
+    restoreState(s);
+    emit historyChanged();
+}
 
-    double p1 = -appConfig->getPhiRange();
-    double p2 =  appConfig->getPhiRange();
-    double p3 = p2 - gamma*(p2-p1);
-    double p4 = p1 + gamma*(p2-p1);
+void FilmWidget::updateGeometry()
+{
+    // Update integration area and redraw
+    updateIntArea();
 
+    int x0shift = currentGeometry.zeroDegreeCenter.x() - previousGeometry.zeroDegreeCenter.x();
+    int y0shift = currentGeometry.zeroDegreeCenter.y() - previousGeometry.zeroDegreeCenter.y();
+    TRACE(TraceFilm, QString("x0shift = %1, y0shift = %2").arg(x0shift).arg(y0shift));
 
-    /*for (double p = -0.01; p <= 0.01; p = p + 0.001)
-    {
-        currentGeometry.phi = p;
-        double r = -integrateRegion(0.025, x, y, reg);
-        cout << p << ", " << r << endl;
-    }*/
-
-    double r1; //-integrateRegion(0.025,x,y,reg);
-    double r2; // = -integrateRegion(0.025,x,y,reg);
-    currentGeometry.phi = p3;
-    double r3 = -integrateRegion(0.025,x,y,reg);
-    currentGeometry.phi = p4;
-    double r4 = -integrateRegion(0.025,x,y,reg);
-
-    do
-    {
+    optRegion0A.moveCenter(QPoint(optRegion0A.center().x() + x0shift, optRegion0A.center().y() + y0shift));
+    optRegion0B.moveCenter(QPoint(optRegion0B.center().x() + x0shift, optRegion0B.center().y() + y0shift));
 
-        if (r3 <= r4)
-        {
-            p2 = p4;
-            r2 = r4;
-            p4 = p3;
-            r4 = r3;
-
-            p3 = p2 - gamma*(p2-p1);
-            currentGeometry.phi = p3;
-            r3 = -integrateRegion(0.025,x,y,reg);
-        } else
-        {
-            p1 = p3;
-            r1 = r3;
-            p3 = p4;
-            r3 = r4;
-
-            p4 = p1 + gamma*(p2-p1);
-            currentGeometry.phi = p4;
-            r4 = -integrateRegion(0.025,x,y,reg);
-        }
+    optRegionSh.moveCenter(QPoint(optRegionSh.center().x() + x0shift, optRegionSh.center().y() + y0shift));
 
-        iter++;
-        deltap = abs(p2-p1);
-        deltash = abs(r2-r1);
-        cout << "Iter[" << iter << "] p1 = " << p1 << ", p2 = " << p2 << ", p3 = " << p3 << ", p4 = " << p4 << endl;
-    } while (iter < 500 && deltap > 0.0001 && deltash > 0.00001 );//&& abs(x1) < 20);
+    int x180shift = currentGeometry.oneEightyDegreeCenter.x() - previousGeometry.oneEightyDegreeCenter.x();
+    int y180shift = currentGeometry.oneEightyDegreeCenter.y() - previousGeometry.oneEightyDegreeCenter.y();
+    TRACE(TraceFilm, QString("x180shift = %1, y180shift = %2").arg(x180shift).arg(y180shift));
 
-    currentGeometry.phi = (p1 + p2)/2.0;
+    optRegion180A.moveCenter(QPoint(optRegion180A.center().x() + x180shift, optRegion180A.center().y() + y180shift));
+    optRegion180B.moveCenter(QPoint(optRegion180B.center().x() + x180shift, optRegion180B.center().y() + y180shift));
 
-    log->addMessage(tr("Phi optimized to %1").arg(currentGeometry.phi));
+    this->update();
+}
 
-    return currentGeometry.phi;
+/* ***************************************************************************
+ * method: optimizer
+ * description: a GeometryOptimizer on the film with the current geometry,
+ *   optimization regions and ranges (those of the preferences by default).
+ *   applyOptimizer takes its results back; the geometry before them can be
+ *   restored with resetGeometry.
+ * ***************************************************************************/
+OptimizerRanges FilmWidget::optimizerRanges()
+{
+    OptimizerRanges r;
+    r.xSharpness = appConfig->getXRangeSharpness();
+    r.ySharpness = appConfig->getYRangeSharpness();
+    r.xSymmetry = appConfig->getXRangeSymmetry();
+    r.ySymmetry = appConfig->getYRangeSymmetry();
+    r.phi = appConfig->getPhiRange();
+    r.alpha = appConfig->getAlphaRange();
+    r.radius = appConfig->getRadiusRange();
+    r.cameraRadius = appConfig->getCameraRadius();
+
+    return r;
 }
 
+GeometryOptimizer FilmWidget::optimizer(const OptimizerRanges &r)
+{
+    GeometryOptimizer o(filmSampler(), filmDPM, r);
+    o.geometry.zeroDegreeCenter = currentGeometry.zeroDegreeCenter;
+    o.geometry.oneEightyDegreeCenter = currentGeometry.oneEightyDegreeCenter;
+    o.geometry.radius = currentGeometry.radius;
+    o.geometry.phi = currentGeometry.phi;
+    o.geometry.alpha = currentGeometry.alpha;
+    o.regions.sharpness = optRegionSh;
+    o.regions.zeroA = optRegion0A;
+    o.regions.zeroB = optRegion0B;
+    o.regions.oneEightyA = optRegion180A;
+    o.regions.oneEightyB = optRegion180B;
+    o.intArea = intArea;
+    o.exclude = &excludeRegions;
+
+    return o;
+}
 
-QPoint FilmWidget::optimizeCenterXSymmetry(int location)
+void FilmWidget::applyOptimizer(const GeometryOptimizer &o)
 {
     previousGeometry = currentGeometry;
-    if (location == ZERO_DEGREES)
-    {
-        optRegionA = &optRegion0A;
-        optRegionB = &optRegion0B;
-    }
-    else
-    {
-        optRegionA = &optRegion180A;
-        optRegionB = &optRegion180B;
-    }
-
-    int iter = 0;
-    int delta = 1;
-    int y = 0;
-
-    double gamma = (sqrt(5.0) - 1.0)/2.0;
-
-
-
-    int x1 = -appConfig->getXRangeSymmetry();
-    int x2 =  appConfig->getXRangeSymmetry();
-    int x3 = int(floor(x2 - gamma*(x2-x1) + 0.5));
-    int x4 = int(floor(x1 + gamma*(x2-x1) + 0.5));
-
-    //double r1 = residual(x1, y, filmData);
-    //double r2 = residual(x2, y, filmData);
-    double r3 = residual(x3, y, filmData);
-    double r4 = residual(x4, y, filmData);
-/*
-    for (int x = -50; x <= 50; x++)
-    {
-        for (int y = -50; y <= 50; y++)
-        {
-            double r = residual(x,y,filmData);
-            cout << x << ", " << y << ", " << r << endl;
-
-        }
-    }
-*/
-
-    do
-    {
-        if (r3 <= r4)
-        {
-            x2 = x4;
-            x4 = x3;
-            r4 = r3;
-
-            x3 = int(floor(x2 - gamma*(x2-x1) + 0.5));
-            r3 = residual(x3, y, filmData);
-        } else
-        {
-            x1 = x3;
-            x3 = x4;
-            r3 = r4;
-
-            x4 = int(floor(x1 + gamma*(x2-x1) + 0.5));
-            r4 = residual(x4, y, filmData);
-        }
-
-        iter++;
-        delta = abs(x2-x1);
-    } while (iter < 500 && delta > 1 );//&& abs(x1) < 20);
-
-    int optx = 0;
-
-    if (residual(x1, y, filmData) <= residual(x2, y, filmData))
-    {
-        cout << "Optimized x point is x = " << x1 << ", iters = " << iter <<  endl;
-        optx = x1;
-    } else
-    {
-        cout << "Optimized x point is x = " << x2 << ", iters = " << iter << endl;
-        optx = x2;
-    }
-
-    if (location == ZERO_DEGREES)
-        currentGeometry.zeroDegreeCenter.setX(currentGeometry.zeroDegreeCenter.x() + optx);
-    else
-        currentGeometry.oneEightyDegreeCenter.setX(currentGeometry.oneEightyDegreeCenter.x() + optx);
-
-    this->updateGeometry();
-
-    if (location == ZERO_DEGREES)
-        return currentGeometry.zeroDegreeCenter;
-    else
-        return currentGeometry.oneEightyDegreeCenter;
 
+    currentGeometry.zeroDegreeCenter = o.geometry.zeroDegreeCenter;
+    currentGeometry.oneEightyDegreeCenter = o.geometry.oneEightyDegreeCenter;
+    currentGeometry.radius = o.geometry.radius;
+    currentGeometry.phi = o.geometry.phi;
+    currentGeometry.alpha = o.geometry.alpha;
+    optRegionSh = o.regions.sharpness;
+    optRegion0A = o.regions.zeroA;
+    optRegion0B = o.regions.zeroB;
+    optRegion180A = o.regions.oneEightyA;
+    optRegion180B = o.regions.oneEightyB;
+    intArea = o.intArea;
+
+    this->update();
 }
 
-QPoint FilmWidget::optimizeCenterYSharpness(int location)
+/* ***************************************************************************
+ * method: optimizeStep
+ * description: runs one step of strategy (see OptimizerStrategy) on the
+ *   film and logs the result and the evaluations it took.
+ * ***************************************************************************/
+void FilmWidget::optimizeStep(int step, const OptimizerStrategy &strategy)
 {
-
-    previousGeometry = currentGeometry;
-    QRect regA;
-    QRect regB;
-
-    if (location == ZERO_DEGREES)
-    {
-        regA = optRegion0B;
-        regB = optRegion0A;
-    } else
+    GeometryOptimizer o = optimizer();
     {
-        regA = optRegion180B;
-        regB = optRegion180A;
+        ScopedTimer timer("optimize");
+        o.runStep(step, strategy);
     }
+    applyOptimizer(o);
 
-    regA = optRegionSh;
-
-    int iter = 0;
-    int delta = 1;
-    int x = 0;
-
-    double gamma = (sqrt(5.0) - 1.0)/2.0;
-
-    /*for (int y = -50; y <= 50; y++)
-    {
-        for (int x = -50; x <= 50; x++)
-        {
-            double r = integrateRegion(0.05, x, y, optRegionSh);
-            cout << x << ", " <<  y << ", " << r << endl;
-        }
-    }*/
-
-
-    int y1 = -appConfig->getYRangeSharpness();
-    int y2 =  appConfig->getYRangeSharpness();
-    int y3 = int(floor(y2 - gamma*(y2-y1) + 0.5));
-    int y4 = int(floor(y1 + gamma*(y2-y1) + 0.5));
-
-
-
-    //double r1 = integrateRegionDifference(0.025,x,y1,regA, regB);
-    //double r2 = integrateRegionDifference(0.025,x,y2,regA, regB);
-    double r3 = -integrateRegion(0.05, x, y3, regA); //integrateRegionDifference(0.025,x,y3,regA, regB);
-    double r4 = -integrateRegion(0.05, x, y4, regA); //integrateRegionDifference(0.025,x,y4,regA, regB);
-
-    do
-    {
-
-        if (r3 <= r4)
-        {
-            y2 = y4;
-            y4 = y3;
-            r4 = r3;
-
-            y3 = int(floor(y2 - gamma*(y2-y1) + 0.5));
-            r3 = -integrateRegion(0.05, x, y3, regA); //integrateRegionDifference(0.025,x,y3,regA,regB);
-        } else
-        {
-            y1 = y3;
-            y3 = y4;
-            r3 = r4;
-
-            y4 = int(floor(y1 + gamma*(y2-y1) + 0.5));
-            r4 = -integrateRegion(0.05, x, y4, regA); //integrateRegionDifference(0.025,x,y4,regA,regB);
-        }
-
-        iter++;
-        delta = abs(y2-y1);
-        cout << "Iter[" << iter << "] y1 = " << y1 << ", y2 = " << y2 << ", y3 = " << y3 << ", y4 = " << y4 << endl;
-    } while (iter < 500 && delta > 1 );//&& abs(x1) < 20);
-
-    int opty = 0;
-
-    //if (integrateRegionDifference(0.025,x,y1,regA,regB) <= integrateRegionDifference(0.025,x,y2,regA,regB))
-    if ( (-integrateRegion(0.05,x,y1,regA)) <= (-integrateRegion(0.05,x,y2,regA)) )
-    {
-        cout << "Optimized y point is y = " << y1 << endl;
-        opty = y1;
-    } else
+    switch (step)
     {
-        cout << "Optimized y point is y = " << y2 << endl;
-        opty = y2;
+    case OptimizeZeroCenter:
+        log->addMessage(tr("0 degree center optimized to (%1, %2)").arg(currentGeometry.zeroDegreeCenter.x()).arg(currentGeometry.zeroDegreeCenter.y()));
+        break;
+    case OptimizeOneEightyCenter:
+        log->addMessage(tr("180 degree center optimized to (%1, %2)").arg(currentGeometry.oneEightyDegreeCenter.x()).arg(currentGeometry.oneEightyDegreeCenter.y()));
+        break;
+    case OptimizeAlpha:
+        log->addMessage(tr("Alpha optimized to %1").arg(currentGeometry.alpha));
+        break;
+    case OptimizeRadius:
+        log->addMessage(tr("Radius optimized to %1").arg(currentGeometry.radius));
+        break;
+    case OptimizePhi:
+        log->addMessage(tr("Phi optimized to %1").arg(currentGeometry.phi));
+        break;
     }
 
-
-    if (location == ZERO_DEGREES)
-        currentGeometry.zeroDegreeCenter.setY(currentGeometry.zeroDegreeCenter.y() - opty);
-    else
-        currentGeometry.oneEightyDegreeCenter.setY(currentGeometry.oneEightyDegreeCenter.y() - opty);
-
-    this->updateGeometry();
-
-    if (location == ZERO_DEGREES)
-        return currentGeometry.zeroDegreeCenter;
-    else
-        return currentGeometry.oneEightyDegreeCenter;
+    log->addMessage(tr("[FilmWidget] %1 integrateRegion and %2 residual evaluations.").arg(o.counts.integrateRegion).arg(o.counts.residual));
 }
 
-QPoint FilmWidget::optimizeCenterYSymmetry(int location)
+/* ***************************************************************************
+ * method: applyCalibration
+ * description: takes radius, phi and alpha from the profile and places the
+ *   centers at its offsets from the 0 degree guess (scaled if the film was
+ *   scanned at another resolution), then only refines the centers within
+ *   CALIBRATION_CENTER_RANGE pixels.  resetGeometry returns to the geometry
+ *   before the profile was applied.
+ * ***************************************************************************/
+bool FilmWidget::applyCalibration(const CalibrationProfile &cp)
 {
-    previousGeometry = currentGeometry;
-    if (location == ZERO_DEGREES)
-    {
-        optRegionA = &optRegion0A;
-        optRegionB = &optRegion0B;
-    }
-    else
+    if (filmData == NULL || guessCenter0 == QPoint(0,0))
     {
-        optRegionA = &optRegion180A;
-        optRegionB = &optRegion180B;
+        log->addMessage(LogWarning, tr("[FilmWidget] Place the 0 degree guess before applying a calibration."));
+        return false;
     }
 
-    int iter = 0;
-    int delta = 1;
-    int x = 0;
-
-    double gamma = (sqrt(5.0) - 1.0)/2.0;
+    double scale = (cp.dpm > 0.0) ? filmDPM/cp.dpm : 1.0;
+    if (scale != 1.0)
+        log->addMessage(LogWarning, tr("[FilmWidget] Calibration %1 was made at %2 dpm, the film is %3 dpm.").arg(cp.name).arg(cp.dpm).arg(filmDPM));
 
-    int y1 = -appConfig->getYRangeSymmetry();
-    int y2 =  appConfig->getYRangeSymmetry();
-    int y3 = y2 - gamma*(y2-y1);
-    int y4 = y1 + gamma*(y2-y1);
-
-    //double r1 = residual(x, y1, filmData);
-    //double r2 = residual(x, y2, filmData);
-    double r3 = residual(x, y3, filmData);
-    double r4 = residual(x, y4, filmData);
-
-    do
-    {
-        if (r3 <= r4)
-        {
-            y2 = y4;
-            y4 = y3;
-            r4 = r3;
-
-            y3 = int(floor(y2 - gamma*(y2-y1) + 0.5));
-            r3 = residual(x, y3, filmData);
-        } else
-        {
-            y1 = y3;
-            y3 = y4;
-            r3 = r4;
-
-            y4 = int(floor(y1 + gamma*(y2-y1) + 0.5));
-            r4 = residual(x, y4, filmData);
-        }
-
-        iter++;
-        delta = abs(y2-y1);
-    } while (iter < 500 && delta > 1 );//&& abs(x1) < 20);
+    Geometry before = currentGeometry;
+    previousGeometry = currentGeometry;
+    currentGeometry.zeroDegreeCenter = guessCenter0 + cp.zeroOffset*scale;
+    currentGeometry.oneEightyDegreeCenter = currentGeometry.zeroDegreeCenter + cp.oneEightyOffset*scale;
+    currentGeometry.radius = cp.radius;
+    currentGeometry.phi = cp.phi;
+    currentGeometry.alpha = cp.alpha;
+    updateGeometry();
 
-    int opty = 0;
+    OptimizerRanges r = optimizerRanges();
+    r.xSharpness = qMin(r.xSharpness, CALIBRATION_CENTER_RANGE);
+    r.ySharpness = qMin(r.ySharpness, CALIBRATION_CENTER_RANGE);
+    r.xSymmetry = qMin(r.xSymmetry, CALIBRATION_CENTER_RANGE);
+    r.ySymmetry = qMin(r.ySymmetry, CALIBRATION_CENTER_RANGE);
 
-    if (residual(x, y1, filmData) <= residual(x, y2, filmData))
-    {
-        cout << "Optimized y point is y = " << y1 << endl;
-        opty = y1;
-    } else
+    OptimizerStrategy strategy("calibration", appConfig->getOptIndex() == SharpnessOpt);
+    GeometryOptimizer o = optimizer(r);
     {
-        cout << "Optimized y point is y = " << y2 << endl;
-        opty = y2;
+        ScopedTimer timer("optimize.calibration");
+        o.run(strategy);
     }
-
-
-    if (location == ZERO_DEGREES)
-        currentGeometry.zeroDegreeCenter.setY(currentGeometry.zeroDegreeCenter.y() + opty);
-    else
-        currentGeometry.oneEightyDegreeCenter.setY(currentGeometry.oneEightyDegreeCenter.y() + opty);
-
-    this->updateGeometry();
-
-    if (location == ZERO_DEGREES)
-        return currentGeometry.zeroDegreeCenter;
-    else
-        return currentGeometry.oneEightyDegreeCenter;
-
-
+    applyOptimizer(o);
+    currentGeometry.converged = true;
+    previousGeometry = before;
+
+    log->addMessage(tr("[FilmWidget] Calibration %1 applied, centers refined to (%2, %3) and (%4, %5) in %6 evaluations.")
+                    .arg(cp.name)
+                    .arg(currentGeometry.zeroDegreeCenter.x()).arg(currentGeometry.zeroDegreeCenter.y())
+                    .arg(currentGeometry.oneEightyDegreeCenter.x()).arg(currentGeometry.oneEightyDegreeCenter.y())
+                    .arg(o.counts.total()));
+    return true;
 }
 
-double FilmWidget::optimizeRotationSymmetry()
-{
-    int x1 = currentGeometry.zeroDegreeCenter.x();
-    int x2 = currentGeometry.oneEightyDegreeCenter.x();
-    int y1 = currentGeometry.zeroDegreeCenter.y();
-    int y2 = currentGeometry.oneEightyDegreeCenter.y();
-
-    double a = -(180.0/M_PI)*atan( double(x2-x1)/double(y2-y1) );
-
-    cout << "Optimizing rotation to " << a << " degrees." << endl;
-
-    currentGeometry.alpha = a;
-    updateGeometry();
-    //this->rotate(a);
-
-    return a;
-}
-
-double FilmWidget::optimizeRadiusSymmetry()
-{
-    //int x1 = currentGeometry.zeroDegreeCenter.x();
-    //int x2 = currentGeometry.oneEightyDegreeCenter.x();
-    int y1 = currentGeometry.zeroDegreeCenter.y();
-    int y2 = currentGeometry.oneEightyDegreeCenter.y();
-
-    double R = (1.0/M_PI)*(y2-y1)/filmDPM;
-
-    currentGeometry.radius = R;
-    updateGeometry();
-
-    return R;
-}
-
-double FilmWidget::optimizeRadiusSharpness()
+/* ***************************************************************************
+ * method: findCenters
+ * description: places the centers found from the symmetry of the film (see
+ *   CenterFinder.h) as the guesses, with the radius their separation gives,
+ *   and the optimization regions around them as Alt-clicking does.  With
+ *   keepConverged, the optimized geometry of the last film is kept when the
+ *   0 degree center found is within FOUND_CENTER_KEEP_DISTANCE of it, so a
+ *   batch of films from one camera still starts the optimizer warm.
+ * ***************************************************************************/
+bool FilmWidget::findCenters(bool keepConverged)
 {
-    previousGeometry = currentGeometry;
-    QRect reg = optRegionSh;
-
-    int iter = 0;
-    double deltarad = 1e20;
-    double deltash = 1e20;
-    int y = 0;
-    int x = 0;
+    if (filmData == NULL) return false;
 
-    double gamma = (sqrt(5.0) - 1.0)/2.0;
+    qint64 start = instrumentationClock();
+    CenterEstimate e = ::findCenters(filmSampler(), filmDPM, appConfig->getCameraRadius());
+    double msecs = (instrumentationClock() - start)/1.0e6;
 
-    double rad1 = appConfig->getCameraRadius()-appConfig->getRadiusRange();
-    double rad2 = appConfig->getCameraRadius()+appConfig->getRadiusRange();
-    double rad3 = rad2 - gamma*(rad2-rad1);
-    double rad4 = rad1 + gamma*(rad2-rad1);
-
-
-   /*for (double rad = 0.050; rad <= 0.065; rad = rad + 0.0001)
+    if (!e.found)
     {
-        currentGeometry.radius = rad;
-        double r = -integrateRegion(0.05, x, y, reg);
-        cout << rad << ", " << r << endl;
-    }*/
-
-    //reg.setHeight(int(floor(M_PI*rad1*filmDPM) + 0.5));
-    currentGeometry.radius = rad1;
-    double r1 =-integrateRegion(0.025,x,y,reg);
-    //reg.setHeight(int(floor(M_PI*rad2*filmDPM) + 0.5));
-    currentGeometry.radius = rad2;
-    double r2 = -integrateRegion(0.025,x,y,reg);
-    currentGeometry.radius = rad3;
-    //reg.setHeight(int(floor(M_PI*rad3*filmDPM) + 0.5));
-    double r3 = -integrateRegion(0.025,x,y,reg);
-    currentGeometry.radius = rad4;
-    //reg.setHeight(int(floor(M_PI*rad4*filmDPM) + 0.5));
-    double r4 = -integrateRegion(0.025,x,y,reg);
-
-    do
-    {
-
-        if (r3 <= r4)
-        {
-            rad2 = rad4;
-            r2 = r4;
-            rad4 = rad3;
-            r4 = r3;
-
-            rad3 = rad2 - gamma*(rad2-rad1);
-            currentGeometry.radius = rad3;
-            //reg.setHeight(int(floor(M_PI*rad3*filmDPM) + 0.5));
-            r3 = -integrateRegion(0.025,x,y,reg);
-        } else
-        {
-            rad1 = rad3;
-            r1 = r3;
-            rad3 = rad4;
-            r3 = r4;
-
-            rad4 = rad1 + gamma*(rad2-rad1);
-            currentGeometry.radius = rad4;
-            //reg.setHeight(int(floor(M_PI*rad4*filmDPM) + 0.5));
-            r4 = -integrateRegion(0.025,x,y,reg);
-        }
-
-        iter++;
-        deltarad = abs(rad2-rad1);
-        deltash = abs(r2-r1);
-        cout << "Iter[" << iter << "] rad1 = " << rad1 << ", rad2 = " << rad2 << ", rad3 = " << rad3 << ", rad4 = " << rad4 << endl;
-        cout << "DR = " << deltarad << ", Dsh = " << deltash << endl;
-    } while (iter < 500 && deltarad > 0.000001); //&& deltash > 0.0000001 );//&& abs(x1) < 20);
-
-    currentGeometry.radius = (rad1 + rad2)/2.0;
-
-    log->addMessage(tr("Radius optimized to %1").arg(currentGeometry.radius));
-    updateGeometry();
-
-    return currentGeometry.radius;
-}
-
-double FilmWidget::residual(int xoffset, int yoffset, QImage *data)
-{	
-    //QRect *optRegionA = &optRegion0A;
-    //QRect *optRegionB = &optRegion0B;
-    QRect oaMod = *optRegionA;
-    QRect obMod = *optRegionB;
-
-    oaMod.moveCenter(QPoint(oaMod.center().x() + xoffset, oaMod.center().y() + yoffset));
-    obMod.moveCenter(QPoint(obMod.center().x() + xoffset, obMod.center().y() + yoffset));
-
-    double res = 0;
-    int xmin = oaMod.x();
-    int xmax = oaMod.x() + oaMod.width();
-    int ymin = oaMod.y();
-    int ymax = obMod.y() + obMod.height();
-
-
-    double rIA = regionIntensity(oaMod, data);
-    double rIB = regionIntensity(obMod, data);
-
-    for (int x = xmin; x < xmax; x++) {
-        for (int y = ymin; y < ymin + oaMod.height(); y++) {
-            res += 0.5*(qGray(data->pixel(xmax-(x-xmin), ymax - (y-ymin))) + qGray(data->pixel(x,y)) )*pow2((rIB/rIA)*qGray(data->pixel(x,y)) - qGray(data->pixel(xmax-(x-xmin), ymax - (y-ymin))));
-            //res += pow2((rIB/rIA)*qGray(data->pixel(x,y)) - qGray(data->pixel(xmax-(x-xmin), ymax - (y-ymin))));
-        }
+        log->addMessage(LogWarning, tr("[FilmWidget] No centers found (symmetry %1, %2); Alt-click them instead.")
+                        .arg(e.xSymmetry, 0, 'f', 2).arg(e.ySymmetry, 0, 'f', 2));
+        return false;
     }
 
-    this->repaint();
-    return res;
-}
-
-double FilmWidget::regionIntensity(QRect r, QImage *d)
-{
-    double normIntensity = 0;
+    if (keepConverged && currentGeometry.converged &&
+        (e.zeroDegreeCenter - currentGeometry.zeroDegreeCenter).manhattanLength() <= FOUND_CENTER_KEEP_DISTANCE)
+    {
+        log->addMessage(tr("[FilmWidget] Centers found at (%1, %2) in %3 ms; keeping the last optimized geometry.")
+                        .arg(e.zeroDegreeCenter.x()).arg(e.zeroDegreeCenter.y()).arg(msecs, 0, 'f', 1));
+        return true;
+    }
 
-    for(int x = r.x(); x < r.x() + r.width(); x++)
+    previousGeometry = currentGeometry;
+    guessCenter0 = e.zeroDegreeCenter;
+    guessCenter180 = e.oneEightyDegreeCenter;
+    currentGeometry.zeroDegreeCenter = e.zeroDegreeCenter;
+    currentGeometry.oneEightyDegreeCenter = e.oneEightyDegreeCenter;
+    currentGeometry.radius = (e.oneEightyDegreeCenter.y() - e.zeroDegreeCenter.y())/(M_PI*filmDPM);
+    currentGeometry.converged = false;
+
+    if (optRegion0A.width() == 0)
     {
-        for(int y = r.y(); y < r.y() + r.height(); y++)
-        {
-            normIntensity += qGray(d->pixel(x,y));
-        }
+        updateIntArea();
+        placeOptimizationRegions();
+        this->update();
     }
+    else updateGeometry();
 
-    return normIntensity/(r.width()*r.height());
+    log->addMessage(tr("[FilmWidget] Centers found at (%1, %2) and (%3, %4)%5 in %6 ms (symmetry %7, %8).")
+                    .arg(e.zeroDegreeCenter.x()).arg(e.zeroDegreeCenter.y())
+                    .arg(e.oneEightyDegreeCenter.x()).arg(e.oneEightyDegreeCenter.y())
+                    .arg(e.oneEightyFound ? QString() : tr(", the 180 degree one from the camera radius"))
+                    .arg(msecs, 0, 'f', 1).arg(e.xSymmetry, 0, 'f', 2).arg(e.ySymmetry, 0, 'f', 2));
+
+    emit geometryUpdated();
+    return true;
 }
 
-// Do integration as in Matsuzaki paper
-double FilmWidget::integrate(double resolution, int xo, int yo)
+/* Optimization regions of an inch square, an inch and a half above and
+ * below each center */
+void FilmWidget::placeOptimizationRegions()
 {
-    sb->showMessage("Performing integration...");
-
-    this->intResolution = resolution;
-    double c;
-    double L;
-    double twoTheta;
-    double bg = 0.0;
-    int twoThetaIndex;
-    double cp = cos(currentGeometry.phi*M_PI/180.0);
-    double sp = sin(currentGeometry.phi*M_PI/180.0);
-    double ca = cos(currentGeometry.alpha*M_PI/180.0);
-    double sa = sin(currentGeometry.alpha*M_PI/180.0);
-    double R = currentGeometry.radius;
-
+    int offset = 1.5*0.0254*filmDPM;
+    if (offset % 2 != 0) offset = offset + 1;
 
-    // Allocate array
-    intData = new double*[int(180.0/resolution)];
-    for (int i = 0; i < int(180.0/resolution); i++)
-        intData[i] = new double[3];
+    optRegion0A.setWidth(0.0254*filmDPM);
+    if (optRegion0A.width() % 2 == 0) optRegion0A.setWidth(optRegion0A.width()+1);
 
-    double intDataMin[int(180.0/resolution)];
-    double intDataMax[int(180.0/resolution)];
+    optRegion0A.setHeight(0.0254*filmDPM);
+    if (optRegion0A.height() % 2 == 0) optRegion0A.setHeight(optRegion0A.height()+1);
 
-    QRect intArea = this->intArea;
-    intArea.moveCenter(QPoint(intArea.center().x() + xo, intArea.center().y() + yo));
+    optRegion0A.moveCenter(QPoint(currentGeometry.zeroDegreeCenter.x(), currentGeometry.zeroDegreeCenter.y() - offset));
 
-    // Initialize 2theta values and set intensities to zero
-    for (int i = 0; i < int(180.0/resolution); i++) {
-        intData[i][0] = i*resolution;
-        intData[i][1] = 0.0;
-        intData[i][2] = 0.0;
-        intDataMin[i] = 1e10;
-        intDataMax[i] = 0.0;
-    }
+    optRegion0B.setWidth(0.0254*filmDPM);
+    if (optRegion0B.width() % 2 == 0) optRegion0B.setWidth(optRegion0B.width()+1);
 
-    // Loop through image data, determine 2theta and store intensity
-    for (int x = intArea.x(); x < intArea.x()+intArea.width(); x++) {
-        c = double(x-intArea.x()-intArea.width()/2.0)/filmDPM;
-        for (int y = intArea.y(); y < intArea.y()+intArea.height(); y++) {
+    optRegion0B.setHeight(0.0254*filmDPM);
+    if (optRegion0B.height() % 2 == 0) optRegion0B.setHeight(optRegion0B.height()+1);
 
-            bool inexclude = false;
+    optRegion0B.moveCenter(QPoint(currentGeometry.zeroDegreeCenter.x(), currentGeometry.zeroDegreeCenter.y() + offset));
 
-            for (int i = 0; i < excludeRegions.size(); i++) {
-                if (excludeRegions[i].contains(x, y))
-                    inexclude = true;
-            }
+    optRegion180A.setWidth(0.0254*filmDPM);
+    if (optRegion180A.width() % 2 == 0) optRegion180A.setWidth(optRegion180A.width() + 1);
 
-            if (inexclude) continue;
+    optRegion180A.setHeight(0.0254*filmDPM);
+    if (optRegion180A.height() % 2 == 0) optRegion180A.setHeight(optRegion180A.height() + 1);
 
-            L = double(y-intArea.y())/filmDPM;
+    optRegion180A.moveCenter(QPoint(currentGeometry.oneEightyDegreeCenter.x(), currentGeometry.oneEightyDegreeCenter.y() - offset));
 
-            int nx, ny;
+    optRegion180B.setWidth(0.0254*filmDPM);
+    if (optRegion180B.width() % 2 == 0) optRegion180B.setWidth(optRegion180B.width() + 1);
 
-            if (currentGeometry.alpha >= 0)
-            {
-                nx = x*ca - y*sa + sa*filmData->height();
-                ny = x*sa + y*ca;
-            } else
-            {
-                nx = x*ca - y*sa;
-                ny = x*sa + y*ca - sa*filmData->height();
-            }
+    optRegion180B.setHeight(0.0254*filmDPM);
+    if (optRegion180B.height() % 2 == 0) optRegion180B.setHeight(optRegion180B.height() + 1);
 
+    optRegion180B.moveCenter(QPoint(currentGeometry.oneEightyDegreeCenter.x(), currentGeometry.oneEightyDegreeCenter.y() + offset));
 
-            //twoTheta = (180.0/M_PI)*atan(sqrt( pow2( cp*((c)*cb+R*sb*sin((L)/R)) - R*sp*cos((L)/R)) + pow2(R*cb*sin((L)/R) - (c)*sb)  )/(R*cos((L)/R)*cp + sp*((c)*cb + R*sb*sin((L)/R))) );
-            twoTheta = (180.0/M_PI)*atan( sqrt( ( pow2( c*cp + R*sp*cos(L/R) ) + pow2(R*sin(L/R)) ) / pow2( -c*sp + R*cp*cos(L/R) ) ) );
+    TRACE(TraceFilm, QString("ya = %1, ha = %2").arg(optRegion0A.center().y()).arg(optRegion0A.height()));
+    TRACE(TraceFilm, QString("yb = %1, hb = %2").arg(optRegion0B.center().y()).arg(optRegion0B.height()));
+}
 
-            if (twoTheta > 180.0) twoTheta = twoTheta - 180.0;
-            if (twoTheta < 0) twoTheta = -twoTheta;
+double FilmWidget::regionIntensity(QRect r, FilmImage *d)
+{
+    return regionMean(FilmSampler(d, currentGeometry.transform, currentGeometry.roi), r);
+}
 
-            if (L > intArea.height()/(2.0*filmDPM)) { twoTheta = 180 - twoTheta; }
+// Do integration as in Matsuzaki paper
+double FilmWidget::integrate(double resolution, int xo, int yo)
+{
+    ScopedTimer timer("integrate");
+    sb->showMessage("Performing integration...");
 
-            twoThetaIndex = floor(twoTheta/resolution + 0.5);
+    this->intResolution = resolution;
+    double bg = 0.0;
 
-            if (twoThetaIndex < int(180.0/resolution))
-            {
-                if (x < filmData->width() && y < filmData->height())
-                {
-                    intData[twoThetaIndex][1] += qGray(filmData->pixel(nx, ny));
-                    intData[twoThetaIndex][2] = intData[twoThetaIndex][2] + 1;
-                }
+    // Intensities go into a fine master histogram so that other step sizes
+    // can be produced later without another pass over the film
+    histogram.reset(resolution, appConfig->getIntMode(), appConfig->getClipSigma());
 
-                if (qGray(filmData->pixel(x,y)) < intDataMin[twoThetaIndex])
-                    intDataMin[twoThetaIndex] = qGray(filmData->pixel(nx,ny));
+    QRect intArea = this->intArea;
+    intArea.moveCenter(QPoint(intArea.center().x() + xo, intArea.center().y() + yo));
 
-                if (qGray(filmData->pixel(x,y)) > intDataMax[twoThetaIndex])
-                    intDataMax[twoThetaIndex] = qGray(filmData->pixel(nx,ny));
-            }
-        }
-    }
+    // Loop through image data, determine 2theta and store intensity.  The
+    // kernel is chosen for the geometry so the common phi = alpha = 0 case
+    // uses the simplified formula and skips the rotation.
+    KernelParams p;
+    p.loop = intArea;
+    p.cOffset = intArea.x() + intArea.width()/2.0;
+    p.LOffset = intArea.y();
+    p.foldL = intArea.height()/(2.0*filmDPM);
+    p.dpm = filmDPM;
+    p.R = currentGeometry.radius;
+    FilmSampler film = filmSampler();
+    p.setAngles(currentGeometry.phi, currentGeometry.alpha, film.height());
+    p.exclude = &excludeRegions;
+
+    // The robust modes keep every pixel visited, at most the whole area
+    QRect visited = intArea.intersected(QRect(0, 0, film.width(), film.height()));
+    histogram.reserveSamples(visited.width()*visited.height());
+
+    // Mean, min/max and the quantile sketch are all accumulated by the sink
+    HistogramSink sink;
+    sink.histogram = &histogram;
+    runIntegrationKernel(film, p, selectKernel(currentGeometry.phi, currentGeometry.alpha, !film.isIdentity()), sink);
+
+    histogram.finish();
+    IntegrationResult result = histogram.result(resolution);
+    int nBins = result.size();
 
     double Sum_WiIi = 0.0;
     double Sum_Wi = 0.0;
     double Sum_WiIisqrt = 0.0;
 
-    for (int i = 0; i < int(180.0/resolution); i++) {
-        Sum_WiIi += intData[i][1];
-
+    for (int i = 0; i < nBins; i++) {
+        Sum_WiIi += result.count[i]*result.mean[i];
 
-        if ( intData[i][2] != 0 )
-            intData[i][1] = intData[i][1]/intData[i][2];
-        else if ( intData[i][2] == 0 && i > 0 )
-            intData[i][1] = intData[i-1][1];
-
-        Sum_WiIisqrt += intData[i][2]*sqrt(intData[i][1]);
-        Sum_WiIi += intData[i][2]*intData[i][1];
-        Sum_Wi += intData[i][2];
+        Sum_WiIisqrt += result.count[i]*sqrt(result.mean[i]);
+        Sum_WiIi += result.count[i]*result.mean[i];
+        Sum_Wi += result.count[i];
     }
 
     double I = Sum_WiIi/Sum_Wi;
     double Isqrt = Sum_WiIisqrt/Sum_Wi;
+    countEvent("integrate.pixels", qint64(Sum_Wi));
 
     double sh = sqrt( I - pow(Isqrt,2.0) )/ Isqrt;
     log->addMessage(tr("[Plot] Sharpness = %1").arg(sh));
 
     this->sb->showMessage("Integration complete.");
 
-    double *xd = new double[int(180.0/resolution)];
-    for (int i = 0; i < int(180.0/resolution); i++) {
-        xd[i] = intData[i][0];
-    }
-
-    double *yd = new double[int(180.0/resolution)];
-    for (int i = 0; i < int(180.0/resolution); i++) {
-        //if (i < (int(180.0/resolution)-5) && sqrt(pow((intData[i][1] - intData[i+3][1]),2.0)) < 2)
-        //    bg = intData[i][1];
-
-        yd[i] = intData[i][1] - bg;
+    for (int i = 0; i < nBins; i++) {
+        result.mean[i] = result.mean[i] - bg;
     }
 
-    twoThetaWindow->setXYData(xd, yd, int(180.0/resolution));
-    twoThetaWindow->setYMinData(intDataMin);
-    twoThetaWindow->setYMaxData(intDataMax);
+    twoThetaWindow->setHistogram(histogram);
+    twoThetaWindow->setIntegration(result);
     twoThetaWindow->show();
 
     currentGeometry.sharpness = sh;
@@ -1074,15 +797,8 @@ double FilmWidget::integrate(double resolution, int xo, int yo)
 double FilmWidget::integrateRegionDifference(double res, int xo, int yo, QRect regA, QRect regB)
 {
     this->intResolution = res;
-    double c;
-    double L;
-    double twoTheta;
-    double bg = 0.0;
-    int twoThetaIndex;
     double cp = cos(currentGeometry.phi);
     double sp = sin(currentGeometry.phi);
-    double ca = cos(currentGeometry.alpha);
-    double sa = sin(currentGeometry.alpha);
     double R = currentGeometry.radius;
 
     regA.setLeft(intArea.left());
@@ -1119,47 +835,32 @@ double FilmWidget::integrateRegionDifference(double res, int xo, int yo, QRect r
         intDataB[i][2] = 0.0;
     }
 
-    // Loop through image data, determine 2theta and store intensity
-    for (int x = regA.x(); x < regA.x()+regA.width(); x++) {
-        c = double(x+xo-regA.x()-regA.width()/2.0)/filmDPM;
-
-        for (int y = regA.y(); y < regA.y()+regA.height(); y++) {
-
-            bool inexclude = false;
-
-            for (int i = 0; i < excludeRegions.size(); i++) {
-                if (excludeRegions[i].contains(x, y))
-                    inexclude = true;
-            }
-
-            if (inexclude) continue;
-
-            L = double(y+ yo-currentGeometry.zeroDegreeCenter.y())/filmDPM;
-
-            //twoTheta = (180.0/M_PI)*atan(sqrt( pow2( cp*((c)*cb+R*sb*sin((L)/R)) - R*sp*cos((L)/R)) + pow2(R*cb*sin((L)/R) - (c)*sb)  )/(R*cos((L)/R)*cp + sp*((c)*cb + R*sb*sin((L)/R))) );
-            twoTheta = (180.0/M_PI)*atan( sqrt( ( pow2( c*cp + R*sp*cos(L/R) ) + pow2(R*sin(L/R)) ) / pow2( -c*sp + R*cp*cos(L/R) ) ) );
-
-
-            if (twoTheta > 180.0) twoTheta = twoTheta - 180.0;
-            if (twoTheta < 0) twoTheta = -twoTheta;
-
-            if (L > intArea.height()/(2.0*filmDPM)) { twoTheta = 180 - twoTheta; }
-
-            if (twoTheta > angleStop || twoTheta < angleStart) continue;
-
-            //cout << "ttA = " << twoTheta << endl;
+    // phi is used here as given (not converted from degrees) and there is
+    // no alpha rotation, as before
+    FilmSampler film = filmSampler();
+    KernelParams p;
+    p.LOffset = currentGeometry.zeroDegreeCenter.y() - yo;
+    p.foldL = intArea.height()/(2.0*filmDPM);
+    p.minTwoTheta = angleStart;
+    p.maxTwoTheta = angleStop;
+    p.dpm = filmDPM;
+    p.R = R;
+    p.cp = cp;
+    p.sp = sp;
+    p.exclude = &excludeRegions;
+    int kernel = (sp == 0.0) ? ZeroTiltKernel : TiltOnlyKernel;
+    if (!film.isIdentity()) kernel |= RotatedKernel;
 
-            twoThetaIndex = floor(twoTheta/res + 0.5);
-
-
-            if (x < filmData->width() && y < filmData->height() && x > 0 && y > 0)
-            {
-                intDataA[twoThetaIndex][1] += qGray(filmData->pixel(x, y));
-                intDataA[twoThetaIndex][2] = intDataA[twoThetaIndex][2] + 1;
-            }
+    // Loop through image data, determine 2theta and store intensity
+    BinSink sinkA;
+    sinkA.data = intDataA;
+    sinkA.res = res;
+    sinkA.n = int(180.0/res);
 
-        }
-    }
+    p.loop = regA;
+    p.cOffset = regA.x() + regA.width()/2.0 - xo;
+    p.positiveOnly = true;
+    runIntegrationKernel(film, p, kernel, sinkA);
 
     cStart = double(regB.left()-intArea.x()-intArea.width()/2.0)/filmDPM;
     LStart = double(regB.bottom()-intArea.y())/filmDPM;
@@ -1172,44 +873,16 @@ double FilmWidget::integrateRegionDifference(double res, int xo, int yo, QRect r
     //cout << "B start = " << angleStart << ", B stop = " << angleStop << endl;
 
     // Loop through image data, determine 2theta and store intensity
-    for (int x = regB.x(); x < regB.x()+regB.width(); x++) {
-        c = double(x+xo-regB.x()-regB.width()/2.0)/filmDPM;
-
-        for (int y = regB.y(); y < regB.y()+regB.height(); y++) {
-            if (y <= 0) break;
-
-            bool inexclude = false;
-
-            for (int i = 0; i < excludeRegions.size(); i++) {
-                if (excludeRegions[i].contains(x, y))
-                    inexclude = true;
-            }
-
-            if (inexclude) continue;
-
-            L = double(y+ yo-currentGeometry.zeroDegreeCenter.y())/filmDPM;
-
-            //twoTheta = (180.0/M_PI)*atan(sqrt( pow2( cp*((c)*cb+R*sb*sin((L)/R)) - R*sp*cos((L)/R)) + pow2(R*cb*sin((L)/R) - (c)*sb)  )/(R*cos((L)/R)*cp + sp*((c)*cb + R*sb*sin((L)/R))) );
-            twoTheta = (180.0/M_PI)*atan( sqrt( ( pow2( c*cp + R*sp*cos(L/R) ) + pow2(R*sin(L/R)) ) / pow2( -c*sp + R*cp*cos(L/R) ) ) );
-
-
-            if (twoTheta > 180.0) twoTheta = twoTheta - 180.0;
-            if (twoTheta < 0) twoTheta = - twoTheta;
+    BinSink sinkB;
+    sinkB.data = intDataB;
+    sinkB.res = res;
+    sinkB.n = int(180.0/res);
 
-            if (L > intArea.height()/(2.0*filmDPM)) { twoTheta = 180 - twoTheta; }
-            //cout << "ttB = " << twoTheta << endl;
-            if (twoTheta > angleStop || twoTheta < angleStart) continue;
-
-
-            twoThetaIndex = floor(twoTheta/res + 0.5);
-
-            if (x < filmData->width() && y < filmData->height())
-            {
-                intDataB[twoThetaIndex][1] += qGray(filmData->pixel(x, y));
-                intDataB[twoThetaIndex][2] = intDataB[twoThetaIndex][2] + 1;
-            }
-        }
-    }
+    p.loop = regB;
+    p.cOffset = regB.x() + regB.width()/2.0 - xo;
+    p.positiveOnly = false;
+    if (regB.y() > 0)
+        runIntegrationKernel(film, p, kernel, sinkB);
 
     double ret = 0.0;
 
@@ -1228,138 +901,6 @@ double FilmWidget::integrateRegionDifference(double res, int xo, int yo, QRect r
     return ret;
 }
 
-double FilmWidget::integrateRegion(double res, int xo, int yo, QRect reg)
-{
-
-    this->intResolution = res;
-    double c;
-    double L;
-    double twoTheta;
-    double bg = 0.0;
-    int twoThetaIndex;
-    double cp = cos(currentGeometry.phi*M_PI/180.0);
-    double sp = sin(currentGeometry.phi*M_PI/180.0);
-    double ca = cos(currentGeometry.alpha*M_PI/180.0);
-    double sa = sin(currentGeometry.alpha*M_PI/180.0);
-    double R = currentGeometry.radius;
-
-    //reg.setLeft(intArea.left());
-    //reg.setWidth(intArea.width());
-
-    double cStart = double(reg.left()-intArea.x()-intArea.width()/2.0)/filmDPM;
-    double LStart = double(reg.top()-intArea.y())/filmDPM;
-    //double angleStart = (180.0/M_PI)*atan(sqrt( pow2( cp*((cStart)*cb+R*sb*sin((LStart)/R)) - R*sp*cos((LStart)/R)) + pow2(R*cb*sin((LStart)/R) - (cStart)*sb)  )/(R*cos(LStart/R)*cp + sp*(cStart*cb + R*sb*sin(LStart/R))) );
-    double angleStart = (180.0/M_PI)*atan( sqrt( ( pow2( cStart*cp + R*sp*cos(LStart/R) ) + pow2(R*sin(LStart/R)) ) / pow2( -cStart*sp + R*cp*cos(LStart/R) ) ) );
-
-    double cEnd = double(reg.center().x()-intArea.x()-intArea.width()/2.0)/filmDPM;
-    double LEnd = double(reg.bottom()-intArea.y())/filmDPM;
-    //double angleStop = (180.0/M_PI)*atan(sqrt( pow2( cp*((cEnd)*cb+R*sb*sin((LEnd)/R)) - R*sp*cos((LEnd)/R)) + pow2(R*cb*sin((LEnd)/R) - (cEnd)*sb)  )/(R*cos((LEnd)/R)*cp + sp*((cEnd)*cb + R*sb*sin((LEnd)/R))) );
-    double angleStop = (180.0/M_PI)*atan( sqrt( ( pow2( cEnd*cp + R*sp*cos(LEnd/R) ) + pow2(R*sin(LEnd/R)) ) / pow2( -cEnd*sp + R*cp*cos(LEnd/R) ) ) );
-
-    intData = new double*[int(180.0/res)];
-    for (int i = 0; i < int(180.0/res); i++)
-        intData[i] = new double[3];
-
-    for (int i = 0; i < int(180.0/res); i++)
-    {
-        intData[i][0] = i*res;
-        intData[i][1] = 0.0;
-        intData[i][2] = 0.0;
-    }
-
-
-    // Loop through image data, determine 2theta and store intensity
-    for (int x = reg.x(); x < reg.x()+reg.width(); x++) {
-        c = double(x+xo-reg.x()-reg.width()/2.0)/filmDPM;
-        for (int y = reg.y(); y < reg.y()+reg.height(); y++) {
-
-            bool inexclude = false;
-
-            for (int i = 0; i < excludeRegions.size(); i++) {
-                if (excludeRegions[i].contains(x, y))
-                    inexclude = true;
-            }
-
-            if (inexclude) continue;
-
-            L = double(y+ yo-intArea.y())/filmDPM;
-
-            int nx, ny;
-
-            if (currentGeometry.alpha >= 0)
-            {
-                nx = x*ca - y*sa + sa*filmData->height();
-                ny = x*sa + y*ca;
-            } else
-            {
-                nx = x*ca - y*sa;
-                ny = x*sa + y*ca - sa*filmData->height();
-            }
-            //c = nc;
-            //L = nL;
-
-
-            //twoTheta = (180.0/M_PI)*atan(sqrt( pow2( cp*((c)*cb+R*sb*sin((L)/R)) - R*sp*cos((L)/R)) + pow2(R*cb*sin((L)/R) - (c)*sb)  )/(R*cos((L)/R)*cp + sp*((c)*cb + R*sb*sin((L)/R))) );
-            twoTheta = (180.0/M_PI)*atan( sqrt( ( pow2( c*cp + R*sp*cos(L/R) ) + pow2(R*sin(L/R)) ) / pow2( -c*sp + R*cp*cos(L/R) ) ) );
-
-            if (twoTheta > 180.0) twoTheta = twoTheta - 180.0;
-            if (twoTheta < 0) twoTheta = -twoTheta;
-
-            if (L > intArea.height()/(2.0*filmDPM)) { twoTheta = 180 - twoTheta; }
-
-            twoThetaIndex = floor(twoTheta/res + 0.5);
-
-
-            if (x < filmData->width() && y < filmData->height() && twoThetaIndex < 180.0/res)
-            {
-                intData[twoThetaIndex][1] += qGray(filmData->pixel(nx, ny));
-                intData[twoThetaIndex][2] = intData[twoThetaIndex][2] + 1;
-            }
-
-        }
-    }
-
-    double Sum_WiIi = 0.0;
-    double Sum_Wi = 0.0;
-    double Sum_WiIisqrt = 0.0;
-
-    for (int i = 0; i < int(180.0/res); i++) {
-        Sum_WiIi += intData[i][1];
-
-
-        if ( intData[i][2] != 0 )
-            intData[i][1] = intData[i][1]/intData[i][2];
-        else if ( intData[i][2] == 0 && i > 0 )
-            intData[i][1] = intData[i-1][1];
-
-        Sum_WiIisqrt += intData[i][2]*sqrt(intData[i][1]);
-        Sum_WiIi += intData[i][2]*intData[i][1];
-        Sum_Wi += intData[i][2];
-    }
-
-    double I, Isqrt, sh;
-    if (Sum_Wi != 0.0)
-    {
-        I = Sum_WiIi/Sum_Wi;
-        Isqrt = Sum_WiIisqrt/Sum_Wi;
-    } else
-    {
-        I = 0;
-        Isqrt = 0;
-    }
-
-
-    if (Isqrt == 0.0)
-    {
-       sh = 0.0;
-    } else
-    {
-        sh = sqrt( I - pow(Isqrt,2.0) )/ Isqrt;
-    }
-
-    return sh;
-}
-
 void FilmWidget::saveCSV()
 {
     this->twoThetaWindow->saveCSV();
@@ -1385,9 +926,32 @@ void FilmWidget::saveTIFF()
     if (res == QFileDialog::Accepted)
     {
         tifFilename = qfd.selectedFiles().at(0);
-        filmData->setDotsPerMeterX(filmDPM);
-        filmData->setDotsPerMeterY(filmDPM);
-        filmData->save(tifFilename, "tiff", 100);
+        ScopedTimer timer("export.tiff");
+
+        // The film is only resampled (and cropped) here, to save it as it
+        // is viewed.  It is painted through the transform itself, as
+        // QImage::transformed would shift a composed transform back to the
+        // origin where FilmSampler does not.
+        QImage out = filmData->toImage();
+        if (!currentGeometry.transform.isIdentity())
+        {
+            QImage view(FilmSampler::viewSize(currentGeometry.transform, filmData->size()), QImage::Format_ARGB32_Premultiplied);
+            view.fill(0);
+
+            QPainter painter(&view);
+            painter.setRenderHint(QPainter::SmoothPixmapTransform);
+            painter.setWorldMatrix(currentGeometry.transform);
+            painter.drawImage(0, 0, out);
+            painter.end();
+
+            out = view;
+        }
+        if (!currentGeometry.roi.isNull())
+            out = out.copy(currentGeometry.roi);
+
+        out.setDotsPerMeterX(filmDPM);
+        out.setDotsPerMeterY(filmDPM);
+        out.save(tifFilename, "tiff", 100);
     }
 
 }
@@ -1473,7 +1037,7 @@ double* FilmWidget::getAngleRangeFromQRect(QRect r)
 
     angles[1] = a;
 
-    cout << "start = " << angles[0] << ", stop = " << angles[1] << endl;
+    TRACE(TraceFilm, QString("start = %1, stop = %2").arg(angles[0]).arg(angles[1]));
 
     return angles;
 
@@ -1491,16 +1055,16 @@ void FilmWidget::moveOptimizationRegion(QAction* a)
 
         if (ok)
         {
-            cout << "Move to specific region between " << a1 << " and " << a2 << endl;
+            TRACE(TraceFilm, QString("Move to specific region between %1 and %2").arg(a1).arg(a2));
             QRect r = getQRectFromAngleRange(a1, a2);
             optRegionSh = r;
-            this->repaint();
+            this->update();
         }
     } else {
         OptimizationRegion r = appConfig->getOptRegion(a->data().toString());
-        cout << "Move to x = " << r.start << ", y = " << r.stop << endl;
+        TRACE(TraceFilm, QString("Move to x = %1, y = %2").arg(r.start).arg(r.stop));
         optRegionSh = getQRectFromAngleRange(r.start, r.stop);
-        this->repaint();
+        this->update();
     }
 }
 
@@ -1523,6 +1087,42 @@ void FilmWidget::saveOptimizationRegion()
     }
 }
 
+/* Keeps the current geometry, meant to be refined on a standard, as a
+ * calibration profile for the camera */
+void FilmWidget::saveCalibration()
+{
+    if (filmData == NULL || guessCenter0 == QPoint(0,0) || currentGeometry.oneEightyDegreeCenter == QPoint(0,0))
+    {
+        log->addMessage(LogWarning, tr("[FilmWidget] Place and optimize the centers before saving a calibration."));
+        return;
+    }
+
+    bool ok;
+    QString name = QInputDialog::getText(this, tr("Save calibration"),
+                                         tr("Calibration name:"), QLineEdit::Normal,
+                                         "", &ok);
+    if (ok && !name.isEmpty())
+    {
+        if (appConfig->hasCalibration(name) &&
+            QMessageBox::question(this, tr("Save calibration"), tr("Replace the calibration %1?").arg(name),
+                                  QMessageBox::Ok | QMessageBox::Cancel, QMessageBox::Cancel) != QMessageBox::Ok)
+            return;
+
+        CalibrationProfile cp;
+        cp.name = name;
+        cp.radius = currentGeometry.radius;
+        cp.phi = currentGeometry.phi;
+        cp.alpha = currentGeometry.alpha;
+        cp.zeroOffset = currentGeometry.zeroDegreeCenter - guessCenter0;
+        cp.oneEightyOffset = currentGeometry.oneEightyDegreeCenter - currentGeometry.zeroDegreeCenter;
+        cp.dpm = filmDPM;
+
+        appConfig->saveCalibration(name, cp);
+        appConfig->saveCalibrations();
+        log->addMessage(tr("[FilmWidget] Calibration %1 saved.").arg(name));
+    }
+}
+
 /* mousePressEvent
  * Used to get pixel info for a film click (currently print to console and sets a status message).
  * Only useful if filmData != NULL
@@ -1553,6 +1153,7 @@ void FilmWidget::mousePressEvent( QMouseEvent *event)
 
             *guessCenter = QPoint( (1.0/scaleFactor)*event->x(), (1.0/scaleFactor)*event->y());
             *currentGeometry.activeCenter = *guessCenter;
+            currentGeometry.converged = false;
 
             if (optRegionA == &optRegion0A && currentGeometry.oneEightyDegreeCenter == QPoint(0,0))
             {
@@ -1564,44 +1165,7 @@ void FilmWidget::mousePressEvent( QMouseEvent *event)
             emit geometryUpdated();
 
             if (optRegionA->width() == 0) {
-                int offset = 1.5*0.0254*filmDPM;
-                if (offset % 2 != 0) offset = offset + 1;
-
-                optRegion0A.setWidth(0.0254*filmDPM);
-                if (optRegion0A.width() % 2 == 0) optRegion0A.setWidth(optRegion0A.width()+1);
-
-                optRegion0A.setHeight(0.0254*filmDPM);
-                if (optRegion0A.height() % 2 == 0) optRegion0A.setHeight(optRegion0A.height()+1);
-
-                optRegion0A.moveCenter(QPoint(currentGeometry.zeroDegreeCenter.x(), currentGeometry.zeroDegreeCenter.y() - offset));
-
-                optRegion0B.setWidth(0.0254*filmDPM);
-                if (optRegion0B.width() % 2 == 0) optRegion0B.setWidth(optRegion0B.width()+1);
-
-                optRegion0B.setHeight(0.0254*filmDPM);
-                if (optRegion0B.height() % 2 == 0) optRegion0B.setHeight(optRegion0B.height()+1);
-
-                optRegion0B.moveCenter(QPoint(currentGeometry.zeroDegreeCenter.x(), currentGeometry.zeroDegreeCenter.y() + offset));
-
-                optRegion180A.setWidth(0.0254*filmDPM);
-                if (optRegion180A.width() % 2 == 0) optRegion180A.setWidth(optRegion180A.width() + 1);
-
-                optRegion180A.setHeight(0.0254*filmDPM);
-                if (optRegion180A.height() % 2 == 0) optRegion180A.setHeight(optRegion180A.height() + 1);
-
-                optRegion180A.moveCenter(QPoint(currentGeometry.oneEightyDegreeCenter.x(), currentGeometry.oneEightyDegreeCenter.y() - offset));
-
-                optRegion180B.setWidth(0.0254*filmDPM);
-                if (optRegion180B.width() % 2 == 0) optRegion180B.setWidth(optRegion180B.width() + 1);
-
-                optRegion180B.setHeight(0.0254*filmDPM);
-                if (optRegion180B.height() % 2 == 0) optRegion180B.setHeight(optRegion180B.height() + 1);
-
-                optRegion180B.moveCenter(QPoint(currentGeometry.oneEightyDegreeCenter.x(), currentGeometry.oneEightyDegreeCenter.y() + offset));
-
-                cout << "ya = " << optRegion0A.center().y() << ", ha = " << optRegion0A.height() << endl;
-                cout << "yb = " << optRegion0B.center().y() << ", hb = " << optRegion0B.height() << endl;
-
+                placeOptimizationRegions();
             } else {               
                 int yA = optRegionA->center().y() - (oldCenter.y()-guessCenter->y());
                 int yB = optRegionB->center().y() - (oldCenter.y()-guessCenter->y());
@@ -1609,13 +1173,13 @@ void FilmWidget::mousePressEvent( QMouseEvent *event)
                 optRegionA->moveCenter(QPoint(guessCenter->x(), yA ));
                 optRegionB->moveCenter(QPoint(guessCenter->x(), yB ));
                 optRegionSh.moveCenter(QPoint(guessCenter->x(), ySh));
-                cout << "Moved optimization regions." << endl;
+                TRACE(TraceFilm, "Moved optimization regions.");
             }
-            this->repaint();
+            this->update();
 
             //cout << "OptA = " << optRegionA->x() << ", " << optRegionA->y() << endl;
             //cout << "OptB = " << optRegionB->x() << ", " << optRegionB->y() << endl;
-            printf("Guess center set to: %i, %i\n", guessCenter->x(), guessCenter->y());
+            TRACE(TraceFilm, QString("Guess center set to: %1, %2").arg(guessCenter->x()).arg(guessCenter->y()));
         }
 
 
@@ -1642,6 +1206,7 @@ void FilmWidget::mousePressEvent( QMouseEvent *event)
                 if (excludeRegions[i].contains(mouseStartX, mouseStartY))
                 {
                     excludeRegions.remove(i);
+                    this->update();
                 }
             }
         }
@@ -1693,14 +1258,14 @@ void FilmWidget::mousePressEvent( QMouseEvent *event)
         {
             cropPoint1 = QPoint( (1.0/scaleFactor)*event->x(), (1.0/scaleFactor)*event->y());
             cropPhase = 2;
-            this->repaint();
+            this->update();
             sb->showMessage("Click the lower right crop point.");
         }
         else if (cropPhase == 2)
         {
             cropPoint2 = QPoint( (1.0/scaleFactor)*event->x(), (1.0/scaleFactor)*event->y());
             cropPhase = 0;
-            this->repaint();
+            this->update();
 
             QMessageBox msgBox;
             QString msg;
@@ -1713,13 +1278,15 @@ void FilmWidget::mousePressEvent( QMouseEvent *event)
 
             if (ret == QMessageBox::Ok)
             {
-
-                QImage *oldFilm = filmData;
-                filmData = new QImage( filmData->copy(QRect(cropPoint1, cropPoint2)) );
-                delete oldFilm;
-
-                this->setPixmap(QPixmap::fromImage(*filmData));
-                this->repaint();
+                // Only the region of interest changes, the film and its
+                // pixmap are left alone
+                pushUndo("Crop");
+                QRect &roi = currentGeometry.roi;
+                QRect view = roi.isNull() ? QRect(QPoint(0,0), getViewSize()) : roi;
+                roi = QRect(cropPoint1, cropPoint2).translated(view.topLeft()) & view;
+
+                this->resize(scaleFactor*getViewSize());
+                this->update();
             }
 
             cropPoint1.setX(0);
@@ -1738,10 +1305,10 @@ void FilmWidget::mousePressEvent( QMouseEvent *event)
         {
             deskewPoint2 = QPoint( (1.0/scaleFactor)*event->x(), (1.0/scaleFactor)*event->y());
             deskewPhase = 0;
-            this->repaint();
+            this->update();
 
             double rotAngle = atan( (double)(deskewPoint2.x()-deskewPoint1.x())/(double)(deskewPoint2.y() - deskewPoint1.y()));
-            cout << "[FilmWidget] Deskewing by " << rotAngle*180.0/M_PI << " degress." << endl;
+            TRACE(TraceFilm, QString("[FilmWidget] Deskewing by %1 degrees.").arg(rotAngle*180.0/M_PI));
 
             QMessageBox msgBox;
             QString msg;
@@ -1755,16 +1322,10 @@ void FilmWidget::mousePressEvent( QMouseEvent *event)
             if (ret == QMessageBox::Ok)
             {
 
-                QImage *oldFilm = filmData;
-
-                QMatrix rotTrans;
-                rotTrans.rotate(rotAngle*180.0/M_PI);
-                filmData = new QImage( filmData->transformed(rotTrans, Qt::SmoothTransformation) );
-                delete oldFilm;
-
-                this->setPixmap(QPixmap::fromImage(*filmData));
+                pushUndo("Deskew");
+                applyRotation(rotAngle*180.0/M_PI);
             }
-            this->repaint();
+            this->update();
 
             deskewPoint1.setX(0);
             deskewPoint1.setY(0);
@@ -1773,9 +1334,10 @@ void FilmWidget::mousePressEvent( QMouseEvent *event)
 
         }
 
-        printf("Mouse clicked in film at (%i, %i).  Pixel data = %i\n", event->x(), event->y(), qGray(filmData->pixel( (1.0/scaleFactor)*event->x(), (1.0/scaleFactor)*event->y())));
+        int pv = filmSampler().gray((1.0/scaleFactor)*event->x(), (1.0/scaleFactor)*event->y());
+        TRACE(TraceFilm, QString("Mouse clicked in film at (%1, %2).  Pixel data = %3").arg(event->x()).arg(event->y()).arg(pv));
         QString msg;
-        msg.sprintf("Mouse clicked in film at (%i, %i). Pixel data = %i\n", event->x(), event->y(), qGray(filmData->pixel( (1.0/scaleFactor)*event->x(), (1.0/scaleFactor)*event->y())));
+        msg.sprintf("Mouse clicked in film at (%i, %i). Pixel data = %i\n", event->x(), event->y(), pv);
         sb->showMessage(msg);
     }
 }
@@ -1784,6 +1346,7 @@ void FilmWidget::mouseReleaseEvent(QMouseEvent *event)
 {
     int deltaX;
     int deltaY;
+    QRect before = editedArea();
 
     deltaX = (1.0/scaleFactor)*event->x() - mouseStartX;    
     deltaY = (1.0/scaleFactor)*event->y() - mouseStartY;
@@ -1792,7 +1355,7 @@ void FilmWidget::mouseReleaseEvent(QMouseEvent *event)
     {
         if (appConfig->getOptIndex() == SymmetryOpt)
         {
-            if (optRegionA->width() + deltaX < filmData->width())
+            if (optRegionA->width() + deltaX < getViewSize().width())
             {
                 QPoint ca(optRegionA->center());
                 QPoint cb(optRegionB->center());
@@ -1861,7 +1424,10 @@ void FilmWidget::mouseReleaseEvent(QMouseEvent *event)
     mouseStartX = (1.0/scaleFactor)*event->x();
     mouseStartY = (1.0/scaleFactor)*event->y();
 
-    this->repaint();
+    /* Only the area the edited regions were and are now drawn in */
+    QRect dirty = before.united(editedArea());
+    overlayDirty = overlayDirty.united(dirty);
+    this->update(dirty);
 
 }
 
@@ -1893,126 +1459,225 @@ void FilmWidget::mouseMoveEvent(QMouseEvent *event)
  * method: paintEvent
  * description: Used to do custom drawing of widget (ie. to add lines and
  * boxes). If the film is zoomed, things are drawn according to the scalefactor.
+ * Only the exposed rectangle is drawn: the film from its tiles and the lines
+ * and boxes from the overlay layer, which is redrawn only when what it shows
+ * has changed or it does not cover the exposed area.
  * ***************************************************************************/
 void FilmWidget::paintEvent( QPaintEvent *event )
 {
-    /* Trigger parent paint event (this draws the image) */
+    ScopedTimer timer("paint");
+
+    /* Trigger parent paint event, which only draws the background. */
     QLabel::paintEvent(event);
 
     /* Only draw if a film is loaded. */
     if (filmData != NULL)
     {
         QPainter painter(this);
-        QPen pen;
-
-        /* Set common pen properties. */
-        pen.setStyle(Qt::SolidLine);
-        pen.setWidth(1);
-
-        /* 1. Draw the integration area. */
-        pen.setColor(Qt::red);
-        painter.setPen(pen);
-        painter.setRenderHint(QPainter::Antialiasing, true);
-        if (intArea.height() > 0)
+        QRect exposed = event->rect();
+
+        /* Draw the tiles of the film under the exposed area, from the mipmap
+         * level for the zoom, through the geometry transform and region of
+         * interest. */
+        QTransform crop = QTransform::fromTranslate(-currentGeometry.roi.x(), -currentGeometry.roi.y());
+        QTransform toWidget = QTransform(currentGeometry.transform)*crop*QTransform::fromScale(scaleFactor, scaleFactor);
+        painter.setRenderHint(QPainter::SmoothPixmapTransform, true);
+        painter.setWorldTransform(toWidget);
+        pyramid.draw(painter, toWidget.inverted().mapRect(QRectF(exposed)), scaleFactor, displayLevels);
+        painter.resetTransform();
+
+        /* Region drags only redraw the part of the layer they changed */
+        OverlayState state = overlayState();
+        bool layerCovers = !overlay.isNull() && overlayRect.contains(exposed);
+        if (!layerCovers || (!(state == overlayShows) && (overlayDirty.isNull() || !state.sameFrame(overlayShows))))
         {
-            QTransform transformer;
-            QPointF pi = QPointF(intArea.center().x(), intArea.y());
+            overlayRect = visibleRegion().boundingRect().united(exposed);
+            overlay = QPixmap(overlayRect.size());
+            overlay.fill(Qt::transparent);
+            renderOverlay(overlayRect);
+        }
+        else if (!(state == overlayShows))
+            renderOverlay(overlayDirty & overlayRect);
 
-            transformer.rotate(currentGeometry.alpha);
-            QPointF pf = transformer.map(pi);
-            transformer.translate( -(pf.x() - pi.x()), -(pf.y() - pi.y()));
+        overlayShows = state;
+        overlayDirty = QRect();
 
-            painter.setTransform(transformer);
-            painter.drawRect(scaleFactor*intArea.x(), scaleFactor*intArea.y(), scaleFactor*intArea.width(), scaleFactor*intArea.height());
-            painter.resetTransform();
-        }
-        painter.setRenderHint(QPainter::Antialiasing, false);
+        painter.drawPixmap(exposed, overlay, exposed.translated(-overlayRect.topLeft()));
+        painter.end();
+    }
+}
 
-        for (int i = 0; i < excludeRegions.size(); i ++)
-        {
-            QBrush qb(Qt::white, Qt::DiagCrossPattern);
-            painter.fillRect(scaleFactor*excludeRegions[i].x(), scaleFactor*excludeRegions[i].y(), scaleFactor*excludeRegions[i].width(), scaleFactor*excludeRegions[i].height(), qb);
-        }
+/* ***************************************************************************
+ * method: drawOverlay
+ * description: draws the integration area, exclusions, centers, regions and
+ *   crop/deskew markers in widget coordinates.
+ * ***************************************************************************/
+void FilmWidget::drawOverlay(QPainter &painter)
+{
+    QPen pen;
+    QSize view = getViewSize();
+
+    /* Set common pen properties. */
+    pen.setStyle(Qt::SolidLine);
+    pen.setWidth(1);
+
+    /* 1. Draw the integration area. */
+    pen.setColor(Qt::red);
+    painter.setPen(pen);
+    painter.setRenderHint(QPainter::Antialiasing, true);
+    if (intArea.height() > 0)
+    {
+        painter.save();
+        painter.setTransform(alphaTransform(intArea), true);
+        painter.drawRect(scaleFactor*intArea.x(), scaleFactor*intArea.y(), scaleFactor*intArea.width(), scaleFactor*intArea.height());
+        painter.restore();
+    }
+    painter.setRenderHint(QPainter::Antialiasing, false);
 
-        /* 2. Guessed center points. */
-        pen.setColor(Qt::white);
-        painter.setPen(pen);
-        painter.drawEllipse(scaleFactor*currentGeometry.zeroDegreeGuess.x()-6, scaleFactor*currentGeometry.zeroDegreeGuess.y()-6, 12, 12);
-        painter.drawEllipse(scaleFactor*currentGeometry.oneEightyDegreeGuess.x()-6, scaleFactor*currentGeometry.oneEightyDegreeGuess.y()-6, 12, 12);
+    for (int i = 0; i < excludeRegions.size(); i ++)
+    {
+        QBrush qb(Qt::white, Qt::DiagCrossPattern);
+        painter.fillRect(scaleFactor*excludeRegions[i].x(), scaleFactor*excludeRegions[i].y(), scaleFactor*excludeRegions[i].width(), scaleFactor*excludeRegions[i].height(), qb);
+    }
 
-        /* 3. Optimized center point. */
-        pen.setColor(Qt::blue);
-        painter.setPen(pen);
-        painter.drawEllipse(scaleFactor*currentGeometry.zeroDegreeCenter.x()-6, scaleFactor*currentGeometry.zeroDegreeCenter.y()-6, 12, 12);
-        if (currentGeometry.zeroDegreeCenter.x() != 0 && currentGeometry.zeroDegreeCenter.y() != 0)
-        {
-            painter.drawLine(scaleFactor*currentGeometry.zeroDegreeCenter.x(), 0, scaleFactor*currentGeometry.zeroDegreeCenter.x(), scaleFactor*filmData->height());
-            painter.drawLine(0, scaleFactor*currentGeometry.zeroDegreeCenter.y(), scaleFactor*filmData->width(), scaleFactor*currentGeometry.zeroDegreeCenter.y());
-        }
+    /* 2. Guessed center points. */
+    pen.setColor(Qt::white);
+    painter.setPen(pen);
+    painter.drawEllipse(scaleFactor*currentGeometry.zeroDegreeGuess.x()-6, scaleFactor*currentGeometry.zeroDegreeGuess.y()-6, 12, 12);
+    painter.drawEllipse(scaleFactor*currentGeometry.oneEightyDegreeGuess.x()-6, scaleFactor*currentGeometry.oneEightyDegreeGuess.y()-6, 12, 12);
+
+    /* 3. Optimized center point. */
+    pen.setColor(Qt::blue);
+    painter.setPen(pen);
+    painter.drawEllipse(scaleFactor*currentGeometry.zeroDegreeCenter.x()-6, scaleFactor*currentGeometry.zeroDegreeCenter.y()-6, 12, 12);
+    if (currentGeometry.zeroDegreeCenter.x() != 0 && currentGeometry.zeroDegreeCenter.y() != 0)
+    {
+        painter.drawLine(scaleFactor*currentGeometry.zeroDegreeCenter.x(), 0, scaleFactor*currentGeometry.zeroDegreeCenter.x(), scaleFactor*view.height());
+        painter.drawLine(0, scaleFactor*currentGeometry.zeroDegreeCenter.y(), scaleFactor*view.width(), scaleFactor*currentGeometry.zeroDegreeCenter.y());
+    }
 
-        /* 4. Optimized center point. */
-        pen.setColor(Qt::blue);
-        painter.setPen(pen);
-        painter.drawEllipse(scaleFactor*currentGeometry.oneEightyDegreeCenter.x()-6, scaleFactor*currentGeometry.oneEightyDegreeCenter.y()-6, 12, 12);
-        if (currentGeometry.oneEightyDegreeCenter.x() != 0 && currentGeometry.oneEightyDegreeCenter.y() != 0)
-        {
-            painter.drawLine(scaleFactor*currentGeometry.oneEightyDegreeCenter.x(), 0, scaleFactor*currentGeometry.oneEightyDegreeCenter.x(), scaleFactor*filmData->height());
-            painter.drawLine(0, scaleFactor*currentGeometry.oneEightyDegreeCenter.y(), scaleFactor*filmData->width(), scaleFactor*currentGeometry.oneEightyDegreeCenter.y());
-        }
+    /* 4. Optimized center point. */
+    pen.setColor(Qt::blue);
+    painter.setPen(pen);
+    painter.drawEllipse(scaleFactor*currentGeometry.oneEightyDegreeCenter.x()-6, scaleFactor*currentGeometry.oneEightyDegreeCenter.y()-6, 12, 12);
+    if (currentGeometry.oneEightyDegreeCenter.x() != 0 && currentGeometry.oneEightyDegreeCenter.y() != 0)
+    {
+        painter.drawLine(scaleFactor*currentGeometry.oneEightyDegreeCenter.x(), 0, scaleFactor*currentGeometry.oneEightyDegreeCenter.x(), scaleFactor*view.height());
+        painter.drawLine(0, scaleFactor*currentGeometry.oneEightyDegreeCenter.y(), scaleFactor*view.width(), scaleFactor*currentGeometry.oneEightyDegreeCenter.y());
+    }
 
-        /* 5. Optimization regions. */
+    /* 5. Optimization regions. */
+    pen.setColor(Qt::green);
+    painter.setPen(pen);
+
+    if (appConfig->getOptIndex() == SymmetryOpt)
+    {
+        painter.drawRect(scaleFactor*optRegion0A.x(), scaleFactor*optRegion0A.y(), scaleFactor*optRegion0A.width(), scaleFactor*optRegion0A.height());
+        painter.drawRect(scaleFactor*optRegion0B.x(), scaleFactor*optRegion0B.y(), scaleFactor*optRegion0B.width(), scaleFactor*optRegion0B.height());
+        painter.drawRect(scaleFactor*optRegion180A.x(), scaleFactor*optRegion180A.y(), scaleFactor*optRegion180A.width(), scaleFactor*optRegion180A.height());
+        painter.drawRect(scaleFactor*optRegion180B.x(), scaleFactor*optRegion180B.y(), scaleFactor*optRegion180B.width(), scaleFactor*optRegion180B.height());
+    } else
+    {
         pen.setColor(Qt::green);
         painter.setPen(pen);
+        painter.setRenderHint(QPainter::Antialiasing, true);
 
-        if (appConfig->getOptIndex() == SymmetryOpt)
-        {
-            painter.drawRect(scaleFactor*optRegion0A.x(), scaleFactor*optRegion0A.y(), scaleFactor*optRegion0A.width(), scaleFactor*optRegion0A.height());
-            painter.drawRect(scaleFactor*optRegion0B.x(), scaleFactor*optRegion0B.y(), scaleFactor*optRegion0B.width(), scaleFactor*optRegion0B.height());
-            painter.drawRect(scaleFactor*optRegion180A.x(), scaleFactor*optRegion180A.y(), scaleFactor*optRegion180A.width(), scaleFactor*optRegion180A.height());
-            painter.drawRect(scaleFactor*optRegion180B.x(), scaleFactor*optRegion180B.y(), scaleFactor*optRegion180B.width(), scaleFactor*optRegion180B.height());
-        } else
-        {
-            pen.setColor(Qt::green);
-            painter.setPen(pen);
-            painter.setRenderHint(QPainter::Antialiasing, true);
+        painter.save();
+        painter.setTransform(alphaTransform(optRegionSh), true);
+        painter.drawRect(scaleFactor*optRegionSh.x(), scaleFactor*optRegionSh.y(), scaleFactor*optRegionSh.width(), scaleFactor*optRegionSh.height());
+        painter.restore();
+    }
 
-            QTransform transformer;
-            QPointF pi = QPointF(optRegionSh.center().x(), optRegionSh.y());
 
-            transformer.rotate(currentGeometry.alpha);
-            QPointF pf = transformer.map(pi);
-            transformer.translate( -(pf.x() - pi.x()), -(pf.y() - pi.y()));
+    /* 6. Crop points. */
+    pen.setColor(Qt::yellow);
+    painter.setPen(pen);
+    if (cropPoint1.x() != 0 && cropPoint1.y() != 0) {
+        //painter.drawEllipse(scaleFactor*cropPoint1.x()-6, scaleFactor*cropPoint1.y()-6, 12, 12);
+        painter.drawLine(cropPoint1, QPoint(this->width(), cropPoint1.y()));
+        painter.drawLine(cropPoint1, QPoint(cropPoint1.x(), this->height()));
+    }
 
-            painter.setTransform(transformer);
-            painter.drawRect(scaleFactor*optRegionSh.x(), scaleFactor*optRegionSh.y(), scaleFactor*optRegionSh.width(), scaleFactor*optRegionSh.height());
-            painter.resetTransform();
-        }
+    if (cropPoint2.x() != 0 && cropPoint2.y() != 0) {
+        //painter.drawEllipse(scaleFactor*cropPoint2.x()-6, scaleFactor*cropPoint2.y()-6, 12, 12);
+        painter.drawLine(cropPoint2, QPoint(0, cropPoint2.y()));
+        painter.drawLine(cropPoint2, QPoint(cropPoint2.x(), 0));
+    }
 
+    /* Deskewing points. */
+    if (deskewPoint1.x() != 0 && deskewPoint1.y() != 0 && (deskewPoint2.x()==0 && deskewPoint2.y()==0))
+        painter.drawEllipse(scaleFactor*deskewPoint1.x()-6, scaleFactor*deskewPoint1.y()-6, 12, 12);
 
-        /* 6. Crop points. */
-        pen.setColor(Qt::yellow);
-        painter.setPen(pen);
-        if (cropPoint1.x() != 0 && cropPoint1.y() != 0) {
-            //painter.drawEllipse(scaleFactor*cropPoint1.x()-6, scaleFactor*cropPoint1.y()-6, 12, 12);
-            painter.drawLine(cropPoint1, QPoint(this->width(), cropPoint1.y()));
-            painter.drawLine(cropPoint1, QPoint(cropPoint1.x(), this->height()));
-        }
+    if (deskewPoint2.x() != 0 && deskewPoint2.y() != 0) {
+        painter.drawEllipse(scaleFactor*deskewPoint2.x()-6, scaleFactor*deskewPoint2.y()-6, 12, 12);
+        painter.drawLine(deskewPoint1, deskewPoint2);
+    }
+}
 
-        if (cropPoint2.x() != 0 && cropPoint2.y() != 0) {
-            //painter.drawEllipse(scaleFactor*cropPoint2.x()-6, scaleFactor*cropPoint2.y()-6, 12, 12);
-            painter.drawLine(cropPoint2, QPoint(0, cropPoint2.y()));
-            painter.drawLine(cropPoint2, QPoint(cropPoint2.x(), 0));
-        }
+/* Redraws area (in widget coordinates) of the overlay layer */
+void FilmWidget::renderOverlay(const QRect &area)
+{
+    QPainter layer(&overlay);
+    layer.translate(-overlayRect.topLeft());
+    layer.setClipRect(area);
+    layer.setCompositionMode(QPainter::CompositionMode_Source);
+    layer.fillRect(area, Qt::transparent);
+    layer.setCompositionMode(QPainter::CompositionMode_SourceOver);
+    drawOverlay(layer);
+    layer.end();
+}
 
-        /* Deskewing points. */
-        if (deskewPoint1.x() != 0 && deskewPoint1.y() != 0 && (deskewPoint2.x()==0 && deskewPoint2.y()==0))
-            painter.drawEllipse(scaleFactor*deskewPoint1.x()-6, scaleFactor*deskewPoint1.y()-6, 12, 12);
+/* Everything the overlay layer shows, to tell when it must be redrawn */
+OverlayState FilmWidget::overlayState()
+{
+    OverlayState s;
+    s.scaleFactor = scaleFactor;
+    s.view = getViewSize();
+    s.widgetSize = this->size();
+    s.optIndex = appConfig->getOptIndex();
+    s.alpha = currentGeometry.alpha;
+    s.intArea = intArea;
+    s.excludeRegions = excludeRegions;
+    s.points << currentGeometry.zeroDegreeGuess << currentGeometry.oneEightyDegreeGuess
+             << currentGeometry.zeroDegreeCenter << currentGeometry.oneEightyDegreeCenter
+             << cropPoint1 << cropPoint2 << deskewPoint1 << deskewPoint2;
+    s.regions << optRegion0A << optRegion0B << optRegion180A << optRegion180B << optRegionSh;
+
+    return s;
+}
 
-        if (deskewPoint2.x() != 0 && deskewPoint2.y() != 0) {
-            painter.drawEllipse(scaleFactor*deskewPoint2.x()-6, scaleFactor*deskewPoint2.y()-6, 12, 12);
-            painter.drawLine(deskewPoint1, deskewPoint2);
-        }
+/* ***************************************************************************
+ * method: alphaTransform
+ * description: rotation by the tilt angle alpha about the top center of
+ *   rectangle r, as the integration and sharpness regions are drawn.
+ * ***************************************************************************/
+QTransform FilmWidget::alphaTransform(const QRect &r)
+{
+    QTransform transformer;
+    QPointF pi = QPointF(r.center().x(), r.y());
 
-        painter.end();
-    }
+    transformer.rotate(currentGeometry.alpha);
+    QPointF pf = transformer.map(pi);
+    transformer.translate( -(pf.x() - pi.x()), -(pf.y() - pi.y()));
+
+    return transformer;
+}
+
+/* ***************************************************************************
+ * method: editedArea
+ * description: widget rectangle covering the regions that are moved, resized
+ *   or drawn by dragging, with room for the pen.  A drag repaints the union
+ *   of this before and after the change.
+ * ***************************************************************************/
+QRect FilmWidget::editedArea()
+{
+    QRect r = optRegionA->normalized().united(optRegionB->normalized());
+    if (!excludeRegions.isEmpty())
+        r = r.united(excludeRegions.last().normalized());
+
+    QRect scaled(scaleFactor*r.x(), scaleFactor*r.y(), scaleFactor*r.width(), scaleFactor*r.height());
+    QRect sh(scaleFactor*optRegionSh.x(), scaleFactor*optRegionSh.y(), scaleFactor*optRegionSh.width(), scaleFactor*optRegionSh.height());
+    scaled = scaled.united(alphaTransform(optRegionSh).mapRect(sh.normalized()));
+
+    return scaled.adjusted(-8, -8, 8, 8);
 }
@@ -62,6 +62,15 @@
 #include "LogWidget.h"
 #include "AppConfig.h"
 #include "TwoThetaWindow.h"
+#include "TwoThetaHistogram.h"
+#include "FilmImage.h"
+#include "FilmSampler.h"
+#include "DisplayLevels.h"
+#include "FilmPyramid.h"
+#include "IntegrationKernel.h"
+#include "GeometryOptimizer.h"
+#include "CenterFinder.h"
+#include "Instrumentation.h"
 
 using namespace std;
 
@@ -69,8 +78,16 @@ using namespace std;
 #define pow2(x) pow(x,2.0)
 #define UPPER_REGION 0
 #define LOWER_REGION 1
-#define ZERO_DEGREES 0
-#define ONEEIGHTY_DEGREES 1
+
+/* Film edits that can be undone */
+#define FILM_UNDO_DEPTH 32
+
+/* Half width of the center searches after a calibration is applied [pixels] */
+#define CALIBRATION_CENTER_RANGE 3
+
+/* Centers found on a newly opened film within this distance of the last
+ * film's optimized ones keep its geometry [pixels] */
+#define FOUND_CENTER_KEEP_DISTANCE 5
 
 /* !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
  * Structures
@@ -88,12 +105,70 @@ struct Geometry
 
     double sharpness;
     bool integrated;
+    /* Optimized since the centers were last placed by hand */
+    bool converged;
     QPoint *activeCenter;    
 
+    /* Rotations and deskews of the film (film pixels to view coordinates) */
+    QMatrix transform;
+    /* Crop of the transformed film shown as the view, null for all of it */
+    QRect roi;
+
     Geometry() : zeroDegreeCenter(QPoint(0,0)), zeroDegreeGuess(QPoint(0,0)),
                  oneEightyDegreeCenter(QPoint(0,0)), oneEightyDegreeGuess(QPoint(0,0)),                 
                  phi(0.0), alpha(0.0), radius(0.0), sharpness(0.0), integrated(false),
-                 activeCenter(&zeroDegreeCenter) {}
+                 converged(false), activeCenter(&zeroDegreeCenter) {}
+};
+
+/* A film edit as kept for undo/redo: the pixels (tiles are shared with the
+ * current film until an edit writes to them), their resolution, and the
+ * view geometry with everything placed in it */
+struct FilmState
+{
+    QString name;
+    FilmImage film;
+    double dpm;
+    QMatrix transform;
+    QRect roi;
+    QPoint zeroDegreeCenter;
+    QPoint oneEightyDegreeCenter;
+    double radius;
+    double phi;
+    double alpha;
+    bool converged;
+    QPoint guessCenter0;
+    QPoint guessCenter180;
+    QVector<QRect> regions;     /* 0 A, 0 B, 180 A, 180 B, shift */
+    QVector<QRect> excludeRegions;
+};
+
+/* What the overlay layer of the film widget was drawn from */
+struct OverlayState
+{
+    double scaleFactor;
+    QSize view;
+    QSize widgetSize;
+    int optIndex;
+    double alpha;
+    QRect intArea;
+    QVector<QRect> excludeRegions;
+    QVector<QPoint> points;
+    QVector<QRect> regions;
+
+    OverlayState() : scaleFactor(0.0), optIndex(-1), alpha(0.0) {}
+
+    /* Same zoom, size and drawing style: only positions can differ */
+    bool sameFrame(const OverlayState &o) const
+    {
+        return scaleFactor == o.scaleFactor && view == o.view && widgetSize == o.widgetSize &&
+               optIndex == o.optIndex && alpha == o.alpha;
+    }
+
+    bool operator==(const OverlayState &o) const
+    {
+        return sameFrame(o) && intArea == o.intArea && excludeRegions == o.excludeRegions &&
+               points == o.points && regions == o.regions;
+    }
 };
 
 /* !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
@@ -113,16 +188,18 @@ public:
 	
     /* Film access methods */
     void setFilm(QString);
-    QImage getFilm() { return *filmData; }
+    QImage getFilm() { return filmData->toImage(); }
     double getScaleFactor() { return scaleFactor; }
     void setScaleFactor(double sf) { scaleFactor = sf; }
     int getDPM() { return filmDPM; }
     int getDPI() { return filmDPM*0.0254; }
+    QSize getViewSize() { FilmSampler s = filmSampler(); return QSize(s.width(), s.height()); }
+    QSize sizeHint() const;
     double getRadius() { return currentGeometry.radius; }
 
     void setRadius(double _R) { currentGeometry.radius = _R; }
-    void setDPM(int dpm) { filmDPM = dpm; }
-    void setData(QImage d) { filmData = new QImage(d); }
+    void changeDPM(double dpm);
+    bool hasFilm() { return filmData != NULL; }
 
     QMainWindow *getTwoThetaPlot() { return twoThetaWindow; }
     void updateIntArea();
@@ -136,20 +213,10 @@ public:
 
     /* Film analysis methods */
     double integrate(double resolution = 0.025, int xo = 0, int yo = 0);
-    double integrateRegion(double res, int xo, int yo, QRect reg);
     double integrateRegionDifference(double res, int xo, int yo, QRect regA, QRect regB);
-
-    QPoint optimizeCenterXSharpness(int location = ZERO_DEGREES);
-    QPoint optimizeCenterXSymmetry(int location = ZERO_DEGREES);
-    QPoint optimizeCenterYSharpness(int location = ZERO_DEGREES);
-    QPoint optimizeCenterYSymmetry(int location = ZERO_DEGREES);
-    double optimizeRadiusSharpness();
-    double optimizePhiSharpness();
-    double optimizeAlphaSharpness();
-    double optimizeRadiusSymmetry();
-    double optimizeRotationSymmetry();
-    double residual(int cgx, int cgy, QImage *data);
-    double regionIntensity(QRect r, QImage *d);
+    void optimizeStep(int step, const OptimizerStrategy &strategy);
+    bool applyCalibration(const CalibrationProfile &cp);
+    double regionIntensity(QRect r, FilmImage *d);
     /* UI methods */
     void showTwoThetaWindow() { twoThetaWindow->show(); }
     void setAltDown(bool ad) { altDown = ad; }
@@ -158,11 +225,19 @@ public:
     void setResizeActive(bool ra) { resizeActive = ra; }
     void setExcludeActive(bool ea) { excludeActive = ea; }
 
-    void setImage(QImage newImage);
+    void setDisplayLevels(double brightness, double gamma);
+    const DisplayLevels &getDisplayLevels() { return displayLevels; }
     QPoint rotatePoint(QPoint in, double a);
 
+    /* Edit history */
+    bool canUndo() { return !undoStack.isEmpty(); }
+    bool canRedo() { return !redoStack.isEmpty(); }
+    QString undoName() { return canUndo() ? undoStack.last().name : QString(); }
+    QString redoName() { return canRedo() ? redoStack.last().name : QString(); }
+
 public slots:
         void startCrop();
+        void resetCrop();
         void startDeskew();
         void invert();
 	void darken();
@@ -170,6 +245,8 @@ public slots:
         void rotate();
         void rotate(double a);
         void closeFilm();
+        void undo();
+        void redo();
 	
 	/* IO methods */
         void saveTIFF();
@@ -180,9 +257,12 @@ public slots:
 
         void moveOptimizationRegion(QAction*);
         void saveOptimizationRegion();
+        void saveCalibration();
+        bool findCenters(bool keepConverged = false);
 	
 signals:
         void geometryUpdated();
+        void historyChanged();
 
 /* Protected members */	
 protected:
@@ -198,7 +278,36 @@ protected:
 private:
         AppConfig *appConfig;
 	/* Film variables */
-	QImage *filmData;
+	FilmImage *filmData;
+	DisplayLevels displayLevels;
+	FilmPyramid pyramid;
+	void updatePixmap() { pyramid.build(filmData); }
+	FilmSampler filmSampler() { return FilmSampler(filmData, currentGeometry.transform, currentGeometry.roi); }
+	void applyRotation(double a);
+	OptimizerRanges optimizerRanges();
+	GeometryOptimizer optimizer() { return optimizer(optimizerRanges()); }
+	GeometryOptimizer optimizer(const OptimizerRanges &r);
+	void applyOptimizer(const GeometryOptimizer &o);
+	void placeOptimizationRegions();
+
+	/* Overlay layer (lines and boxes over the film) for the visible area */
+	QPixmap overlay;
+	QRect overlayRect;
+	QRect overlayDirty;
+	OverlayState overlayShows;
+	OverlayState overlayState();
+	void drawOverlay(QPainter &painter);
+	void renderOverlay(const QRect &area);
+	QTransform alphaTransform(const QRect &r);
+	QRect editedArea();
+
+	/* Edit history */
+	QList<FilmState> undoStack;
+	QList<FilmState> redoStack;
+	FilmState captureState(const QString &name);
+	void restoreState(const FilmState &s);
+	void pushUndo(const QString &name);
+	void clearHistory();
 	double filmDPM;
         double lambda;
 
@@ -229,6 +338,7 @@ private:
 	QRect intArea;
 	double **intData;
 	double intResolution;
+	TwoThetaHistogram histogram;
 
 	/* Points and areas */
         QPoint guessCenter0;
@@ -0,0 +1,918 @@
+/* ***************************************************************************
+ * GeometryOptimizer.cpp: implements the camera geometry optimizations
+ * ***************************************************************************/
+
+/* !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+ * Headers, definitions, etc.
+ * !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!*/
+
+#include "GeometryOptimizer.h"
+#include "IntegrationKernel.h"
+#include "Instrumentation.h"
+#include "Log.h"
+
+#include <QMap>
+
+#include <cmath>
+#include <cstdlib>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+using namespace std;
+
+/* !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+ * Methods
+ * !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!*/
+
+QList<int> OptimizerStrategy::stepList() const
+{
+    static const int order[] = { OptimizeZeroCenter, OptimizeOneEightyCenter, OptimizeAlpha,
+                                 OptimizeRadius, OptimizePhi };
+
+    QList<int> list;
+    for (unsigned int i = 0; i < sizeof(order)/sizeof(order[0]); i++)
+        if (steps & order[i])
+            list.append(order[i]);
+
+    return list;
+}
+
+GeometryOptimizer::GeometryOptimizer(const FilmSampler &film, double dpm, const OptimizerRanges &ranges)
+    : exclude(0), film(film), dpm(dpm), ranges(ranges)
+{
+}
+
+QPoint &GeometryOptimizer::center(int location)
+{
+    return (location == ZERO_DEGREES) ? geometry.zeroDegreeCenter : geometry.oneEightyDegreeCenter;
+}
+
+/* The regions of a center move with it */
+void GeometryOptimizer::moveCenter(int location, const QPoint &c)
+{
+    QPoint shift = c - center(location);
+    center(location) = c;
+
+    if (location == ZERO_DEGREES)
+    {
+        regions.zeroA.translate(shift);
+        regions.zeroB.translate(shift);
+        regions.sharpness.translate(shift);
+    } else
+    {
+        regions.oneEightyA.translate(shift);
+        regions.oneEightyB.translate(shift);
+    }
+}
+
+void GeometryOptimizer::updateIntArea()
+{
+    if (geometry.zeroDegreeCenter == QPoint(0,0) || geometry.oneEightyDegreeCenter == QPoint(0,0))
+        return;
+
+    intArea.setX(geometry.zeroDegreeCenter.x() - (0.0254*dpm)/2.0);
+    intArea.setY(geometry.zeroDegreeCenter.y());
+    intArea.setWidth(0.0254*dpm);
+    intArea.setHeight(M_PI*geometry.radius*dpm);
+
+    if (regions.sharpness.width() == 0) regions.sharpness = intArea;
+}
+
+/* One inch square regions (odd sizes), 1.5 inch above and below each center */
+void GeometryOptimizer::placeRegions()
+{
+    int offset = 1.5*0.0254*dpm;
+    if (offset % 2 != 0) offset = offset + 1;
+
+    int size = 0.0254*dpm;
+    if (size % 2 == 0) size = size + 1;
+
+    QRect r(0, 0, size, size);
+    regions.zeroA = r;
+    regions.zeroA.moveCenter(QPoint(geometry.zeroDegreeCenter.x(), geometry.zeroDegreeCenter.y() - offset));
+    regions.zeroB = r;
+    regions.zeroB.moveCenter(QPoint(geometry.zeroDegreeCenter.x(), geometry.zeroDegreeCenter.y() + offset));
+    regions.oneEightyA = r;
+    regions.oneEightyA.moveCenter(QPoint(geometry.oneEightyDegreeCenter.x(), geometry.oneEightyDegreeCenter.y() - offset));
+    regions.oneEightyB = r;
+    regions.oneEightyB.moveCenter(QPoint(geometry.oneEightyDegreeCenter.x(), geometry.oneEightyDegreeCenter.y() + offset));
+
+    regions.sharpness = QRect();
+    updateIntArea();
+}
+
+/* ***************************************************************************
+ * method: integrateRegion
+ * description: sharpness (relative spread of the square root intensities)
+ *   of reg integrated into res wide bins, with the integration area moved by
+ *   (xo, yo).  Empty bins take the previous bin's intensity.
+ * ***************************************************************************/
+double GeometryOptimizer::integrateRegion(double res, int xo, int yo, const QRect &reg)
+{
+    ScopedTimer timer("optimize.integrateRegion");
+    counts.integrateRegion++;
+
+    int n = int(180.0/res);
+    QVector<double> bins(3*n, 0.0);
+    QVector<double*> rows(n);
+    for (int i = 0; i < n; i++)
+    {
+        rows[i] = bins.data() + 3*i;
+        rows[i][0] = i*res;
+    }
+
+    KernelParams p;
+    p.loop = reg;
+    p.cOffset = reg.x() + reg.width()/2.0 - xo;
+    p.LOffset = intArea.y() - yo;
+    p.foldL = intArea.height()/(2.0*dpm);
+    p.dpm = dpm;
+    p.R = geometry.radius;
+    p.setAngles(geometry.phi, geometry.alpha, film.height());
+    p.exclude = exclude;
+
+    BinSink sink;
+    sink.data = rows.data();
+    sink.res = res;
+    sink.n = n;
+    runIntegrationKernel(film, p, selectKernel(geometry.phi, geometry.alpha, !film.isIdentity()), sink);
+
+    double Sum_WiIi = 0.0;
+    double Sum_Wi = 0.0;
+    double Sum_WiIisqrt = 0.0;
+
+    for (int i = 0; i < n; i++) {
+        Sum_WiIi += rows[i][1];
+
+        if ( rows[i][2] != 0 )
+            rows[i][1] = rows[i][1]/rows[i][2];
+        else if ( i > 0 )
+            rows[i][1] = rows[i-1][1];
+
+        Sum_WiIisqrt += rows[i][2]*sqrt(rows[i][1]);
+        Sum_WiIi += rows[i][2]*rows[i][1];
+        Sum_Wi += rows[i][2];
+    }
+
+    if (Sum_Wi == 0.0) return 0.0;
+
+    double I = Sum_WiIi/Sum_Wi;
+    double Isqrt = Sum_WiIisqrt/Sum_Wi;
+    if (Isqrt == 0.0) return 0.0;
+
+    return sqrt( I - pow(Isqrt,2.0) )/ Isqrt;
+}
+
+/* Symmetry residual of the pair of location moved by (xo, yo) */
+double GeometryOptimizer::residual(int xo, int yo, int location)
+{
+    ScopedTimer timer("optimize.residual");
+    counts.residual++;
+
+    QRect a = (location == ZERO_DEGREES) ? regions.zeroA : regions.oneEightyA;
+    QRect b = (location == ZERO_DEGREES) ? regions.zeroB : regions.oneEightyB;
+    a.translate(xo, yo);
+    b.translate(xo, yo);
+
+    return symmetryResidual(film, a, b);
+}
+
+/* ***************************************************************************
+ * method: optimizeCenterXSharpness
+ * description: golden section search over x offsets of the sharpness region
+ *   for the sharpest integration.  The center moves against the offset.
+ * ***************************************************************************/
+QPoint GeometryOptimizer::optimizeCenterXSharpness(int location)
+{
+    QRect reg = regions.sharpness;
+
+    int iter = 0;
+    int delta = 1;
+    int y = 0;
+
+    double gamma = (sqrt(5.0) - 1.0)/2.0;
+
+    int x1 = -ranges.xSharpness;
+    int x2 =  ranges.xSharpness;
+    int x3 = int(floor(x2 - gamma*(x2-x1)));
+    int x4 = int(floor(x1 + gamma*(x2-x1)));
+
+    double r3 = -integrateRegion(0.025,x3,y,reg);
+    double r4 = -integrateRegion(0.025,x4,y,reg);
+
+    do
+    {
+        if (r3 <= r4)
+        {
+            x2 = x4;
+            x4 = x3;
+            r4 = r3;
+
+            x3 = int(floor(x2 - gamma*(x2-x1) + 0.5));
+            r3 = -integrateRegion(0.025,x3,y,reg);
+        } else
+        {
+            x1 = x3;
+            x3 = x4;
+            r3 = r4;
+
+            x4 = int(floor(x1 + gamma*(x2-x1) + 0.5));
+            r4 = -integrateRegion(0.025,x4,y,reg);
+        }
+
+        TRACE(TraceOptimizer, QString("Iter[%1] x1 = %2, x2 = %3, x3 = %4, x4 = %5").arg(iter).arg(x1).arg(x2).arg(x3).arg(x4));
+        iter++;
+        delta = abs(x2-x1);
+
+    } while (iter < 500 && delta > 1 );
+
+    int optx = ( (-integrateRegion(0.025,x1,y,reg)) <= (-integrateRegion(0.025,x2,y,reg)) ) ? x1 : x2;
+
+    moveCenter(location, center(location) - QPoint(optx, 0));
+    updateIntArea();
+
+    return center(location);
+}
+
+QPoint GeometryOptimizer::optimizeCenterYSharpness(int location)
+{
+    QRect regA = regions.sharpness;
+
+    int iter = 0;
+    int delta = 1;
+    int x = 0;
+
+    double gamma = (sqrt(5.0) - 1.0)/2.0;
+
+    int y1 = -ranges.ySharpness;
+    int y2 =  ranges.ySharpness;
+    int y3 = int(floor(y2 - gamma*(y2-y1) + 0.5));
+    int y4 = int(floor(y1 + gamma*(y2-y1) + 0.5));
+
+    double r3 = -integrateRegion(0.05, x, y3, regA);
+    double r4 = -integrateRegion(0.05, x, y4, regA);
+
+    do
+    {
+        if (r3 <= r4)
+        {
+            y2 = y4;
+            y4 = y3;
+            r4 = r3;
+
+            y3 = int(floor(y2 - gamma*(y2-y1) + 0.5));
+            r3 = -integrateRegion(0.05, x, y3, regA);
+        } else
+        {
+            y1 = y3;
+            y3 = y4;
+            r3 = r4;
+
+            y4 = int(floor(y1 + gamma*(y2-y1) + 0.5));
+            r4 = -integrateRegion(0.05, x, y4, regA);
+        }
+
+        TRACE(TraceOptimizer, QString("Iter[%1] y1 = %2, y2 = %3, y3 = %4, y4 = %5").arg(iter).arg(y1).arg(y2).arg(y3).arg(y4));
+        iter++;
+        delta = abs(y2-y1);
+    } while (iter < 500 && delta > 1 );
+
+    int opty = ( (-integrateRegion(0.05,x,y1,regA)) <= (-integrateRegion(0.05,x,y2,regA)) ) ? y1 : y2;
+
+    moveCenter(location, center(location) - QPoint(0, opty));
+    updateIntArea();
+
+    return center(location);
+}
+
+/* ***************************************************************************
+ * method: optimizeCenterXSymmetry
+ * description: golden section search over x offsets of the symmetry pair
+ *   for the smallest residual.  The center moves with the offset.
+ * ***************************************************************************/
+QPoint GeometryOptimizer::optimizeCenterXSymmetry(int location)
+{
+    int iter = 0;
+    int delta = 1;
+    int y = 0;
+
+    double gamma = (sqrt(5.0) - 1.0)/2.0;
+
+    int x1 = -ranges.xSymmetry;
+    int x2 =  ranges.xSymmetry;
+    int x3 = int(floor(x2 - gamma*(x2-x1) + 0.5));
+    int x4 = int(floor(x1 + gamma*(x2-x1) + 0.5));
+
+    double r3 = residual(x3, y, location);
+    double r4 = residual(x4, y, location);
+
+    do
+    {
+        if (r3 <= r4)
+        {
+            x2 = x4;
+            x4 = x3;
+            r4 = r3;
+
+            x3 = int(floor(x2 - gamma*(x2-x1) + 0.5));
+            r3 = residual(x3, y, location);
+        } else
+        {
+            x1 = x3;
+            x3 = x4;
+            r3 = r4;
+
+            x4 = int(floor(x1 + gamma*(x2-x1) + 0.5));
+            r4 = residual(x4, y, location);
+        }
+
+        TRACE(TraceOptimizer, QString("Iter[%1] x1 = %2, x2 = %3, x3 = %4, x4 = %5").arg(iter).arg(x1).arg(x2).arg(x3).arg(x4));
+        iter++;
+        delta = abs(x2-x1);
+    } while (iter < 500 && delta > 1 );
+
+    int optx = (residual(x1, y, location) <= residual(x2, y, location)) ? x1 : x2;
+
+    moveCenter(location, center(location) + QPoint(optx, 0));
+    updateIntArea();
+
+    return center(location);
+}
+
+QPoint GeometryOptimizer::optimizeCenterYSymmetry(int location)
+{
+    int iter = 0;
+    int delta = 1;
+    int x = 0;
+
+    double gamma = (sqrt(5.0) - 1.0)/2.0;
+
+    int y1 = -ranges.ySymmetry;
+    int y2 =  ranges.ySymmetry;
+    int y3 = y2 - gamma*(y2-y1);
+    int y4 = y1 + gamma*(y2-y1);
+
+    double r3 = residual(x, y3, location);
+    double r4 = residual(x, y4, location);
+
+    do
+    {
+        if (r3 <= r4)
+        {
+            y2 = y4;
+            y4 = y3;
+            r4 = r3;
+
+            y3 = int(floor(y2 - gamma*(y2-y1) + 0.5));
+            r3 = residual(x, y3, location);
+        } else
+        {
+            y1 = y3;
+            y3 = y4;
+            r3 = r4;
+
+            y4 = int(floor(y1 + gamma*(y2-y1) + 0.5));
+            r4 = residual(x, y4, location);
+        }
+
+        TRACE(TraceOptimizer, QString("Iter[%1] y1 = %2, y2 = %3, y3 = %4, y4 = %5").arg(iter).arg(y1).arg(y2).arg(y3).arg(y4));
+        iter++;
+        delta = abs(y2-y1);
+    } while (iter < 500 && delta > 1 );
+
+    int opty = (residual(x, y1, location) <= residual(x, y2, location)) ? y1 : y2;
+
+    moveCenter(location, center(location) + QPoint(0, opty));
+    updateIntArea();
+
+    return center(location);
+}
+
+/* ***************************************************************************
+ * method: optimizeAlphaSharpness
+ * description: golden section search for the alpha giving the sharpest
+ *   integration of the sharpness region.  Stops when the bracket or the
+ *   sharpness at its ends stops changing.
+ * ***************************************************************************/
+double GeometryOptimizer::optimizeAlphaSharpness()
+{
+    QRect reg = regions.sharpness;
+
+    int iter = 0;
+    double deltaa = 1e20;
+    double deltash = 1e20;
+    int y = 0;
+    int x = 0;
+
+    double gamma = (sqrt(5.0) - 1.0)/2.0;
+
+    double a1 = -ranges.alpha;
+    double a2 =  ranges.alpha;
+    double a3 = a2 - gamma*(a2-a1);
+    double a4 = a1 + gamma*(a2-a1);
+
+    /* The ends are not evaluated; deltash only counts once both have moved */
+    double r1 = 1e20;
+    double r2 = -1e20;
+    geometry.alpha = a3;
+    double r3 = -integrateRegion(0.025,x,y,reg);
+    geometry.alpha = a4;
+    double r4 = -integrateRegion(0.025,x,y,reg);
+
+    do
+    {
+        if (r3 <= r4)
+        {
+            a2 = a4;
+            r2 = r4;
+            a4 = a3;
+            r4 = r3;
+
+            a3 = a2 - gamma*(a2-a1);
+            geometry.alpha = a3;
+            r3 = -integrateRegion(0.025,x,y,reg);
+        } else
+        {
+            a1 = a3;
+            r1 = r3;
+            a3 = a4;
+            r3 = r4;
+
+            a4 = a1 + gamma*(a2-a1);
+            geometry.alpha = a4;
+            r4 = -integrateRegion(0.025,x,y,reg);
+        }
+
+        TRACE(TraceOptimizer, QString("Iter[%1] a1 = %2, a2 = %3, a3 = %4, a4 = %5").arg(iter).arg(a1).arg(a2).arg(a3).arg(a4));
+        iter++;
+        deltaa = fabs(a2-a1);
+        deltash = fabs(r2-r1);
+    } while (iter < 500 && deltaa > 0.0001 && deltash > 0.00001 );
+
+    geometry.alpha = (a1 + a2)/2.0;
+    return geometry.alpha;
+}
+
+double GeometryOptimizer::optimizePhiSharpness()
+{
+    QRect reg = regions.sharpness;
+
+    int iter = 0;
+    double deltap = 1e20;
+    double deltash = 1e20;
+    int y = 0;
+    int x = 0;
+
+    double gamma = (sqrt(5.0) - 1.0)/2.0;
+
+    double p1 = -ranges.phi;
+    double p2 =  ranges.phi;
+    double p3 = p2 - gamma*(p2-p1);
+    double p4 = p1 + gamma*(p2-p1);
+
+    double r1 = 1e20;
+    double r2 = -1e20;
+    geometry.phi = p3;
+    double r3 = -integrateRegion(0.025,x,y,reg);
+    geometry.phi = p4;
+    double r4 = -integrateRegion(0.025,x,y,reg);
+
+    do
+    {
+        if (r3 <= r4)
+        {
+            p2 = p4;
+            r2 = r4;
+            p4 = p3;
+            r4 = r3;
+
+            p3 = p2 - gamma*(p2-p1);
+            geometry.phi = p3;
+            r3 = -integrateRegion(0.025,x,y,reg);
+        } else
+        {
+            p1 = p3;
+            r1 = r3;
+            p3 = p4;
+            r3 = r4;
+
+            p4 = p1 + gamma*(p2-p1);
+            geometry.phi = p4;
+            r4 = -integrateRegion(0.025,x,y,reg);
+        }
+
+        TRACE(TraceOptimizer, QString("Iter[%1] p1 = %2, p2 = %3, p3 = %4, p4 = %5").arg(iter).arg(p1).arg(p2).arg(p3).arg(p4));
+        iter++;
+        deltap = fabs(p2-p1);
+        deltash = fabs(r2-r1);
+    } while (iter < 500 && deltap > 0.0001 && deltash > 0.00001 );
+
+    geometry.phi = (p1 + p2)/2.0;
+    return geometry.phi;
+}
+
+/* ***************************************************************************
+ * method: optimizeRadiusSharpness
+ * description: golden section search for the camera radius giving the
+ *   sharpest integration, to a micrometre, around the configured radius.
+ * ***************************************************************************/
+double GeometryOptimizer::optimizeRadiusSharpness()
+{
+    QRect reg = regions.sharpness;
+
+    int iter = 0;
+    double deltarad = 1e20;
+    int y = 0;
+    int x = 0;
+
+    double gamma = (sqrt(5.0) - 1.0)/2.0;
+
+    double rad1 = ranges.cameraRadius - ranges.radius;
+    double rad2 = ranges.cameraRadius + ranges.radius;
+    double rad3 = rad2 - gamma*(rad2-rad1);
+    double rad4 = rad1 + gamma*(rad2-rad1);
+
+    geometry.radius = rad1;
+    integrateRegion(0.025,x,y,reg);
+    geometry.radius = rad2;
+    integrateRegion(0.025,x,y,reg);
+    geometry.radius = rad3;
+    double r3 = -integrateRegion(0.025,x,y,reg);
+    geometry.radius = rad4;
+    double r4 = -integrateRegion(0.025,x,y,reg);
+
+    do
+    {
+        if (r3 <= r4)
+        {
+            rad2 = rad4;
+            rad4 = rad3;
+            r4 = r3;
+
+            rad3 = rad2 - gamma*(rad2-rad1);
+            geometry.radius = rad3;
+            r3 = -integrateRegion(0.025,x,y,reg);
+        } else
+        {
+            rad1 = rad3;
+            rad3 = rad4;
+            r3 = r4;
+
+            rad4 = rad1 + gamma*(rad2-rad1);
+            geometry.radius = rad4;
+            r4 = -integrateRegion(0.025,x,y,reg);
+        }
+
+        TRACE(TraceOptimizer, QString("Iter[%1] rad1 = %2, rad2 = %3, rad3 = %4, rad4 = %5").arg(iter).arg(rad1).arg(rad2).arg(rad3).arg(rad4));
+        iter++;
+        deltarad = fabs(rad2-rad1);
+    } while (iter < 500 && deltarad > 0.000001);
+
+    geometry.radius = (rad1 + rad2)/2.0;
+    updateIntArea();
+
+    return geometry.radius;
+}
+
+/* Alpha that puts the 180 degree center straight below the 0 degree one */
+double GeometryOptimizer::optimizeRotationSymmetry()
+{
+    int x1 = geometry.zeroDegreeCenter.x();
+    int x2 = geometry.oneEightyDegreeCenter.x();
+    int y1 = geometry.zeroDegreeCenter.y();
+    int y2 = geometry.oneEightyDegreeCenter.y();
+
+    geometry.alpha = -(180.0/M_PI)*atan( double(x2-x1)/double(y2-y1) );
+    updateIntArea();
+
+    return geometry.alpha;
+}
+
+/* Radius from the distance between the centers */
+double GeometryOptimizer::optimizeRadiusSymmetry()
+{
+    int y1 = geometry.zeroDegreeCenter.y();
+    int y2 = geometry.oneEightyDegreeCenter.y();
+
+    geometry.radius = (1.0/M_PI)*(y2-y1)/dpm;
+    updateIntArea();
+
+    return geometry.radius;
+}
+
+/* !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+ * Warm starts
+ * !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!*/
+
+#define WarmCenterX 0
+#define WarmCenterY 1
+#define WarmAlpha 2
+#define WarmPhi 3
+#define WarmRadius 4
+
+/* ***************************************************************************
+ * class: WarmObjective
+ * description: the objective of a warm search as a function of a whole
+ *   number of steps from the geometry it started at, to be minimized.  The
+ *   center objectives are those of the golden section searches (sharpness
+ *   moves the center against the offset, symmetry with it).  Values are
+ *   remembered, as the searches come back to the same steps.
+ * ***************************************************************************/
+struct WarmObjective
+{
+    GeometryOptimizer *o;
+    int parameter;
+    int location;
+    bool sharpness;
+    CameraGeometry start;
+    QMap<int, double> values;
+
+    WarmObjective(GeometryOptimizer *o, int parameter, int location = ZERO_DEGREES, bool sharpness = true)
+        : o(o), parameter(parameter), location(location), sharpness(sharpness), start(o->geometry) {}
+
+    double operator()(int k)
+    {
+        QMap<int, double>::const_iterator i = values.constFind(k);
+        if (i != values.constEnd()) return i.value();
+
+        double v = 0.0;
+        switch (parameter)
+        {
+        case WarmCenterX:
+            v = sharpness ? -o->integrateRegion(0.025, k, 0, o->regions.sharpness) : o->residual(k, 0, location);
+            break;
+        case WarmCenterY:
+            v = sharpness ? -o->integrateRegion(0.05, 0, k, o->regions.sharpness) : o->residual(0, k, location);
+            break;
+        case WarmAlpha:
+            o->geometry.alpha = start.alpha + k*WARM_ANGLE_STEP;
+            v = -o->integrateRegion(0.025, 0, 0, o->regions.sharpness);
+            break;
+        case WarmPhi:
+            o->geometry.phi = start.phi + k*WARM_ANGLE_STEP;
+            v = -o->integrateRegion(0.025, 0, 0, o->regions.sharpness);
+            break;
+        case WarmRadius:
+            o->geometry.radius = start.radius + k*WARM_RADIUS_STEP;
+            v = -o->integrateRegion(0.025, 0, 0, o->regions.sharpness);
+            break;
+        }
+        o->geometry = start;
+
+        values.insert(k, v);
+        return v;
+    }
+};
+
+/* ***************************************************************************
+ * function: warmSearch
+ * description: the step in [-range, range] minimizing f, searched from 0.
+ *   Steps downhill from 0, widening by the golden ratio while the objective
+ *   keeps falling by more than the fraction tolerance, then narrows the
+ *   bracket found by golden section until it is two steps wide or the
+ *   objective stops improving.  Geometry at the optimum takes three
+ *   evaluations.
+ * ***************************************************************************/
+static int warmSearch(WarmObjective &f, int range, double tolerance)
+{
+    if (range < 1) return 0;
+
+    double gamma = (sqrt(5.0) - 1.0)/2.0;
+    double f0 = f(0);
+    double tol = tolerance*fabs(f0);
+
+    int dir = 1;
+    if (!(f(1) < f0 - tol))
+    {
+        dir = -1;
+        if (!(f(-1) < f0 - tol)) return 0;
+    }
+
+    /* Bracket: a, b, c with f(b) below both ends */
+    int a = 0;
+    int b = dir;
+    int c = b;
+    int step = 1;
+
+    for (;;)
+    {
+        if (abs(b) >= range) return b;
+
+        step = qMax(step + 1, int(step/gamma + 0.5));
+        c = dir*qMin(range, abs(b) + step);
+
+        if (f(c) < f(b) - tol)
+        {
+            a = b;
+            b = c;
+        } else break;
+    }
+
+    int lo = qMin(a, c);
+    int hi = qMax(a, c);
+    int iter = 0;
+
+    while (hi - lo > 2 && iter < 500)
+    {
+        int x = (hi - b > b - lo) ? b + qMax(1, int((1.0 - gamma)*(hi - b) + 0.5))
+                                  : b - qMax(1, int((1.0 - gamma)*(b - lo) + 0.5));
+        double fx = f(x);
+        double fb = f(b);
+
+        if (fx < fb)
+        {
+            if (x > b) lo = b; else hi = b;
+            b = x;
+        } else
+        {
+            if (x > b) hi = x; else lo = x;
+        }
+
+        TRACE(TraceOptimizer, QString("Warm[%1] lo = %2, b = %3, hi = %4").arg(iter).arg(lo).arg(b).arg(hi));
+        iter++;
+        if (fabs(fx - fb) <= tol) break;
+    }
+
+    return b;
+}
+
+/* ***************************************************************************
+ * method: refineCenter
+ * description: warm searches of the center of location along x then y,
+ *   repeated until it stops moving if untilNoChange is set.
+ * ***************************************************************************/
+QPoint GeometryOptimizer::refineCenter(int location, bool sharpness, bool untilNoChange)
+{
+    int sign = sharpness ? -1 : 1;
+    int passes = 0;
+    bool moved;
+
+    do
+    {
+        WarmObjective fx(this, WarmCenterX, location, sharpness);
+        int kx = warmSearch(fx, sharpness ? ranges.xSharpness : ranges.xSymmetry, 0.0);
+        moveCenter(location, center(location) + QPoint(sign*kx, 0));
+        updateIntArea();
+
+        WarmObjective fy(this, WarmCenterY, location, sharpness);
+        int ky = warmSearch(fy, sharpness ? ranges.ySharpness : ranges.ySymmetry, 0.0);
+        moveCenter(location, center(location) + QPoint(0, sign*ky));
+        updateIntArea();
+
+        moved = (kx != 0 || ky != 0);
+        passes++;
+    } while (untilNoChange && moved && passes < OPTIMIZER_MAX_PASSES);
+
+    return center(location);
+}
+
+double GeometryOptimizer::refineAlphaSharpness()
+{
+    WarmObjective f(this, WarmAlpha);
+    geometry.alpha += warmSearch(f, int(ranges.alpha/WARM_ANGLE_STEP + 0.5), WARM_TOLERANCE)*WARM_ANGLE_STEP;
+    return geometry.alpha;
+}
+
+double GeometryOptimizer::refinePhiSharpness()
+{
+    WarmObjective f(this, WarmPhi);
+    geometry.phi += warmSearch(f, int(ranges.phi/WARM_ANGLE_STEP + 0.5), WARM_TOLERANCE)*WARM_ANGLE_STEP;
+    return geometry.phi;
+}
+
+double GeometryOptimizer::refineRadiusSharpness()
+{
+    WarmObjective f(this, WarmRadius);
+    geometry.radius += warmSearch(f, int(ranges.radius/WARM_RADIUS_STEP + 0.5), WARM_TOLERANCE)*WARM_RADIUS_STEP;
+    updateIntArea();
+    return geometry.radius;
+}
+
+/* !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+ * Strategies
+ * !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!*/
+
+/* ***************************************************************************
+ * method: optimizeCenter
+ * description: x then y of a center, repeated while the center still moves
+ *   if untilNoChange is set (at most OPTIMIZER_MAX_PASSES times, as the
+ *   integer searches can alternate between two points).
+ * ***************************************************************************/
+QPoint GeometryOptimizer::optimizeCenter(int location, bool sharpness, bool untilNoChange)
+{
+    QPoint lastPoint = center(location);
+    QPoint newPoint;
+    int passes = 0;
+
+    do
+    {
+        if (passes > 0) lastPoint = newPoint;
+
+        int newX = sharpness ? optimizeCenterXSharpness(location).x() : optimizeCenterXSymmetry(location).x();
+        int newY = sharpness ? optimizeCenterYSharpness(location).y() : optimizeCenterYSymmetry(location).y();
+        newPoint = QPoint(newX, newY);
+        passes++;
+    } while (untilNoChange && newPoint != lastPoint && passes < OPTIMIZER_MAX_PASSES);
+
+    return newPoint;
+}
+
+void GeometryOptimizer::runStep(int step, const OptimizerStrategy &strategy)
+{
+    if (strategy.warmStart)
+    {
+        switch (step)
+        {
+        case OptimizeZeroCenter:
+            refineCenter(ZERO_DEGREES, strategy.sharpness, strategy.untilNoChange);
+            return;
+        case OptimizeOneEightyCenter:
+            refineCenter(ONEEIGHTY_DEGREES, strategy.sharpness, strategy.untilNoChange);
+            return;
+        case OptimizeAlpha:
+            if (strategy.sharpness) { refineAlphaSharpness(); return; }
+            break;
+        case OptimizeRadius:
+            if (strategy.sharpness) { refineRadiusSharpness(); return; }
+            break;
+        case OptimizePhi:
+            refinePhiSharpness();
+            return;
+        }
+    }
+
+    switch (step)
+    {
+    case OptimizeZeroCenter:
+        optimizeCenter(ZERO_DEGREES, strategy.sharpness, strategy.untilNoChange);
+        break;
+    case OptimizeOneEightyCenter:
+        optimizeCenter(ONEEIGHTY_DEGREES, strategy.sharpness, strategy.untilNoChange);
+        break;
+    case OptimizeAlpha:
+        if (strategy.sharpness) optimizeAlphaSharpness();
+        else optimizeRotationSymmetry();
+        break;
+    case OptimizeRadius:
+        if (strategy.sharpness) optimizeRadiusSharpness();
+        else optimizeRadiusSymmetry();
+        break;
+    case OptimizePhi:
+        optimizePhiSharpness();
+        break;
+    }
+}
+
+void GeometryOptimizer::run(const OptimizerStrategy &strategy)
+{
+    QList<int> steps = strategy.stepList();
+    for (int i = 0; i < steps.size(); i++)
+        runStep(steps.at(i), strategy);
+}
+
+/* !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+ * Functions
+ * !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!*/
+
+QString optimizerStepName(int step)
+{
+    switch (step)
+    {
+    case OptimizeZeroCenter: return "Optimizing 0 degree center...";
+    case OptimizeOneEightyCenter: return "Optimizing 180 degree center...";
+    case OptimizeAlpha: return "Optimizing alpha rotation...";
+    case OptimizeRadius: return "Optimizing camera radius...";
+    case OptimizePhi: return "Optimizing phi rotation...";
+    }
+
+    return QString();
+}
+
+QList<OptimizerStrategy> optimizerStrategies()
+{
+    static const int centers = OptimizeZeroCenter | OptimizeOneEightyCenter;
+    static const int steps[] = { centers, centers | OptimizeRadius,
+                                 centers | OptimizeAlpha | OptimizeRadius,
+                                 centers | OptimizeAlpha | OptimizeRadius | OptimizePhi };
+    static const char *stepNames[] = { "centers", "centers+radius", "centers+alpha+radius", "all" };
+    static const char *modeNames[] = { "", "+repeat", "+warm" };
+
+    QList<OptimizerStrategy> list;
+    for (int m = 0; m < 2; m++)
+    {
+        for (int mode = 0; mode < 3; mode++)
+        {
+            for (unsigned int s = 0; s < sizeof(steps)/sizeof(steps[0]); s++)
+            {
+                QString name = QString("%1%2/%3").arg(m == 0 ? "sharpness" : "symmetry")
+                                                 .arg(modeNames[mode])
+                                                 .arg(stepNames[s]);
+                list.append(OptimizerStrategy(name, m == 0, mode == 1, steps[s], mode == 2));
+            }
+        }
+    }
+
+    return list;
+}
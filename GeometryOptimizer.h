@@ -0,0 +1,191 @@
+/* ***************************************************************************
+ * GeometryOptimizer.h: defines the golden section searches for the camera
+ *   geometry (centers, radius, phi, alpha) and the strategies combining them,
+ *   independent of the widgets so they can also be run in batch
+ * ***************************************************************************/
+#ifndef GeometryOptimizer_H
+#define GeometryOptimizer_H
+
+/* !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+ * Headers, definitions, etc.
+ * !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!*/
+
+/* Qt related headers */
+#include <QList>
+#include <QPoint>
+#include <QRect>
+#include <QString>
+#include <QVector>
+
+#include "FilmSampler.h"
+
+#define ZERO_DEGREES 0
+#define ONEEIGHTY_DEGREES 1
+
+/* Steps of a strategy, run in this order */
+#define OptimizeZeroCenter 1
+#define OptimizeOneEightyCenter 2
+#define OptimizeAlpha 4
+#define OptimizeRadius 8
+#define OptimizePhi 16
+
+/* Passes over both center coordinates when iterating until no change */
+#define OPTIMIZER_MAX_PASSES 20
+
+/* Warm searches move in steps of a pixel, these angles [deg] and radii [m];
+ * those of the angles and radius must improve the objective by this fraction */
+#define WARM_ANGLE_STEP 0.0001
+#define WARM_RADIUS_STEP 0.000001
+#define WARM_TOLERANCE 1e-5
+
+/* !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+ * Structures
+ * !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!*/
+
+/* The parameters being optimized, in view pixels, [m] and [deg] */
+struct CameraGeometry
+{
+    QPoint zeroDegreeCenter;
+    QPoint oneEightyDegreeCenter;
+    double radius;
+    double phi;
+    double alpha;
+
+    CameraGeometry() : radius(0.0), phi(0.0), alpha(0.0) {}
+};
+
+/* Half widths of the searches, as set in the preferences */
+struct OptimizerRanges
+{
+    int xSharpness;         /* [pixels] */
+    int ySharpness;
+    int xSymmetry;
+    int ySymmetry;
+    double phi;             /* [deg] */
+    double alpha;           /* [deg] */
+    double radius;          /* [m], around cameraRadius */
+    double cameraRadius;
+
+    OptimizerRanges() : xSharpness(10), ySharpness(10), xSymmetry(10), ySymmetry(10),
+                        phi(0.01), alpha(0.01), radius(0.001), cameraRadius(0.1146/2.0) {}
+};
+
+/* Regions the objectives are evaluated on.  The sharpness region and the
+ * symmetry pairs (A above B) follow the center they belong to. */
+struct OptimizerRegions
+{
+    QRect sharpness;
+    QRect zeroA;
+    QRect zeroB;
+    QRect oneEightyA;
+    QRect oneEightyB;
+};
+
+/* Objective evaluations made */
+struct OptimizerCounts
+{
+    int integrateRegion;
+    int residual;
+
+    OptimizerCounts() : integrateRegion(0), residual(0) {}
+    int total() const { return integrateRegion + residual; }
+};
+
+/* What AppWindow::optimize runs: the sharpness or symmetry searches for the
+ * steps selected, repeating the center searches until they stop moving if
+ * untilNoChange is set.  Phi is always optimized by sharpness.  A warm start
+ * searches outwards from the current geometry instead of over the whole
+ * ranges, for geometry already close to the optimum. */
+struct OptimizerStrategy
+{
+    QString name;
+    bool sharpness;
+    bool untilNoChange;
+    bool warmStart;
+    int steps;
+
+    OptimizerStrategy(const QString &n = QString(), bool sh = true, bool repeat = false,
+                      int s = OptimizeZeroCenter | OptimizeOneEightyCenter, bool warm = false)
+        : name(n), sharpness(sh), untilNoChange(repeat), warmStart(warm), steps(s) {}
+
+    QList<int> stepList() const;
+};
+
+/* !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+ * Main class definition
+ * !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!*/
+
+/* ***************************************************************************
+ * class: GeometryOptimizer
+ * description: the optimizations FilmWidget offers, on a copy of its
+ *   geometry and regions.  Centers are searched on offsets of their regions
+ *   (sharpness of the integrated region, or the residual between the
+ *   symmetry pair), radius, phi and alpha on the sharpness of the region.
+ *   The integration area is only brought up to date when a search ends, as
+ *   FilmWidget does.  Every evaluation is counted.
+ * ***************************************************************************/
+class GeometryOptimizer
+{
+public:
+    GeometryOptimizer(const FilmSampler &film, double dpm, const OptimizerRanges &ranges = OptimizerRanges());
+
+    CameraGeometry geometry;
+    OptimizerRegions regions;
+    QRect intArea;
+    const QVector<QRect> *exclude;
+    OptimizerCounts counts;
+
+    /* Recomputes intArea from the 0 degree center and radius, as
+     * FilmWidget::updateIntArea */
+    void updateIntArea();
+    /* Places the regions around the centers as FilmWidget does when the
+     * first center is set */
+    void placeRegions();
+
+    /* Objectives */
+    double integrateRegion(double res, int xo, int yo, const QRect &reg);
+    double residual(int xo, int yo, int location);
+
+    /* Single searches */
+    QPoint optimizeCenterXSharpness(int location = ZERO_DEGREES);
+    QPoint optimizeCenterYSharpness(int location = ZERO_DEGREES);
+    QPoint optimizeCenterXSymmetry(int location = ZERO_DEGREES);
+    QPoint optimizeCenterYSymmetry(int location = ZERO_DEGREES);
+    double optimizeAlphaSharpness();
+    double optimizePhiSharpness();
+    double optimizeRadiusSharpness();
+    double optimizeRotationSymmetry();
+    double optimizeRadiusSymmetry();
+
+    /* Warm searches, from the current geometry outwards */
+    QPoint refineCenter(int location, bool sharpness, bool untilNoChange);
+    double refineAlphaSharpness();
+    double refinePhiSharpness();
+    double refineRadiusSharpness();
+
+    /* Strategies */
+    QPoint optimizeCenter(int location, bool sharpness, bool untilNoChange);
+    void runStep(int step, const OptimizerStrategy &strategy);
+    void run(const OptimizerStrategy &strategy);
+
+private:
+    FilmSampler film;
+    double dpm;
+    OptimizerRanges ranges;
+
+    QPoint &center(int location);
+    void moveCenter(int location, const QPoint &c);
+};
+
+/* !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+ * Functions
+ * !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!*/
+
+/* Log line for a step */
+QString optimizerStepName(int step);
+
+/* Sharpness and symmetry, with and without repetition or warm started, for
+ * the centers alone and with radius, alpha and phi added in turn */
+QList<OptimizerStrategy> optimizerStrategies();
+
+#endif
@@ -0,0 +1,292 @@
+/* ***************************************************************************
+ * Instrumentation.cpp: implements the session timers, counters and trace
+ * ***************************************************************************/
+
+/* !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+ * Headers, definitions, etc.
+ * !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!*/
+
+#include "Instrumentation.h"
+
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QMap>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QStringList>
+#include <QThread>
+#include <QVector>
+
+/* One timed call on the timeline */
+struct TraceEvent
+{
+    const char *name;
+    qint64 start;
+    qint64 duration;
+    int thread;
+};
+
+static QElapsedTimer startedTimer()
+{
+    QElapsedTimer t;
+    t.start();
+    return t;
+}
+
+/* The session.  Stages are few and coarse (the finest are optimizer probes
+ * of a millisecond or more), so one lock around everything is cheap enough.
+ * The clock is never restarted; sessions and traces keep their start on it. */
+static const QElapsedTimer instrumentationTimer = startedTimer();
+static QMutex sessionMutex;
+static QMap<QString, StageStats> stages;
+static QMap<QString, CounterStats> counters;
+static QDateTime sessionStart = QDateTime::currentDateTime();
+static qint64 sessionOffset = 0;
+
+static volatile bool tracing = false;
+static qint64 traceOffset = 0;
+static QVector<TraceEvent> traceEvents;
+static qint64 droppedEvents = 0;
+static QMap<Qt::HANDLE, int> threadIds;
+static QStringList threadNames;
+
+/* !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+ * ScopedTimer
+ * !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!*/
+
+ScopedTimer::ScopedTimer(const char *stage) : stage(stage), start(instrumentationClock())
+{
+}
+
+ScopedTimer::~ScopedTimer()
+{
+    recordStage(stage, start, instrumentationClock() - start);
+}
+
+/* !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+ * Functions
+ * !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!*/
+
+qint64 instrumentationClock()
+{
+    return instrumentationTimer.nsecsElapsed();
+}
+
+/* Small id of the calling thread for the trace; the GUI thread is "main",
+ * others are numbered as they first record.  Called with the lock held. */
+static int traceThread()
+{
+    Qt::HANDLE h = QThread::currentThreadId();
+    QMap<Qt::HANDLE, int>::const_iterator i = threadIds.constFind(h);
+    if (i != threadIds.constEnd()) return i.value();
+
+    QCoreApplication *app = QCoreApplication::instance();
+    bool main = (app != NULL && QThread::currentThread() == app->thread());
+
+    static int workers = 0;
+    int id = threadNames.size() + 1;
+    threadNames.append(main ? QString("main") : QString("worker %1").arg(++workers));
+    threadIds.insert(h, id);
+    return id;
+}
+
+void recordStage(const char *stage, qint64 start, qint64 nsecs)
+{
+    QMutexLocker lock(&sessionMutex);
+
+    StageStats &s = stages[QLatin1String(stage)];
+    s.calls++;
+    s.totalNsecs += nsecs;
+    s.maxNsecs = qMax(s.maxNsecs, nsecs);
+
+    if (!tracing || start < traceOffset) return;
+
+    if (traceEvents.size() >= TRACE_MAX_EVENTS)
+    {
+        droppedEvents++;
+        return;
+    }
+
+    TraceEvent e;
+    e.name = stage;
+    e.start = start;
+    e.duration = nsecs;
+    e.thread = traceThread();
+    traceEvents.append(e);
+}
+
+void countEvent(const char *counter, qint64 n)
+{
+    QMutexLocker lock(&sessionMutex);
+    counters[QLatin1String(counter)].value += n;
+}
+
+QList<StageStats> stageStats()
+{
+    QMutexLocker lock(&sessionMutex);
+
+    QList<StageStats> l;
+    for (QMap<QString, StageStats>::const_iterator i = stages.constBegin(); i != stages.constEnd(); ++i)
+    {
+        l.append(i.value());
+        l.last().name = i.key();
+    }
+    return l;
+}
+
+QList<CounterStats> counterStats()
+{
+    QMutexLocker lock(&sessionMutex);
+
+    QList<CounterStats> l;
+    for (QMap<QString, CounterStats>::const_iterator i = counters.constBegin(); i != counters.constEnd(); ++i)
+    {
+        l.append(i.value());
+        l.last().name = i.key();
+    }
+    return l;
+}
+
+double sessionMsecs()
+{
+    QMutexLocker lock(&sessionMutex);
+    return (instrumentationClock() - sessionOffset)/1.0e6;
+}
+
+void resetInstrumentation()
+{
+    QMutexLocker lock(&sessionMutex);
+
+    stages.clear();
+    counters.clear();
+    sessionStart = QDateTime::currentDateTime();
+    sessionOffset = instrumentationClock();
+}
+
+static QString jsonString(const QString &s)
+{
+    QString e = s;
+    e.replace("\\", "\\\\").replace("\"", "\\\"");
+    return "\"" + e + "\"";
+}
+
+/* ***************************************************************************
+ * function: writeInstrumentationJson
+ * description: the session start and length, then one entry per stage
+ *   (calls, total, mean and longest call in seconds) and per counter.
+ * ***************************************************************************/
+void writeInstrumentationJson(QTextStream &out)
+{
+    QList<StageStats> s = stageStats();
+    QList<CounterStats> c = counterStats();
+
+    sessionMutex.lock();
+    QString start = sessionStart.toString(Qt::ISODate);
+    sessionMutex.unlock();
+
+    out << "{\n";
+    out << "  \"session_start\": " << jsonString(start) << ",\n";
+    out << "  \"session_s\": " << QString::number(sessionMsecs()/1000.0, 'g', 8) << ",\n";
+    out << "  \"stages\": [\n";
+
+    for (int i = 0; i < s.size(); i++)
+    {
+        const StageStats &st = s.at(i);
+
+        out << "    {\"name\": " << jsonString(st.name)
+            << ", \"calls\": " << st.calls
+            << ", \"total_s\": " << QString::number(st.totalMsecs()/1000.0, 'g', 8)
+            << ", \"mean_s\": " << QString::number(st.meanMsecs()/1000.0, 'g', 8)
+            << ", \"max_s\": " << QString::number(st.maxMsecs()/1000.0, 'g', 8)
+            << "}" << (i + 1 < s.size() ? "," : "") << "\n";
+    }
+
+    out << "  ],\n";
+    out << "  \"counters\": {";
+
+    for (int i = 0; i < c.size(); i++)
+        out << (i ? ", " : "") << jsonString(c.at(i).name) << ": " << c.at(i).value;
+
+    out << "}\n}\n";
+}
+
+bool saveInstrumentationJson(const QString &fileName)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) return false;
+
+    QTextStream out(&file);
+    writeInstrumentationJson(out);
+    return true;
+}
+
+void setTracing(bool on)
+{
+    QMutexLocker lock(&sessionMutex);
+
+    if (on && !tracing)
+    {
+        traceEvents.clear();
+        droppedEvents = 0;
+        traceOffset = instrumentationClock();
+    }
+    tracing = on;
+}
+
+bool isTracing()
+{
+    return tracing;
+}
+
+int traceEventCount()
+{
+    QMutexLocker lock(&sessionMutex);
+    return traceEvents.size();
+}
+
+/* ***************************************************************************
+ * function: writeTraceJson
+ * description: a complete ("X") event per timed call, in microseconds from
+ *   the start of the trace, with the thread it ran on, preceded by the
+ *   thread names.  The category is the stage up to its first '.', so the
+ *   optimizer probes can be filtered together.
+ * ***************************************************************************/
+void writeTraceJson(QTextStream &out)
+{
+    QMutexLocker lock(&sessionMutex);
+
+    out << "{\"displayTimeUnit\": \"ms\",\n";
+    out << " \"otherData\": {\"dropped_events\": " << droppedEvents << "},\n";
+    out << " \"traceEvents\": [\n";
+
+    out << "  {\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": 0, \"args\": {\"name\": \"DIIS\"}}";
+    for (int t = 0; t < threadNames.size(); t++)
+        out << ",\n  {\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << t + 1
+            << ", \"args\": {\"name\": " << jsonString(threadNames.at(t)) << "}}";
+
+    for (int i = 0; i < traceEvents.size(); i++)
+    {
+        const TraceEvent &e = traceEvents.at(i);
+        QString name = QLatin1String(e.name);
+
+        out << ",\n  {\"name\": " << jsonString(name)
+            << ", \"cat\": " << jsonString(name.section('.', 0, 0))
+            << ", \"ph\": \"X\", \"pid\": 1, \"tid\": " << e.thread
+            << ", \"ts\": " << QString::number((e.start - traceOffset)/1000.0, 'f', 3)
+            << ", \"dur\": " << QString::number(e.duration/1000.0, 'f', 3) << "}";
+    }
+
+    out << "\n]}\n";
+}
+
+bool saveTraceJson(const QString &fileName)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) return false;
+
+    QTextStream out(&file);
+    writeTraceJson(out);
+    return true;
+}
@@ -0,0 +1,115 @@
+/* ***************************************************************************
+ * Instrumentation.h: defines the per-stage timers and counters kept for the
+ *   session (load, invert, integrate, optimizer probes, background
+ *   subtraction, plotting, export) and the optional timeline of them
+ * ***************************************************************************/
+#ifndef Instrumentation_H
+#define Instrumentation_H
+
+/* !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+ * Headers, definitions, etc.
+ * !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!*/
+
+/* Qt related headers */
+#include <QList>
+#include <QString>
+#include <QTextStream>
+
+/* Events kept while tracing; later ones are counted as dropped */
+#define TRACE_MAX_EVENTS 1000000
+
+/* !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+ * Structures
+ * !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!*/
+
+/* Time spent in a stage since the session started (or was reset) */
+struct StageStats
+{
+    QString name;
+    qint64 calls;
+    qint64 totalNsecs;
+    qint64 maxNsecs;
+
+    StageStats() : calls(0), totalNsecs(0), maxNsecs(0) {}
+    double totalMsecs() const { return totalNsecs/1.0e6; }
+    double meanMsecs() const { return calls ? totalNsecs/1.0e6/calls : 0.0; }
+    double maxMsecs() const { return maxNsecs/1.0e6; }
+};
+
+/* A counted quantity (pixels integrated, points written, ...) */
+struct CounterStats
+{
+    QString name;
+    qint64 value;
+
+    CounterStats() : value(0) {}
+};
+
+/* !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+ * Main class definition
+ * !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!*/
+
+/* ***************************************************************************
+ * class: ScopedTimer
+ * description: adds the time from construction to destruction to stage.
+ *   Put one at the top of the block to be timed:
+ *     ScopedTimer timer("integrate");
+ *   stage must outlive the timer (a string literal).  Nested stages are
+ *   each charged in full, so "plot" includes the "background" it runs.
+ *   While tracing, every timer also leaves an event on the timeline.
+ * ***************************************************************************/
+class ScopedTimer
+{
+public:
+    explicit ScopedTimer(const char *stage);
+    ~ScopedTimer();
+
+private:
+    const char *stage;
+    qint64 start;
+
+    ScopedTimer(const ScopedTimer &);
+    ScopedTimer &operator=(const ScopedTimer &);
+};
+
+/* !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+ * Functions
+ * !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!*/
+
+/* Nanoseconds on a monotonic clock shared by all threads */
+qint64 instrumentationClock();
+
+/* Adds one call of nsecs, started at start (instrumentationClock), to
+ * stage and, while tracing, to the timeline.  Safe to call from any thread. */
+void recordStage(const char *stage, qint64 start, qint64 nsecs);
+
+/* Adds n to counter.  Safe to call from any thread. */
+void countEvent(const char *counter, qint64 n = 1);
+
+/* Stages and counters so far, by name */
+QList<StageStats> stageStats();
+QList<CounterStats> counterStats();
+
+/* Milliseconds since the session started or was last reset */
+double sessionMsecs();
+
+/* Clears all stages and counters and starts a new session */
+void resetInstrumentation();
+
+/* The session as JSON; saveInstrumentationJson returns false if fileName
+ * could not be written */
+void writeInstrumentationJson(QTextStream &out);
+bool saveInstrumentationJson(const QString &fileName);
+
+/* Timeline of the stages, on the calling threads.  Starting a trace clears
+ * the previous one. */
+void setTracing(bool on);
+bool isTracing();
+int traceEventCount();
+
+/* The timeline as Chrome trace-event JSON (chrome://tracing, Perfetto);
+ * saveTraceJson returns false if fileName could not be written */
+void writeTraceJson(QTextStream &out);
+bool saveTraceJson(const QString &fileName);
+
+#endif
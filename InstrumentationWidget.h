@@ -0,0 +1,138 @@
+/* ***************************************************************************
+ * InstrumentationWidget.h: table of the session timers and counters, shown
+ *   in the Timings dock
+ * ***************************************************************************/
+#ifndef InstrumentationWidget_H
+#define InstrumentationWidget_H
+
+#include <QtGui>
+#include <iostream>
+
+#include "Instrumentation.h"
+
+using namespace std;
+
+/* Refresh interval while the table is visible [ms] */
+#define INSTRUMENTATION_REFRESH 1000
+
+/* ***************************************************************************
+ * class: InstrumentationWidget
+ * description: one row per stage (calls, total, mean and longest call in
+ *   ms) followed by the counters.  Refreshes itself while visible; the
+ *   context menu resets the session or saves it as JSON, and records the
+ *   timeline of the stages for chrome://tracing or Perfetto.
+ * ***************************************************************************/
+class InstrumentationWidget : public QTableWidget
+{
+    Q_OBJECT
+public:
+    InstrumentationWidget(QWidget *parent) : QTableWidget(0, 5, parent)
+    {
+        QStringList header;
+        header << "Stage" << "Calls" << "Total [ms]" << "Mean [ms]" << "Max [ms]";
+        this->setHorizontalHeaderLabels(header);
+        this->verticalHeader()->hide();
+        this->setSelectionMode(QAbstractItemView::NoSelection);
+        this->setEditTriggers(QAbstractItemView::NoEditTriggers);
+
+        QTimer *timer = new QTimer(this);
+        connect(timer, SIGNAL(timeout()), this, SLOT(refreshIfVisible()));
+        timer->start(INSTRUMENTATION_REFRESH);
+    }
+
+public slots:
+    void refresh()
+    {
+        QList<StageStats> s = stageStats();
+        QList<CounterStats> c = counterStats();
+
+        this->setRowCount(s.size() + c.size());
+
+        for (int i = 0; i < s.size(); i++)
+        {
+            const StageStats &st = s.at(i);
+            setRow(i, st.name, QString::number(st.calls),
+                   QString::number(st.totalMsecs(), 'f', 1),
+                   QString::number(st.meanMsecs(), 'f', 2),
+                   QString::number(st.maxMsecs(), 'f', 2));
+        }
+
+        for (int i = 0; i < c.size(); i++)
+            setRow(s.size() + i, c.at(i).name, QString::number(c.at(i).value), "", "", "");
+
+        this->resizeColumnsToContents();
+    }
+
+    void refreshIfVisible()
+    {
+        if (this->isVisible()) refresh();
+    }
+
+    void resetSession()
+    {
+        resetInstrumentation();
+        refresh();
+    }
+
+    void saveJson()
+    {
+        QString fileName = QFileDialog::getSaveFileName(this, tr("Save timings as..."), QDir::currentPath(), tr("*.json"));
+        if (fileName.isEmpty()) return;
+
+        if (!saveInstrumentationJson(fileName))
+            cout << "Unable to save file..." << endl;
+    }
+
+    void toggleTrace(bool on)
+    {
+        setTracing(on);
+    }
+
+    void saveTrace()
+    {
+        QString fileName = QFileDialog::getSaveFileName(this, tr("Save timeline as..."), QDir::currentPath(), tr("*.json"));
+        if (fileName.isEmpty()) return;
+
+        if (!saveTraceJson(fileName))
+            cout << "Unable to save file..." << endl;
+    }
+
+protected:
+    void mousePressEvent(QMouseEvent *e)
+    {
+        if (e->button() == Qt::RightButton)
+        {
+            QMenu contextMenu(this);
+            contextMenu.addAction("Refresh", this, SLOT(refresh()));
+            contextMenu.addAction("Reset", this, SLOT(resetSession()));
+            contextMenu.addAction("Save as JSON...", this, SLOT(saveJson()));
+            contextMenu.addSeparator();
+            QAction *traceAct = contextMenu.addAction("Record timeline", this, SLOT(toggleTrace(bool)));
+            traceAct->setCheckable(true);
+            traceAct->setChecked(isTracing());
+            QAction *saveTraceAct = contextMenu.addAction("Save timeline...", this, SLOT(saveTrace()));
+            saveTraceAct->setEnabled(traceEventCount() > 0);
+            contextMenu.exec(QCursor::pos());
+            return;
+        }
+
+        QTableWidget::mousePressEvent(e);
+    }
+
+private:
+    void setRow(int row, const QString &name, const QString &calls,
+                const QString &total, const QString &mean, const QString &max)
+    {
+        QStringList values;
+        values << name << calls << total << mean << max;
+
+        for (int col = 0; col < values.size(); col++)
+        {
+            QTableWidgetItem *item = new QTableWidgetItem(values.at(col));
+            if (col > 0) item->setTextAlignment(Qt::AlignRight | Qt::AlignVCenter);
+            this->setItem(row, col, item);
+        }
+    }
+};
+
+#endif // InstrumentationWidget_H
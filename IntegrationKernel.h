@@ -0,0 +1,281 @@
+/* ***************************************************************************
+ * IntegrationKernel.h: defines the pixel to 2theta integration loops,
+ *   specialized at compile time for the common geometry cases
+ * ***************************************************************************/
+#ifndef IntegrationKernel_H
+#define IntegrationKernel_H
+
+/* !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+ * Headers, definitions, etc.
+ * !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!*/
+
+/* Qt related headers */
+#include <QImage>
+#include <QRect>
+#include <QVector>
+
+#include <cmath>
+
+#include "FilmSampler.h"
+#include "TwoThetaHistogram.h"
+
+/* Angles [deg] below which phi or alpha are treated as zero */
+#define KERNEL_ZERO_ANGLE 1e-9
+
+/* Kernel selected by selectKernel().  Bit 0 selects the full (tilted)
+ * formula, bit 1 mapping of the pixels through alpha and the film rotation. */
+#define ZeroTiltKernel 0
+#define TiltOnlyKernel 1
+#define RotatedKernel 2
+#define GeneralKernel 3
+
+/* !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+ * Structures
+ * !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!*/
+
+/* Everything an integration loop needs to know.  A view pixel (x, y) in loop
+ * is at c = (x - cOffset)/dpm across and L = (y - LOffset)/dpm along the
+ * film; beyond L = foldL the angle is measured from the other end
+ * (180 - 2theta).  Pixels outside [minTwoTheta, maxTwoTheta] or in an
+ * exclude region are skipped. */
+struct KernelParams
+{
+    QRect loop;
+    double cOffset;
+    double LOffset;
+    double foldL;
+    double minTwoTheta;
+    double maxTwoTheta;
+
+    double dpm;
+    double R;
+    double cp;      /* cos and sin of phi */
+    double sp;
+    double ca;      /* cos and sin of alpha */
+    double sa;
+    double ox;      /* translation completing the alpha rotation */
+    double oy;
+
+    /* Only pixels with x and y above zero are used when set */
+    bool positiveOnly;
+
+    const QVector<QRect> *exclude;
+
+    KernelParams() : cOffset(0.0), LOffset(0.0), foldL(1e20), minTwoTheta(-1.0),
+                     maxTwoTheta(1000.0), dpm(1.0), R(1.0), cp(1.0), sp(0.0),
+                     ca(1.0), sa(0.0), ox(0.0), oy(0.0), positiveOnly(false),
+                     exclude(0) {}
+
+    /* Sets phi and alpha [deg].  The alpha rotation keeps the view in
+     * positive coordinates, so its translation depends on the sign. */
+    void setAngles(double phi, double alpha, int viewHeight)
+    {
+        cp = cos(phi*M_PI/180.0);
+        sp = sin(phi*M_PI/180.0);
+        ca = cos(alpha*M_PI/180.0);
+        sa = sin(alpha*M_PI/180.0);
+        ox = (alpha >= 0) ? sa*viewHeight : 0.0;
+        oy = (alpha >= 0) ? 0.0 : -sa*viewHeight;
+    }
+
+    bool isExcluded(int x, int y) const
+    {
+        if (!exclude) return false;
+
+        for (int i = 0; i < exclude->size(); i++)
+            if (exclude->at(i).contains(x, y))
+                return true;
+
+        return false;
+    }
+};
+
+/* !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+ * Geometry policies
+ *   A formula provides per row terms (L is constant along a row) and the
+ *   2theta of a pixel in that row.  A mapping reads the pixel's gray value.
+ * !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!*/
+
+/* phi = 0: the simplified form used in mouseMoveEvent,
+ * tan^2(2theta) = ((R^2 + c^2)/R^2)(1 + tan^2(L/R)) - 1
+ *              = tan^2(L/R) + (c/R)^2 (1 + tan^2(L/R)) */
+struct ZeroTilt
+{
+    struct Row
+    {
+        double t2;
+        double sec2;
+        double invR2;
+    };
+
+    static Row row(const KernelParams &p, double L)
+    {
+        Row r;
+        double t = tan(L/p.R);
+        r.t2 = t*t;
+        r.sec2 = 1.0 + r.t2;
+        r.invR2 = 1.0/(p.R*p.R);
+        return r;
+    }
+
+    static double twoTheta(const KernelParams &, const Row &r, double c)
+    {
+        return (180.0/M_PI)*atan( sqrt( r.t2 + c*c*r.invR2*r.sec2 ) );
+    }
+};
+
+/* phi != 0: the full formula with the row trig hoisted */
+struct Tilted
+{
+    struct Row
+    {
+        double Rs;      /* R sin(phi) cos(L/R) */
+        double Rc;      /* R cos(phi) cos(L/R) */
+        double Rsin2;   /* (R sin(L/R))^2 */
+    };
+
+    static Row row(const KernelParams &p, double L)
+    {
+        Row r;
+        double cosL = cos(L/p.R);
+        double sinL = sin(L/p.R);
+        r.Rs = p.R*p.sp*cosL;
+        r.Rc = p.R*p.cp*cosL;
+        r.Rsin2 = p.R*p.R*sinL*sinL;
+        return r;
+    }
+
+    static double twoTheta(const KernelParams &p, const Row &r, double c)
+    {
+        double a = c*p.cp + r.Rs;
+        double b = -c*p.sp + r.Rc;
+        return (180.0/M_PI)*atan( sqrt( (a*a + r.Rsin2)/(b*b) ) );
+    }
+};
+
+/* alpha = 0 on an unrotated film: view pixels are (cropped) film pixels */
+struct DirectMap
+{
+    static int gray(const FilmSampler &film, const KernelParams &, int x, int y)
+    {
+        return qGray(film.image()->pixel(x + film.offsetX(), y + film.offsetY()));
+    }
+};
+
+/* Otherwise the branch-free alpha rotation, then the film rotation, sampled
+ * bilinearly (-1 when the pixel lands off the film) */
+struct AffineMap
+{
+    static int gray(const FilmSampler &film, const KernelParams &p, int x, int y)
+    {
+        return film.grayAt(x*p.ca - y*p.sa + p.ox, x*p.sa + y*p.ca + p.oy);
+    }
+};
+
+/* !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+ * Kernels
+ * !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!*/
+
+/* Picks the cheapest kernel that is exact for the given angles [deg] and
+ * film transform */
+inline int selectKernel(double phi, double alpha, bool rotatedFilm = false)
+{
+    int kernel = ZeroTiltKernel;
+    if (fabs(phi) > KERNEL_ZERO_ANGLE) kernel |= TiltOnlyKernel;
+    if (fabs(alpha) > KERNEL_ZERO_ANGLE || rotatedFilm) kernel |= RotatedKernel;
+    return kernel;
+}
+
+/* ***************************************************************************
+ * method: integrationKernel
+ * description: visits the view pixels of p.loop row by row and hands each
+ *   pixel's 2theta and gray value to sink(twoTheta, gray).  Pixels outside
+ *   the view, or mapped off the film, are skipped.
+ * ***************************************************************************/
+template <class Formula, class Mapping, class Sink>
+void integrationKernel(const FilmSampler &film, const KernelParams &p, Sink &sink)
+{
+    int W = film.width();
+    int H = film.height();
+
+    for (int y = p.loop.y(); y < p.loop.y() + p.loop.height(); y++)
+    {
+        if (y >= H) break;
+        if (y < 0 || (p.positiveOnly && y == 0)) continue;
+
+        double L = (y - p.LOffset)/p.dpm;
+        typename Formula::Row row = Formula::row(p, L);
+        bool fold = L > p.foldL;
+
+        for (int x = p.loop.x(); x < p.loop.x() + p.loop.width(); x++)
+        {
+            if (x >= W) break;
+            if (x < 0 || (p.positiveOnly && x == 0)) continue;
+            if (p.isExcluded(x, y)) continue;
+
+            double c = (x - p.cOffset)/p.dpm;
+            double twoTheta = Formula::twoTheta(p, row, c);
+            if (fold) twoTheta = 180.0 - twoTheta;
+
+            if (twoTheta < p.minTwoTheta || twoTheta > p.maxTwoTheta) continue;
+
+            int gray = Mapping::gray(film, p, x, y);
+            if (gray < 0) continue;
+
+            sink(twoTheta, gray);
+        }
+    }
+}
+
+/* Runs the kernel selected for the geometry in p */
+template <class Sink>
+void runIntegrationKernel(const FilmSampler &film, const KernelParams &p, int kernel, Sink &sink)
+{
+    switch (kernel)
+    {
+    case ZeroTiltKernel:
+        integrationKernel<ZeroTilt, DirectMap>(film, p, sink);
+        break;
+    case TiltOnlyKernel:
+        integrationKernel<Tilted, DirectMap>(film, p, sink);
+        break;
+    case RotatedKernel:
+        integrationKernel<ZeroTilt, AffineMap>(film, p, sink);
+        break;
+    default:
+        integrationKernel<Tilted, AffineMap>(film, p, sink);
+        break;
+    }
+}
+
+/* !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+ * Sinks
+ * !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!*/
+
+/* Receives the pixels of an integration kernel into the master histogram */
+struct HistogramSink
+{
+    TwoThetaHistogram *histogram;
+
+    void operator()(double twoTheta, int gray) { histogram->add(twoTheta, gray); }
+};
+
+/* Receives the pixels of an integration kernel into an intData style array
+ * of (2theta, summed intensity, count) rows */
+struct BinSink
+{
+    double **data;
+    double res;
+    int n;
+
+    void operator()(double twoTheta, int gray)
+    {
+        int i = floor(twoTheta/res + 0.5);
+        if (i < 0 || i >= n) return;
+
+        data[i][1] += gray;
+        data[i][2] = data[i][2] + 1;
+    }
+};
+
+#endif
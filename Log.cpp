@@ -0,0 +1,176 @@
+/* ***************************************************************************
+ * Log.cpp: implements the log message queue
+ * ***************************************************************************/
+
+/* !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+ * Headers, definitions, etc.
+ * !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!*/
+
+#include "Log.h"
+
+#include <QAtomicInt>
+#include <QDateTime>
+#include <QStringList>
+
+#define LOG_RING_MASK (LOG_RING_SIZE - 1)
+
+/* ***************************************************************************
+ * class: LogRing
+ * description: bounded multi-producer queue after D. Vyukov.  Each slot
+ *   carries a sequence number: a writer may fill the slot at position pos
+ *   when its sequence is pos, and publishes it by setting pos + 1; the
+ *   reader empties it and hands it to the writer one lap later by setting
+ *   pos + LOG_RING_SIZE.  Writers only contend on the compare-and-swap of
+ *   the write position.  Positions wrap, so they are compared as
+ *   differences.
+ * ***************************************************************************/
+struct LogSlot
+{
+    QAtomicInt sequence;
+    LogEntry entry;
+};
+
+struct LogRing
+{
+    LogSlot slots[LOG_RING_SIZE];
+    QAtomicInt writePos;
+    unsigned readPos;
+    QAtomicInt dropped;
+
+    LogRing() : readPos(0)
+    {
+        for (int i = 0; i < LOG_RING_SIZE; i++)
+            slots[i].sequence = i;
+    }
+};
+
+static LogRing ring;
+static QAtomicInt minimumLevel(LogInfo);
+static QAtomicInt traceMask(0);
+
+/* !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+ * Functions
+ * !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!*/
+
+void logMessage(int level, const QString &category, const QString &text)
+{
+    if (level < int(minimumLevel)) return;
+
+    unsigned pos = unsigned(int(ring.writePos));
+    LogSlot *slot;
+
+    for (;;)
+    {
+        slot = &ring.slots[pos & LOG_RING_MASK];
+        int dif = int(unsigned(slot->sequence.fetchAndAddAcquire(0)) - pos);
+
+        if (dif == 0 && ring.writePos.testAndSetRelaxed(int(pos), int(pos + 1)))
+            break;
+
+        if (dif < 0)
+        {
+            ring.dropped.fetchAndAddRelaxed(1);
+            return;
+        }
+
+        pos = unsigned(int(ring.writePos));
+    }
+
+    slot->entry.time = QDateTime::currentMSecsSinceEpoch();
+    slot->entry.level = level;
+    slot->entry.category = category;
+    slot->entry.text = text;
+    slot->sequence.fetchAndStoreRelease(int(pos + 1));
+}
+
+int drainLog(QVector<LogEntry> &out)
+{
+    int n = 0;
+
+    for (;;)
+    {
+        unsigned pos = ring.readPos;
+        LogSlot &slot = ring.slots[pos & LOG_RING_MASK];
+        if (int(unsigned(slot.sequence.fetchAndAddAcquire(0)) - (pos + 1)) < 0)
+            break;
+
+        /* The slot's strings are emptied so the writer of the next lap
+         * does not free them */
+        out.append(slot.entry);
+        slot.entry.category = QString();
+        slot.entry.text = QString();
+
+        slot.sequence.fetchAndStoreRelease(int(pos + LOG_RING_SIZE));
+        ring.readPos = pos + 1;
+        n++;
+    }
+
+    return n;
+}
+
+int takeDroppedLogMessages()
+{
+    return ring.dropped.fetchAndStoreRelaxed(0);
+}
+
+void setLogLevel(int level)
+{
+    minimumLevel = qBound(LogDebug, level, LogError);
+}
+
+int logLevel()
+{
+    return int(minimumLevel);
+}
+
+QString logLevelName(int level)
+{
+    switch (level)
+    {
+    case LogDebug: return "Debug";
+    case LogWarning: return "Warning";
+    case LogError: return "Error";
+    default: return "Info";
+    }
+}
+
+void setTraceSubsystems(int mask)
+{
+    traceMask = mask & TraceAll;
+    if (mask & TraceAll) setLogLevel(LogDebug);
+}
+
+int traceSubsystems()
+{
+    return int(traceMask);
+}
+
+int parseTraceSubsystems(const QString &names)
+{
+    int mask = 0;
+
+    QStringList l = names.toLower().split(",", QString::SkipEmptyParts);
+    for (int i = 0; i < l.size(); i++)
+    {
+        QString n = l.at(i).trimmed();
+        if (n == "all") mask |= TraceAll;
+        else if (n == "film") mask |= TraceFilm;
+        else if (n == "optimizer") mask |= TraceOptimizer;
+        else if (n == "plot") mask |= TracePlot;
+        else if (n == "search") mask |= TraceSearch;
+    }
+
+    return mask;
+}
+
+QString traceName(int subsystem)
+{
+    switch (subsystem)
+    {
+    case TraceFilm: return "Film";
+    case TraceOptimizer: return "Optimizer";
+    case TracePlot: return "Plot";
+    case TraceSearch: return "Search";
+    default: return "Trace";
+    }
+}
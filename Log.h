@@ -0,0 +1,90 @@
+/* ***************************************************************************
+ * Log.h: defines the log messages and the bounded ring buffer they are
+ *   queued in until the log window collects them
+ * ***************************************************************************/
+#ifndef Log_H
+#define Log_H
+
+/* !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+ * Headers, definitions, etc.
+ * !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!*/
+
+/* Qt related headers */
+#include <QString>
+#include <QVector>
+
+/* Levels, least severe first */
+#define LogDebug 0
+#define LogInfo 1
+#define LogWarning 2
+#define LogError 3
+
+/* Subsystems whose debug traces can be switched on separately */
+#define TraceFilm 1
+#define TraceOptimizer 2
+#define TracePlot 4
+#define TraceSearch 8
+#define TraceAll (TraceFilm | TraceOptimizer | TracePlot | TraceSearch)
+
+/* TRACE(subsystem, text) logs text at LogDebug when the subsystem is
+ * switched on.  Traces compile in with debug builds or DEFINES += DIIS_TRACE;
+ * in release builds they compile out, text included, so they may sit in
+ * inner loops. */
+#if !defined(QT_NO_DEBUG) || defined(DIIS_TRACE)
+#define TRACE(subsystem, text) \
+    do { if (traceEnabled(subsystem)) logMessage(LogDebug, traceName(subsystem), text); } while (0)
+#else
+#define TRACE(subsystem, text) do { } while (0)
+#endif
+
+/* Messages queued at most; must be a power of two.  A message logged while
+ * the queue is full is dropped (and counted) rather than waited for. */
+#define LOG_RING_SIZE 16384
+
+/* !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+ * Structures
+ * !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!*/
+
+struct LogEntry
+{
+    qint64 time;            /* [ms] since the epoch */
+    int level;
+    QString category;
+    QString text;
+
+    LogEntry() : time(0), level(LogInfo) {}
+};
+
+/* !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+ * Functions
+ * !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!*/
+
+/* Queues a message from any thread without taking a lock or touching the
+ * GUI.  Messages below the log level are discarded. */
+void logMessage(int level, const QString &category, const QString &text);
+
+/* Appends the queued messages to out, oldest first, and returns how many.
+ * Meant for one reader (the log window's timer). */
+int drainLog(QVector<LogEntry> &out);
+
+/* Messages dropped because the queue was full, since the last call */
+int takeDroppedLogMessages();
+
+/* Least severe level kept (LogDebug..LogError) */
+void setLogLevel(int level);
+int logLevel();
+
+/* "Debug", "Info", "Warning" or "Error" */
+QString logLevelName(int level);
+
+/* Switches the traces of the subsystems in mask on (and the others off).
+ * Switching any on lowers the log level to LogDebug so they are shown. */
+void setTraceSubsystems(int mask);
+int traceSubsystems();
+inline bool traceEnabled(int subsystem) { return (traceSubsystems() & subsystem) != 0; }
+
+/* "film,optimizer,plot,search" (or "all") as a mask, and the name of one */
+int parseTraceSubsystems(const QString &names);
+QString traceName(int subsystem);
+
+#endif
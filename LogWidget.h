@@ -12,6 +12,9 @@
 #include <math.h>
 #include <iostream>
 #include <fstream>
+
+#include "Log.h"
+
 using namespace std;
 
 QT_BEGIN_NAMESPACE
@@ -22,15 +25,85 @@ class QScrollArea;
 class QScrollBar;
 QT_END_NAMESPACE
 
-class LogWidgetWidget : public QListWidget
+/* How often the queued messages are collected [ms] */
+#define LOG_DRAIN_INTERVAL 100
+
+/* Messages kept in the window; the oldest tenth goes when it is full */
+#define LOG_MODEL_MAX 200000
+
+/* The messages collected so far, one row each */
+class LogModel : public QAbstractListModel
+{
+    Q_OBJECT
+public:
+    LogModel(QObject *parent) : QAbstractListModel(parent) {}
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const
+    {
+        return parent.isValid() ? 0 : entries.size();
+    }
+
+    QVariant data(const QModelIndex &index, int role) const
+    {
+        if (!index.isValid() || index.row() >= entries.size()) return QVariant();
+        const LogEntry &e = entries.at(index.row());
+
+        switch (role)
+        {
+        case Qt::DisplayRole:
+            return QString(e.text).replace('\n', ' ');
+        case Qt::ToolTipRole:
+            return QString("%1 %2 [%3]").arg(QDateTime::fromMSecsSinceEpoch(e.time).toString("hh:mm:ss.zzz"))
+                                        .arg(logLevelName(e.level)).arg(e.category);
+        case Qt::ForegroundRole:
+            if (e.level == LogDebug) return QBrush(Qt::gray);
+            if (e.level == LogWarning) return QBrush(QColor(192, 112, 0));
+            if (e.level == LogError) return QBrush(Qt::red);
+            return QVariant();
+        default:
+            return QVariant();
+        }
+    }
+
+    void append(const QVector<LogEntry> &batch)
+    {
+        if (batch.isEmpty()) return;
+
+        if (entries.size() + batch.size() > LOG_MODEL_MAX)
+        {
+            int n = qMin(entries.size(), qMax(LOG_MODEL_MAX/10, entries.size() + batch.size() - LOG_MODEL_MAX));
+            beginRemoveRows(QModelIndex(), 0, n - 1);
+            entries.remove(0, n);
+            endRemoveRows();
+        }
+
+        beginInsertRows(QModelIndex(), entries.size(), entries.size() + batch.size() - 1);
+        entries += batch;
+        endInsertRows();
+    }
+
+    void clear()
+    {
+        beginResetModel();
+        entries.clear();
+        endResetModel();
+    }
+
+    const QVector<LogEntry> &messages() const { return entries; }
+
+private:
+    QVector<LogEntry> entries;
+};
+
+class LogView : public QListView
 {
     Q_OBJECT
 public:
-    LogWidgetWidget(QWidget *parent) : QListWidget(parent)
+    LogView(QWidget *parent, LogModel *model) : QListView(parent), model(model)
     {
+        this->setModel(model);
         this->setSelectionMode(QAbstractItemView::NoSelection);
-        this->setWordWrap(true);
-        cout << "[LogWidgetWidget] Created." << endl;
+        this->setUniformItemSizes(true);
     }
 
 public slots:
@@ -41,8 +114,9 @@ public slots:
         ofstream logFile (logFilename.toAscii());
         if (logFile.is_open())
         {
-            for (int row = 0; row < this->count(); row++) {
-                logFile << this->item(row)->text().toStdString() << endl;
+            const QVector<LogEntry> &m = model->messages();
+            for (int row = 0; row < m.size(); row++) {
+                logFile << m.at(row).text.toStdString() << "\n";
             }
             logFile.close();
         }
@@ -53,7 +127,7 @@ public slots:
 
     void clearLog()
     {
-        this->clear();
+        model->clear();
     }
 
 protected:
@@ -71,8 +145,18 @@ protected:
             contextMenu = 0;
         }
     }
+
+private:
+    LogModel *model;
 };
 
+/* ***************************************************************************
+ * class: LogWidget
+ * description: the log window.  Messages are queued (see Log.h) by
+ *   addMessage or logMessage from any thread and collected on a timer, so
+ *   logging from the analysis costs no repaint.  While any trace subsystem
+ *   is switched on the collected messages are also echoed to cout.
+ * ***************************************************************************/
 class LogWidget : public QDialog
 {
     Q_OBJECT
@@ -80,28 +164,73 @@ class LogWidget : public QDialog
 public:
     LogWidget(QWidget *parent) : QDialog(parent)
     {
-        listWidget = new LogWidgetWidget(this);
-        listWidget->autoScrollMargin();
+        model = new LogModel(this);
+        listView = new LogView(this, model);
         this->resize(300,500);
         this->setWindowTitle("Log");
 
         this->setMouseTracking(true);
+
+        QTimer *timer = new QTimer(this);
+        connect(timer, SIGNAL(timeout()), this, SLOT(drain()));
+        timer->start(LOG_DRAIN_INTERVAL);
     }
 
+    /* A leading "[Category]" in msg is taken as its category */
     void addMessage(QString msg)
     {
-        new QListWidgetItem(msg, listWidget);
-        cout << msg.toStdString() << endl;
-        listWidget->setCurrentRow(listWidget->count()-1);
+        addMessage(LogInfo, msg);
+    }
+
+    void addMessage(int level, QString msg)
+    {
+        QString category = "Main";
+        if (msg.startsWith("[") && msg.indexOf("]") > 1)
+            category = msg.mid(1, msg.indexOf("]") - 1);
+
+        logMessage(level, category, msg);
+    }
+
+public slots:
+    void drain()
+    {
+        QVector<LogEntry> batch;
+        drainLog(batch);
+
+        int dropped = takeDroppedLogMessages();
+        if (dropped > 0)
+        {
+            LogEntry e;
+            e.time = QDateTime::currentMSecsSinceEpoch();
+            e.level = LogWarning;
+            e.category = "Log";
+            e.text = QString("[Log] %1 messages dropped.").arg(dropped);
+            batch.append(e);
+        }
+
+        if (batch.isEmpty()) return;
+
+        if (traceSubsystems() != 0)
+        {
+            for (int i = 0; i < batch.size(); i++)
+                cout << batch.at(i).text.toStdString() << "\n";
+            cout.flush();
+        }
+
+        QScrollBar *bar = listView->verticalScrollBar();
+        bool atBottom = (bar->value() == bar->maximum());
+        model->append(batch);
+        if (atBottom) listView->scrollToBottom();
     }
 
 protected:
     void resizeEvent ( QResizeEvent * e)
     {
-        listWidget->resize(e->size());
+        listView->resize(e->size());
     }
 
 private:
-    LogWidgetWidget *listWidget;
+    LogModel *model;
+    LogView *listView;
 };
 #endif // LogWidget_H
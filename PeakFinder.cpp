@@ -0,0 +1,545 @@
+/* ***************************************************************************
+ * PeakFinder.cpp: implements peak detection (Savitzky-Golay derivative zero
+ *   crossings) and pseudo-Voigt profile fitting (Levenberg-Marquardt)
+ * ***************************************************************************/
+
+/* !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+ * Headers, definitions, etc.
+ * !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!*/
+
+#include "PeakFinder.h"
+#include "Instrumentation.h"
+
+#include <QtConcurrentMap>
+#include <QtAlgorithms>
+
+#include <cmath>
+#include <algorithm>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+/* Parameters per peak (x0, area, fwhm, eta) and for the background (b0, b1) */
+#define PV_NPAR 4
+#define BG_NPAR 2
+
+/* Normalisation of the unit area Gaussian and Lorentzian for a given FWHM */
+static const double GAUSS_C = 2.0*sqrt(log(2.0)/M_PI);
+static const double GAUSS_K = 4.0*log(2.0);
+static const double LORENTZ_C = 2.0/M_PI;
+
+/* !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+ * Smoothing
+ * !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!*/
+
+/* ***************************************************************************
+ * method: smoothSavitzkyGolay
+ * description: least squares quadratic over 2m+1 points.  The closed form
+ *   coefficients are
+ *     smooth:     (3(3m^2+3m-1) - 15i^2) / ((2m-1)(2m+1)(2m+3))
+ *     derivative: 3i / (m(m+1)(2m+1))
+ * ***************************************************************************/
+void smoothSavitzkyGolay(const double *y, int n, int m, double *s, double *ds)
+{
+    for (int i = 0; i < n; i++)
+    {
+        int mi = qMin(m, qMin(i, n-1-i));
+
+        if (mi < 1)
+        {
+            s[i] = y[i];
+            if (ds) ds[i] = (i == 0) ? ((n > 1) ? y[1] - y[0] : 0.0) : y[i] - y[i-1];
+            continue;
+        }
+
+        double sNorm = (2.0*mi - 1.0)*(2.0*mi + 1.0)*(2.0*mi + 3.0);
+        double dNorm = mi*(mi + 1.0)*(2.0*mi + 1.0);
+        double sum = 0.0;
+        double dsum = 0.0;
+
+        for (int j = -mi; j <= mi; j++)
+        {
+            sum += (3.0*(3.0*mi*mi + 3.0*mi - 1.0) - 15.0*j*j)*y[i+j];
+            dsum += 3.0*j*y[i+j];
+        }
+
+        s[i] = sum/sNorm;
+        if (ds) ds[i] = dsum/dNorm;
+    }
+}
+
+/* !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+ * Profile model
+ * !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!*/
+
+/* ***************************************************************************
+ * method: pseudoVoigt
+ * description: area normalised pseudo-Voigt A(eta L + (1-eta) G) with
+ *   p = (x0, A, w, eta).  If dp is non-zero the analytic partial derivatives
+ *   with respect to each parameter are written to it.
+ * ***************************************************************************/
+static double pseudoVoigt(double x, const double *p, double *dp)
+{
+    double x0 = p[0];
+    double A = p[1];
+    double w = p[2];
+    double eta = p[3];
+
+    double dx = x - x0;
+    double w2 = w*w;
+    double q = 1.0 + 4.0*dx*dx/w2;
+
+    double G = GAUSS_C/w*exp(-GAUSS_K*dx*dx/w2);
+    double L = LORENTZ_C/w/q;
+    double shape = eta*L + (1.0 - eta)*G;
+
+    if (dp)
+    {
+        double dGdx0 = G*2.0*GAUSS_K*dx/w2;
+        double dGdw = G*(-1.0/w + 2.0*GAUSS_K*dx*dx/(w2*w));
+        double dLdx0 = L*8.0*dx/(w2*q);
+        double dLdw = L*(-1.0/w + 8.0*dx*dx/(w2*w*q));
+
+        dp[0] = A*(eta*dLdx0 + (1.0 - eta)*dGdx0);
+        dp[1] = shape;
+        dp[2] = A*(eta*dLdw + (1.0 - eta)*dGdw);
+        dp[3] = A*(L - G);
+    }
+
+    return A*shape;
+}
+
+/* Height of a pseudo-Voigt at its centre */
+static double pseudoVoigtHeight(const double *p)
+{
+    return p[1]*(p[3]*LORENTZ_C/p[2] + (1.0 - p[3])*GAUSS_C/p[2]);
+}
+
+/* Area of a pseudo-Voigt with the given height, FWHM and mixing */
+static double pseudoVoigtArea(double h, double w, double eta)
+{
+    return h*w/(eta*LORENTZ_C + (1.0 - eta)*GAUSS_C);
+}
+
+/* !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+ * Linear algebra
+ * !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!*/
+
+/* ***************************************************************************
+ * method: choleskyDecompose
+ * description: in place Cholesky factorisation of the symmetric positive
+ *   definite n x n matrix a (row major, lower triangle used).  Returns false
+ *   if the matrix is not positive definite.
+ * ***************************************************************************/
+static bool choleskyDecompose(double *a, int n)
+{
+    for (int j = 0; j < n; j++)
+    {
+        double d = a[j*n+j];
+        for (int k = 0; k < j; k++)
+            d -= a[j*n+k]*a[j*n+k];
+
+        if (d <= 0.0) return false;
+        d = sqrt(d);
+        a[j*n+j] = d;
+
+        for (int i = j+1; i < n; i++)
+        {
+            double v = a[i*n+j];
+            for (int k = 0; k < j; k++)
+                v -= a[i*n+k]*a[j*n+k];
+            a[i*n+j] = v/d;
+        }
+    }
+
+    return true;
+}
+
+/* Solves (L L^T) x = b in place using the factor from choleskyDecompose */
+static void choleskySolve(const double *l, int n, double *b)
+{
+    for (int i = 0; i < n; i++)
+    {
+        double v = b[i];
+        for (int k = 0; k < i; k++)
+            v -= l[i*n+k]*b[k];
+        b[i] = v/l[i*n+i];
+    }
+
+    for (int i = n-1; i >= 0; i--)
+    {
+        double v = b[i];
+        for (int k = i+1; k < n; k++)
+            v -= l[k*n+i]*b[k];
+        b[i] = v/l[i*n+i];
+    }
+}
+
+/* !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+ * Cluster fitting
+ * !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!*/
+
+/* A group of overlapping peaks fitted together over points lo..hi */
+struct PeakCluster
+{
+    int lo;
+    int hi;
+    double xc;                  /* background reference position */
+    QVector<double> p;          /* b0, b1, then x0, A, w, eta per peak */
+    QVector<double> esd;
+    bool fitted;
+};
+
+/* ***************************************************************************
+ * class: ClusterFitter
+ * description: function object used with QtConcurrent::mapped to fit one
+ *   cluster by Levenberg-Marquardt.  The model is a linear background plus a
+ *   pseudo-Voigt per peak; the Jacobian is analytic.  Parameter esds come
+ *   from the diagonal of (J^T J)^-1 scaled by the reduced chi squared.
+ * ***************************************************************************/
+struct ClusterFitter
+{
+    typedef PeakCluster result_type;
+
+    const double *x;
+    const double *y;
+    double step;
+
+    /* Evaluates the residuals (and Jacobian if jac is non-zero) and returns
+     * the sum of squared residuals */
+    double evaluate(const PeakCluster &c, const double *p, double *r, double *jac) const
+    {
+        int np = c.p.size();
+        int nPeaks = (np - BG_NPAR)/PV_NPAR;
+        double chi2 = 0.0;
+
+        for (int i = c.lo; i <= c.hi; i++)
+        {
+            int row = i - c.lo;
+            double t = x[i] - c.xc;
+            double f = p[0] + p[1]*t;
+
+            if (jac)
+            {
+                jac[row*np + 0] = 1.0;
+                jac[row*np + 1] = t;
+            }
+
+            for (int k = 0; k < nPeaks; k++)
+            {
+                int o = BG_NPAR + k*PV_NPAR;
+                f += pseudoVoigt(x[i], p + o, jac ? jac + row*np + o : 0);
+            }
+
+            r[row] = y[i] - f;
+            chi2 += r[row]*r[row];
+        }
+
+        return chi2;
+    }
+
+    /* Keeps the parameters physical: positive width and area, eta in [0,1],
+     * and centres inside the fit window */
+    void constrain(const PeakCluster &c, double *p) const
+    {
+        int nPeaks = (c.p.size() - BG_NPAR)/PV_NPAR;
+        for (int k = 0; k < nPeaks; k++)
+        {
+            double *pk = p + BG_NPAR + k*PV_NPAR;
+            pk[0] = qBound(x[c.lo], pk[0], x[c.hi]);
+            pk[1] = qMax(pk[1], 0.0);
+            pk[2] = qMax(pk[2], 0.5*step);
+            pk[3] = qBound(0.0, pk[3], 1.0);
+        }
+    }
+
+    PeakCluster operator()(const PeakCluster &in) const
+    {
+        ScopedTimer timer("peaks.fit");
+        PeakCluster c = in;
+        c.fitted = false;
+
+        int np = c.p.size();
+        int nPts = c.hi - c.lo + 1;
+        if (nPts <= np) return c;
+
+        QVector<double> r(nPts);
+        QVector<double> jac(nPts*np);
+        QVector<double> alpha(np*np);
+        QVector<double> beta(np);
+        QVector<double> trial(np);
+        QVector<double> rTrial(nPts);
+
+        double lm = 1e-3;
+        double chi2 = evaluate(c, c.p.constData(), r.data(), jac.data());
+        bool converged = false;
+
+        for (int iter = 0; iter < LM_MAX_ITERATIONS; iter++)
+        {
+            /* Normal equations J^T J and J^T r */
+            for (int a = 0; a < np; a++)
+            {
+                double b = 0.0;
+                for (int row = 0; row < nPts; row++)
+                    b += jac[row*np + a]*r[row];
+                beta[a] = b;
+
+                for (int bb = 0; bb <= a; bb++)
+                {
+                    double v = 0.0;
+                    for (int row = 0; row < nPts; row++)
+                        v += jac[row*np + a]*jac[row*np + bb];
+                    alpha[a*np + bb] = v;
+                }
+            }
+
+            /* Increase damping until a step lowers chi squared */
+            bool improved = false;
+            while (lm < 1e10)
+            {
+                QVector<double> m = alpha;
+                for (int a = 0; a < np; a++)
+                    m[a*np + a] *= (1.0 + lm);
+
+                for (int a = 0; a < np; a++)
+                    trial[a] = beta[a];
+
+                if (choleskyDecompose(m.data(), np))
+                {
+                    choleskySolve(m.constData(), np, trial.data());
+                    for (int a = 0; a < np; a++)
+                        trial[a] += c.p[a];
+                    constrain(c, trial.data());
+
+                    double chi2Trial = evaluate(c, trial.constData(), rTrial.data(), 0);
+                    if (chi2Trial < chi2)
+                    {
+                        converged = (chi2 - chi2Trial) < 1e-8*chi2;
+                        c.p = trial;
+                        chi2 = evaluate(c, c.p.constData(), r.data(), jac.data());
+                        lm = qMax(lm*0.1, 1e-12);
+                        improved = true;
+                        break;
+                    }
+                }
+
+                lm *= 10.0;
+            }
+
+            if (!improved || converged) break;
+        }
+
+        /* Covariance from the undamped normal matrix at the minimum */
+        for (int a = 0; a < np; a++)
+            for (int bb = 0; bb <= a; bb++)
+            {
+                double v = 0.0;
+                for (int row = 0; row < nPts; row++)
+                    v += jac[row*np + a]*jac[row*np + bb];
+                alpha[a*np + bb] = v;
+            }
+
+        if (!choleskyDecompose(alpha.data(), np)) return c;
+
+        double s2 = chi2/(nPts - np);
+        c.esd.resize(np);
+        QVector<double> col(np);
+        for (int a = 0; a < np; a++)
+        {
+            col.fill(0.0);
+            col[a] = 1.0;
+            choleskySolve(alpha.constData(), np, col.data());
+            c.esd[a] = sqrt(qMax(col[a], 0.0)*s2);
+        }
+
+        c.fitted = true;
+        return c;
+    }
+};
+
+/* !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+ * Peak finding
+ * !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!*/
+
+/* Converts a 2theta position (and esd) to d spacing (and esd) */
+static void setDSpacing(Peak &pk, double lambda)
+{
+    double theta = (M_PI/180.0)*0.5*pk.twoTheta;
+    pk.d = 1e10*lambda/(2.0*sin(theta));
+    pk.dEsd = pk.d*fabs(cos(theta)/sin(theta))*(M_PI/180.0)*0.5*pk.twoThetaEsd;
+}
+
+/* ***************************************************************************
+ * method: findPeaks
+ * description: smooths the curve, detects maxima from the derivative,
+ *   estimates their widths, then groups and fits them.
+ * ***************************************************************************/
+QVector<Peak> findPeaks(const double *x, const double *y, int n, double lambda, bool fitProfiles)
+{
+    ScopedTimer timer("peaks");
+    QVector<Peak> peaks;
+    if (n < 2*SG_HALF_WIDTH + 3) return peaks;
+
+    double step = fabs(x[2] - x[1]);
+    if (step <= 0.0) return peaks;
+
+    QVector<double> s(n);
+    QVector<double> ds(n);
+    smoothSavitzkyGolay(y, n, SG_HALF_WIDTH, s.data(), ds.data());
+
+    /* Noise from the median absolute deviation of the smoothing residual */
+    QVector<double> res(n);
+    double smax = 0.0;
+    for (int i = 0; i < n; i++)
+    {
+        res[i] = fabs(y[i] - s[i]);
+        if (s[i] > smax) smax = s[i];
+    }
+    if (smax <= 0.0) return peaks;
+
+    std::nth_element(res.begin(), res.begin() + n/2, res.end());
+    double noise = 1.4826*res[n/2];
+
+    double threshold = qMax(PEAK_MIN_RELATIVE*smax, PEAK_MIN_SIGMA*noise);
+
+    /* Downward zero crossings of the derivative */
+    QVector<int> centres;
+    QVector<double> widths;
+    for (int i = 1; i < n-1; i++)
+    {
+        if (x[i] <= 0.0) continue;
+        if (!(ds[i] > 0.0 && ds[i+1] <= 0.0)) continue;
+
+        int c = (s[i+1] > s[i]) ? i+1 : i;
+        double h = s[c];
+        if (h <= threshold) continue;
+
+        /* Walk out to half height, stopping at a neighbouring minimum */
+        double half = 0.5*h;
+        int l = c;
+        while (l > 0 && s[l-1] > half && s[l-1] <= s[l]) l--;
+        int r = c;
+        while (r < n-1 && s[r+1] > half && s[r+1] <= s[r]) r++;
+
+        double hwl = -1.0;
+        double hwr = -1.0;
+        if (l > 0 && s[l-1] <= half)
+            hwl = x[c] - (x[l-1] + (half - s[l-1])/(s[l] - s[l-1])*(x[l] - x[l-1]));
+        if (r < n-1 && s[r+1] <= half)
+            hwr = (x[r] + (s[r] - half)/(s[r] - s[r+1])*(x[r+1] - x[r])) - x[c];
+
+        double w;
+        if (hwl > 0.0 && hwr > 0.0) w = hwl + hwr;
+        else if (hwl > 0.0) w = 2.0*hwl;
+        else if (hwr > 0.0) w = 2.0*hwr;
+        else w = (r - l + 1)*step;
+        w = qMax(w, 2.0*step);
+
+        centres.append(c);
+        widths.append(w);
+
+        Peak pk;
+        pk.twoTheta = x[c];
+        pk.height = h;
+        pk.fwhm = w;
+        pk.eta = 0.5;
+        pk.area = pseudoVoigtArea(h, w, pk.eta);
+        peaks.append(pk);
+    }
+
+    if (peaks.isEmpty()) return peaks;
+
+    if (fitProfiles)
+    {
+        /* Group peaks whose fit windows overlap */
+        QVector<PeakCluster> clusters;
+        QVector<int> first;
+        for (int k = 0; k < peaks.size(); k++)
+        {
+            int lo = qMax(0, centres[k] - int(ceil(PEAK_FIT_WINDOW*widths[k]/step)));
+            int hi = qMin(n-1, centres[k] + int(ceil(PEAK_FIT_WINDOW*widths[k]/step)));
+
+            if (!clusters.isEmpty() && lo <= clusters.last().hi)
+            {
+                clusters.last().hi = qMax(clusters.last().hi, hi);
+            }
+            else
+            {
+                PeakCluster c;
+                c.lo = lo;
+                c.hi = hi;
+                c.fitted = false;
+                clusters.append(c);
+                first.append(k);
+            }
+        }
+        first.append(peaks.size());
+
+        for (int ci = 0; ci < clusters.size(); ci++)
+        {
+            PeakCluster &c = clusters[ci];
+            c.xc = 0.5*(x[c.lo] + x[c.hi]);
+
+            /* Background starts as the line through the window end points */
+            double b1 = (x[c.hi] > x[c.lo]) ? (s[c.hi] - s[c.lo])/(x[c.hi] - x[c.lo]) : 0.0;
+            double b0 = s[c.lo] + b1*(c.xc - x[c.lo]);
+            c.p.append(b0);
+            c.p.append(b1);
+
+            for (int k = first[ci]; k < first[ci+1]; k++)
+            {
+                double h = qMax(peaks[k].height - (b0 + b1*(peaks[k].twoTheta - c.xc)), 0.5*peaks[k].height);
+                c.p.append(peaks[k].twoTheta);
+                c.p.append(pseudoVoigtArea(h, peaks[k].fwhm, 0.5));
+                c.p.append(peaks[k].fwhm);
+                c.p.append(0.5);
+            }
+        }
+
+        ClusterFitter fitter;
+        fitter.x = x;
+        fitter.y = y;
+        fitter.step = step;
+
+        QList<PeakCluster> fits = QtConcurrent::blockingMapped<QList<PeakCluster> >(clusters, fitter);
+
+        for (int ci = 0; ci < fits.size(); ci++)
+        {
+            const PeakCluster &c = fits[ci];
+            if (!c.fitted) continue;
+
+            for (int k = first[ci]; k < first[ci+1]; k++)
+            {
+                int o = BG_NPAR + (k - first[ci])*PV_NPAR;
+                Peak &pk = peaks[k];
+                pk.twoTheta = c.p[o];
+                pk.area = c.p[o+1];
+                pk.fwhm = c.p[o+2];
+                pk.eta = c.p[o+3];
+                pk.height = pseudoVoigtHeight(c.p.constData() + o);
+                pk.twoThetaEsd = c.esd[o];
+                pk.areaEsd = c.esd[o+1];
+                pk.fwhmEsd = c.esd[o+2];
+                pk.fitted = true;
+            }
+        }
+    }
+
+    /* Fits that collapsed to nothing are dropped */
+    QVector<Peak> result;
+    double maxArea = 0.0;
+    for (int k = 0; k < peaks.size(); k++)
+    {
+        if (peaks[k].area <= 0.0 || peaks[k].twoTheta <= 0.0) continue;
+        setDSpacing(peaks[k], lambda);
+        result.append(peaks[k]);
+        maxArea = qMax(maxArea, peaks[k].area);
+    }
+
+    for (int k = 0; k < result.size(); k++)
+        result[k].intensity = result[k].area/maxArea;
+
+    qSort(result);
+    return result;
+}
@@ -0,0 +1,78 @@
+/* ***************************************************************************
+ * PeakFinder.h: defines the peak detection and profile fitting engine used
+ *   on integrated diffractograms
+ * ***************************************************************************/
+#ifndef PeakFinder_H
+#define PeakFinder_H
+
+/* !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+ * Headers, definitions, etc.
+ * !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!*/
+
+/* Qt related headers */
+#include <QVector>
+
+/* Half width (in points) of the Savitzky-Golay smoothing window */
+#define SG_HALF_WIDTH 4
+/* Smoothed maxima must be this many noise sigmas high */
+#define PEAK_MIN_SIGMA 3.0
+/* Fraction of the strongest peak below which maxima are ignored */
+#define PEAK_MIN_RELATIVE 0.02
+/* Fit window either side of a peak, in FWHMs */
+#define PEAK_FIT_WINDOW 2.0
+/* Levenberg-Marquardt iteration limit per cluster */
+#define LM_MAX_ITERATIONS 100
+
+/* !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+ * Structures
+ * !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!*/
+
+/* A peak found in a diffractogram.  When fitted is true the position, FWHM,
+ * area and mixing come from a pseudo-Voigt fit and the esd fields hold their
+ * standard deviations; otherwise they are the detection estimates and the
+ * esds are zero. */
+struct Peak
+{
+    double twoTheta;    /* position [deg] */
+    double d;           /* d spacing [ang] */
+    double intensity;   /* area relative to the strongest peak (0..1] */
+    double height;      /* fitted height above the local background */
+    double fwhm;        /* full width at half maximum [deg] */
+    double area;        /* integrated intensity above background */
+    double eta;         /* Lorentzian fraction of the pseudo-Voigt (0..1) */
+
+    double twoThetaEsd;
+    double dEsd;
+    double fwhmEsd;
+    double areaEsd;
+
+    bool fitted;
+
+    Peak() : twoTheta(0.0), d(0.0), intensity(0.0), height(0.0), fwhm(0.0),
+             area(0.0), eta(0.5), twoThetaEsd(0.0), dEsd(0.0), fwhmEsd(0.0),
+             areaEsd(0.0), fitted(false) {}
+};
+
+inline bool operator<(const Peak &p1, const Peak &p2)
+{
+    return p1.d < p2.d;
+}
+
+/* !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+ * Functions
+ * !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!*/
+
+/* Quadratic Savitzky-Golay filter of half width m.  Writes the smoothed
+ * curve to s and, if ds is non-zero, its first derivative per point to ds.
+ * The window shrinks towards the ends of the data. */
+void smoothSavitzkyGolay(const double *y, int n, int m, double *s, double *ds = 0);
+
+/* Finds the peaks of (x, y), x in degrees 2theta and equally spaced.  Peaks
+ * are detected as downward zero crossings of the smoothed derivative that
+ * clear a noise threshold.  If fitProfiles is true, overlapping peaks are
+ * grouped into clusters and each cluster is fitted (in parallel) with
+ * pseudo-Voigt profiles on a linear background.  Returns the peaks sorted by
+ * d spacing. */
+QVector<Peak> findPeaks(const double *x, const double *y, int n, double lambda, bool fitProfiles = true);
+
+#endif
@@ -0,0 +1,181 @@
+/* ***************************************************************************
+ * SearchMatch.cpp: implements the full pattern search-match engine
+ * ***************************************************************************/
+
+/* !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+ * Headers, definitions, etc.
+ * !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!*/
+
+#include "SearchMatch.h"
+
+#include <QtConcurrentMap>
+#include <QtAlgorithms>
+
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+/* !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+ * Search-match
+ * !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!*/
+
+/* ***************************************************************************
+ * class: PhaseScorer
+ * description: function object used with QtConcurrent::mapped to score one
+ *   phase.  Every reference line in the observable range is matched to the
+ *   nearest observed peak (in d).  The figure of merit combines:
+ *     - the intensity weighted fraction of reference lines that were found
+ *       (missing strong lines are what rule a phase out),
+ *     - how well the matched relative intensities agree, and
+ *     - the fraction of observed intensity the phase explains.
+ *   Unexplained observed peaks are only weakly penalised so that minor phases
+ *   of a mixture still score well.
+ * ***************************************************************************/
+struct PhaseScorer
+{
+    typedef SearchMatch result_type;
+
+    const QVector<Peak> *peaks;
+    const QVector<double> *dObs;
+    double dMin;
+    double dMax;
+    double tol;
+    double totalObs;
+
+    SearchMatch operator()(const Mineral *m) const
+    {
+        SearchMatch sm;
+        sm.name = m->name;
+
+        int nObs = dObs->size();
+        if (nObs == 0) return sm;
+
+        QVarLengthArray<char, 256> used(nObs);
+        memset(used.data(), 0, nObs);
+
+        double refTotal = 0.0;
+        double refMatched = 0.0;
+        double obsMatched = 0.0;
+        double sumOR = 0.0;
+        double sumRR = 0.0;
+        QVarLengthArray<double, 64> mObs;
+        QVarLengthArray<double, 64> mRef;
+
+        int nLines = qMin(m->nLines, m->lines.count());
+        for (int j = 0; j < nLines; j++)
+        {
+            double d = m->lines[j];
+            double I = m->intensities[j];
+            if (d < dMin || d > dMax) continue;
+
+            sm.nExpected++;
+            refTotal += I;
+
+            /* Nearest observed peak by binary search */
+            int k = std::lower_bound(dObs->constBegin(), dObs->constEnd(), d) - dObs->constBegin();
+            int best = -1;
+            double bestDiff = 1e20;
+            if (k < nObs && fabs(dObs->at(k) - d) < bestDiff) { best = k; bestDiff = fabs(dObs->at(k) - d); }
+            if (k > 0 && fabs(dObs->at(k-1) - d) < bestDiff) { best = k-1; bestDiff = fabs(dObs->at(k-1) - d); }
+
+            double rel = bestDiff/d;
+            if (best < 0 || rel > tol) continue;
+
+            /* A match at the edge of the tolerance counts half */
+            refMatched += I*(1.0 - 0.5*rel/tol);
+            sm.nMatched++;
+
+            double io = peaks->at(best).intensity;
+            if (!used[best])
+            {
+                obsMatched += io;
+                used[best] = 1;
+            }
+
+            mObs.append(io);
+            mRef.append(I);
+            sumOR += io*I;
+            sumRR += I*I;
+        }
+
+        if (sm.nExpected == 0 || refTotal <= 0.0) return sm;
+        if (sm.nMatched < qMin(3, sm.nExpected)) return sm;
+
+        /* Least squares scale of reference to observed, then normalised
+         * absolute intensity residual */
+        double s = (sumRR > 0.0) ? sumOR/sumRR : 0.0;
+        double num = 0.0;
+        double den = 0.0;
+        for (int i = 0; i < mObs.size(); i++)
+        {
+            num += fabs(mObs[i] - s*mRef[i]);
+            den += mObs[i] + s*mRef[i];
+        }
+
+        sm.lineFraction = refMatched/refTotal;
+        sm.intensityAgreement = (den > 0.0) ? qMax(0.0, 1.0 - num/den) : 0.0;
+        sm.peakFraction = (totalObs > 0.0) ? obsMatched/totalObs : 0.0;
+        sm.fom = 100.0*sm.lineFraction*(0.75 + 0.25*sm.intensityAgreement)*(0.75 + 0.25*sm.peakFraction);
+
+        return sm;
+    }
+};
+
+/* ***************************************************************************
+ * method: searchMatch
+ * description: filters the database on chemistry (bitset AND/ANDNOT), scores
+ *   the remaining phases in parallel and returns the ranked matches.
+ * ***************************************************************************/
+QList<SearchMatch> searchMatch(const QMap<QString, Mineral> &db,
+                               const QVector<Peak> &peaks,
+                               double dMin, double dMax, double tol,
+                               const ElementSet &required, const ElementSet &excluded,
+                               int maxResults, double minFom)
+{
+    QList<SearchMatch> ranked;
+    if (peaks.isEmpty() || tol <= 0.0) return ranked;
+
+    QVector<const Mineral *> candidates;
+    candidates.reserve(db.count());
+
+    QMap<QString, Mineral>::const_iterator it;
+    for (it = db.constBegin(); it != db.constEnd(); ++it)
+    {
+        const ElementSet &elements = it.value().elements;
+        if (!elements.containsAll(required) || elements.intersects(excluded))
+            continue;
+
+        candidates.append(&it.value());
+    }
+
+    QVector<double> dObs(peaks.size());
+    double totalObs = 0.0;
+    for (int i = 0; i < peaks.size(); i++)
+    {
+        dObs[i] = peaks[i].d;
+        totalObs += peaks[i].intensity;
+    }
+
+    PhaseScorer scorer;
+    scorer.peaks = &peaks;
+    scorer.dObs = &dObs;
+    scorer.dMin = dMin;
+    scorer.dMax = dMax;
+    scorer.tol = tol;
+    scorer.totalObs = totalObs;
+
+    QList<SearchMatch> scores = QtConcurrent::blockingMapped<QList<SearchMatch> >(candidates, scorer);
+
+    for (int i = 0; i < scores.count(); i++)
+    {
+        if (scores[i].fom >= minFom)
+            ranked.append(scores[i]);
+    }
+
+    qSort(ranked.begin(), ranked.end(), betterMatch);
+
+    while (ranked.count() > maxResults)
+        ranked.removeLast();
+
+    return ranked;
+}
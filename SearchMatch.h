@@ -0,0 +1,102 @@
+/* ***************************************************************************
+ * SearchMatch.h: defines the mineral database types and a full pattern
+ *   search-match engine
+ * ***************************************************************************/
+#ifndef SearchMatch_H
+#define SearchMatch_H
+
+/* !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+ * Headers, definitions, etc.
+ * !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!*/
+
+/* Qt related headers */
+#include <QString>
+#include <QList>
+#include <QMap>
+#include <QVector>
+#include <QVarLengthArray>
+
+#include "PeakFinder.h"
+
+/* Number of element slots in an ElementSet (two 64 bit words) */
+#define MAX_ELEMENTS 128
+
+/* !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+ * Structures
+ * !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!*/
+
+/* Set of chemical elements, one bit per element.  Bit positions are the
+ * indices returned by TwoThetaWindow::elementIndex(). */
+struct ElementSet
+{
+    quint64 bits[2];
+
+    ElementSet() { bits[0] = 0; bits[1] = 0; }
+
+    void insert(int i) { bits[i >> 6] |= Q_UINT64_C(1) << (i & 63); }
+    bool isEmpty() const { return (bits[0] | bits[1]) == 0; }
+
+    /* True if every element of o is in this set (AND) */
+    bool containsAll(const ElementSet &o) const
+    {
+        return (bits[0] & o.bits[0]) == o.bits[0] && (bits[1] & o.bits[1]) == o.bits[1];
+    }
+
+    /* True if any element of o is in this set (used with ANDNOT queries) */
+    bool intersects(const ElementSet &o) const
+    {
+        return ((bits[0] & o.bits[0]) | (bits[1] & o.bits[1])) != 0;
+    }
+};
+
+struct Mineral
+{
+    QString name;
+    ElementSet elements;
+    QString formula;
+    QVarLengthArray<double> lines;
+    QVarLengthArray<double> intensities;
+    int nLines;
+};
+
+inline bool operator<(const Mineral &m1, const Mineral &m2)
+{
+    return m1.name < m2.name;
+}
+
+/* Score of one database phase against the observed pattern */
+struct SearchMatch
+{
+    QString name;
+    double fom;             /* figure of merit, 0 (no match) to 100 */
+    double lineFraction;    /* intensity weighted fraction of reference lines found */
+    double peakFraction;    /* fraction of observed intensity explained */
+    double intensityAgreement;
+    int nMatched;
+    int nExpected;
+
+    SearchMatch() : fom(0.0), lineFraction(0.0), peakFraction(0.0),
+                    intensityAgreement(0.0), nMatched(0), nExpected(0) {}
+};
+
+/* Orders matches best first, for qSort */
+inline bool betterMatch(const SearchMatch &m1, const SearchMatch &m2)
+{
+    return m1.fom > m2.fom;
+}
+
+/* !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+ * Functions
+ * !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!*/
+
+/* Scores every phase in db (that satisfies the chemistry constraints) against
+ * the observed peaks, in parallel.  Observed d spacings must lie between
+ * dMin and dMax.  tol is the relative d tolerance (e.g. 0.02).  Returns at
+ * most maxResults matches with fom >= minFom, best first. */
+QList<SearchMatch> searchMatch(const QMap<QString, Mineral> &db,
+                               const QVector<Peak> &peaks,
+                               double dMin, double dMax, double tol,
+                               const ElementSet &required, const ElementSet &excluded,
+                               int maxResults = 50, double minFom = 10.0);
+
+#endif
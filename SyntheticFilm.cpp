@@ -0,0 +1,352 @@
+/* ***************************************************************************
+ * SyntheticFilm.cpp: implements the synthetic Gandolfi film generator
+ * ***************************************************************************/
+
+/* !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+ * Headers, definitions, etc.
+ * !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!*/
+
+#include "SyntheticFilm.h"
+#include "ConfigFile/ConfigFile.h"
+
+#include <QtConcurrentMap>
+#include <QtAlgorithms>
+
+#include <cmath>
+#include <fstream>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+/* A bright grain, in view (loop) coordinates */
+struct SyntheticSpot
+{
+    double x;
+    double y;
+    double height;
+};
+
+inline bool operator<(const SyntheticSpot &s1, const SyntheticSpot &s2)
+{
+    return s1.y < s2.y;
+}
+
+/* A range of film rows for one rendering task */
+struct SyntheticRows
+{
+    int first;
+    int last;
+};
+
+/* Linear congruential generator, so a seed gives the same film everywhere */
+static double uniform(unsigned int &s)
+{
+    s = s*1103515245u + 12345u;
+    return ((s >> 8) & 0xffffff)/double(0x1000000);
+}
+
+static double gaussian(unsigned int &s)
+{
+    double u = qMax(uniform(s), 1e-12);
+    double v = uniform(s);
+    return sqrt(-2.0*log(u))*cos(2.0*M_PI*v);
+}
+
+/* ConfigFile writes doubles with six digits, too few for dpm */
+static std::string exact(double v)
+{
+    return QString::number(v, 'g', 15).toStdString();
+}
+
+/* 2theta of view pixel (x, y) exactly as integrationKernel computes it */
+template <class Formula>
+static double pixelTwoTheta(const KernelParams &p, double x, double y)
+{
+    double L = (y - p.LOffset)/p.dpm;
+    double twoTheta = Formula::twoTheta(p, Formula::row(p, L), (x - p.cOffset)/p.dpm);
+    return (L > p.foldL) ? 180.0 - twoTheta : twoTheta;
+}
+
+/* ***************************************************************************
+ * class: SyntheticRenderer
+ * description: function object used with QtConcurrent::map.  Renders a
+ *   block of film rows.  The noise of each row is seeded from the row, so
+ *   the film does not depend on how the rows are shared between threads.
+ * ***************************************************************************/
+struct SyntheticRenderer
+{
+    typedef void result_type;
+
+    const SyntheticFilmSpec *spec;
+    KernelParams p;
+    bool tilted;
+    QPointF stop0;
+    QPointF stop180;
+    double stopRadius;
+    const QVector<SyntheticSpot> *spots;
+    uchar *bits;
+    int bytesPerLine;
+
+    double intensity(double x, double y) const
+    {
+        if (stopRadius > 0.0)
+        {
+            double d0 = (x - stop0.x())*(x - stop0.x()) + (y - stop0.y())*(y - stop0.y());
+            double d180 = (x - stop180.x())*(x - stop180.x()) + (y - stop180.y())*(y - stop180.y());
+            if (qMin(d0, d180) < stopRadius*stopRadius)
+                return spec->beamStopLevel;
+        }
+
+        double tt = tilted ? pixelTwoTheta<Tilted>(p, x, y) : pixelTwoTheta<ZeroTilt>(p, x, y);
+        double v = spec->background + spec->airScatter*exp(-qMin(tt, 180.0 - tt)/SYNTHETIC_AIR_SCALE);
+
+        for (int k = 0; k < spec->lines.size(); k++)
+        {
+            const SyntheticLine &line = spec->lines.at(k);
+            double d = (tt - line.twoTheta)/line.fwhm;
+            if (fabs(d) < 3.0) v += line.height*exp(-4.0*log(2.0)*d*d);
+        }
+
+        return v;
+    }
+
+    void operator()(const SyntheticRows &rows) const
+    {
+        double r = spec->spotRadius;
+        double reach = 4.0*r;
+
+        for (int fy = rows.first; fy < rows.last; fy++)
+        {
+            unsigned int seed = spec->seed*2654435761u + unsigned(fy)*40503u + 1u;
+            uchar *row = bits + fy*bytesPerLine;
+
+            /* First grain that can reach this row (y is linear along it) */
+            double yFirst = -(0 - p.ox)*p.sa + (fy - p.oy)*p.ca;
+            double yLast = -(spec->width - 1 - p.ox)*p.sa + (fy - p.oy)*p.ca;
+            SyntheticSpot lowest;
+            lowest.y = qMin(yFirst, yLast) - reach;
+            int first = qLowerBound(spots->begin(), spots->end(), lowest) - spots->begin();
+
+            for (int fx = 0; fx < spec->width; fx++)
+            {
+                /* Back through the alpha rotation of AffineMap */
+                double x = (fx - p.ox)*p.ca + (fy - p.oy)*p.sa;
+                double y = -(fx - p.ox)*p.sa + (fy - p.oy)*p.ca;
+
+                double v = intensity(x, y);
+
+                for (int s = first; s < spots->size(); s++)
+                {
+                    const SyntheticSpot &spot = spots->at(s);
+                    if (spot.y > y + reach) break;
+
+                    double d2 = (x - spot.x)*(x - spot.x) + (y - spot.y)*(y - spot.y);
+                    if (d2 < reach*reach) v += spot.height*exp(-0.5*d2/(r*r));
+                }
+
+                if (spec->noise > 0.0) v += spec->noise*gaussian(seed);
+
+                int g = qBound(0, int(v + 0.5), 255);
+                row[fx] = uchar(spec->negative ? 255 - g : g);
+            }
+        }
+    }
+};
+
+/* !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+ * Methods
+ * !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!*/
+
+SyntheticFilmSpec::SyntheticFilmSpec()
+    : width(0), height(0), dpm(0.0), radius(0.1146/2.0), phi(0.0), alpha(0.0),
+      background(20.0), airScatter(30.0), noise(4.0),
+      spots(0), spotHeight(80.0), spotRadius(2.0),
+      beamStopRadius(0.0), beamStopLevel(5.0),
+      negative(true), seed(1)
+{
+    lines = quartzLines();
+}
+
+SyntheticFilmSpec SyntheticFilmSpec::standard(int dpi, double radius)
+{
+    SyntheticFilmSpec spec;
+    spec.dpm = dpi/0.0254;
+    spec.radius = radius;
+
+    int margin = int(0.055*spec.dpm);
+    spec.width = int(0.035*spec.dpm);
+    spec.height = int(M_PI*radius*spec.dpm) + 2*margin;
+    spec.zeroDegreeCenter = QPoint(spec.width/2, margin);
+
+    return spec;
+}
+
+/* !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+ * Functions
+ * !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!*/
+
+QVector<SyntheticLine> quartzLines()
+{
+    static const double q[][2] = { {20.86, 35}, {26.64, 100}, {36.54, 12}, {39.47, 12},
+                                   {40.29, 6}, {42.45, 9}, {45.79, 6}, {50.14, 17},
+                                   {54.87, 8}, {59.96, 14}, {64.04, 4}, {67.74, 7},
+                                   {68.14, 10}, {75.66, 4}, {81.49, 4} };
+
+    QVector<SyntheticLine> lines;
+    for (unsigned int i = 0; i < sizeof(q)/sizeof(q[0]); i++)
+        lines.append(SyntheticLine(q[i][0], 1.8*q[i][1], 0.2));
+
+    return lines;
+}
+
+SyntheticTruth syntheticTruth(const SyntheticFilmSpec &spec)
+{
+    SyntheticTruth t;
+    t.zeroDegreeCenter = spec.zeroDegreeCenter;
+    t.oneEightyDegreeCenter = QPoint(spec.zeroDegreeCenter.x(), spec.zeroDegreeCenter.y() + M_PI*spec.radius*spec.dpm);
+    t.radius = spec.radius;
+    t.phi = spec.phi;
+    t.alpha = spec.alpha;
+    t.dpm = spec.dpm;
+
+    return t;
+}
+
+QRect syntheticIntArea(const SyntheticFilmSpec &spec)
+{
+    QRect intArea;
+    intArea.setX(spec.zeroDegreeCenter.x() - (0.0254*spec.dpm)/2.0);
+    intArea.setY(spec.zeroDegreeCenter.y());
+    intArea.setWidth(0.0254*spec.dpm);
+    intArea.setHeight(M_PI*spec.radius*spec.dpm);
+
+    return intArea;
+}
+
+KernelParams syntheticKernelParams(const SyntheticFilmSpec &spec)
+{
+    QRect intArea = syntheticIntArea(spec);
+
+    KernelParams p;
+    p.loop = intArea;
+    p.cOffset = intArea.x() + intArea.width()/2.0;
+    p.LOffset = intArea.y();
+    p.foldL = intArea.height()/(2.0*spec.dpm);
+    p.dpm = spec.dpm;
+    p.R = spec.radius;
+    p.setAngles(spec.phi, spec.alpha, spec.height);
+
+    return p;
+}
+
+/* ***************************************************************************
+ * function: renderSyntheticFilm
+ * description: grains are put on random lines near the film's center line
+ *   (where 2theta is about L/R) on either side of the 90 degree fold.
+ * ***************************************************************************/
+QImage renderSyntheticFilm(const SyntheticFilmSpec &spec)
+{
+    if (spec.width <= 0 || spec.height <= 0 || spec.dpm <= 0.0)
+        return QImage();
+
+    QImage image(spec.width, spec.height, QImage::Format_Indexed8);
+    QVector<QRgb> grays(256);
+    for (int i = 0; i < 256; i++)
+        grays[i] = qRgb(i, i, i);
+    image.setColorTable(grays);
+    image.setDotsPerMeterX(int(spec.dpm + 0.5));
+    image.setDotsPerMeterY(int(spec.dpm + 0.5));
+
+    SyntheticTruth truth = syntheticTruth(spec);
+
+    QVector<SyntheticSpot> spots;
+    unsigned int seed = spec.seed;
+    for (int i = 0; i < spec.spots && !spec.lines.isEmpty(); i++)
+    {
+        const SyntheticLine &line = spec.lines.at(int(uniform(seed)*spec.lines.size()) % spec.lines.size());
+        double L = spec.radius*line.twoTheta*M_PI/180.0*spec.dpm;
+
+        SyntheticSpot s;
+        s.x = spec.zeroDegreeCenter.x() + (uniform(seed) - 0.5)*0.0254*spec.dpm;
+        s.y = (uniform(seed) < 0.5) ? truth.zeroDegreeCenter.y() + L : truth.oneEightyDegreeCenter.y() - L;
+        s.height = spec.spotHeight*(0.5 + uniform(seed));
+        spots.append(s);
+    }
+    qSort(spots);
+
+    SyntheticRenderer renderer;
+    renderer.spec = &spec;
+    renderer.p = syntheticKernelParams(spec);
+    renderer.tilted = (selectKernel(spec.phi, spec.alpha) & TiltOnlyKernel) != 0;
+    renderer.stop0 = truth.zeroDegreeCenter;
+    renderer.stop180 = truth.oneEightyDegreeCenter;
+    renderer.stopRadius = spec.beamStopRadius*spec.dpm;
+    renderer.spots = &spots;
+    renderer.bits = image.bits();
+    renderer.bytesPerLine = image.bytesPerLine();
+
+    QVector<SyntheticRows> blocks;
+    for (int y = 0; y < spec.height; y += SYNTHETIC_ROW_BLOCK)
+    {
+        SyntheticRows b;
+        b.first = y;
+        b.last = qMin(y + SYNTHETIC_ROW_BLOCK, spec.height);
+        blocks.append(b);
+    }
+
+    QtConcurrent::blockingMap(blocks, renderer);
+
+    return image;
+}
+
+bool writeSyntheticTruth(const SyntheticFilmSpec &spec, const QString &fileName)
+{
+    SyntheticTruth t = syntheticTruth(spec);
+
+    ConfigFile config;
+    config.add("zero_degree_center_x", t.zeroDegreeCenter.x());
+    config.add("zero_degree_center_y", t.zeroDegreeCenter.y());
+    config.add("oneeighty_degree_center_x", t.oneEightyDegreeCenter.x());
+    config.add("oneeighty_degree_center_y", t.oneEightyDegreeCenter.y());
+    config.add("camera_radius", exact(t.radius));
+    config.add("phi", exact(t.phi));
+    config.add("alpha", exact(t.alpha));
+    config.add("dpm", exact(t.dpm));
+    config.add("noise", exact(spec.noise));
+    config.add("spots", spec.spots);
+    config.add("beam_stop_radius", exact(spec.beamStopRadius));
+    config.add("seed", spec.seed);
+
+    std::ofstream out(fileName.toStdString().c_str());
+    if (!out) return false;
+
+    out << config;
+    return true;
+}
+
+bool readSyntheticTruth(const QString &fileName, SyntheticTruth &truth)
+{
+    try
+    {
+        ConfigFile config(fileName.toStdString());
+
+        int x0 = 0, y0 = 0, x180 = 0, y180 = 0;
+        bool ok = config.readInto(x0, "zero_degree_center_x") &&
+                  config.readInto(y0, "zero_degree_center_y") &&
+                  config.readInto(x180, "oneeighty_degree_center_x") &&
+                  config.readInto(y180, "oneeighty_degree_center_y") &&
+                  config.readInto(truth.radius, "camera_radius") &&
+                  config.readInto(truth.dpm, "dpm");
+        config.readInto(truth.phi, "phi", 0.0);
+        config.readInto(truth.alpha, "alpha", 0.0);
+
+        truth.zeroDegreeCenter = QPoint(x0, y0);
+        truth.oneEightyDegreeCenter = QPoint(x180, y180);
+        return ok;
+    }
+    catch (ConfigFile::file_not_found &)
+    {
+        return false;
+    }
+}
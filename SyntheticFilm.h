@@ -0,0 +1,128 @@
+/* ***************************************************************************
+ * SyntheticFilm.h: defines a generator of Gandolfi films with known geometry
+ *   for benchmarks and for checking the optimizers
+ * ***************************************************************************/
+#ifndef SyntheticFilm_H
+#define SyntheticFilm_H
+
+/* !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+ * Headers, definitions, etc.
+ * !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!*/
+
+/* Qt related headers */
+#include <QImage>
+#include <QPoint>
+#include <QRect>
+#include <QString>
+#include <QVector>
+
+#include "IntegrationKernel.h"
+
+/* Rows of the film handed to each rendering task */
+#define SYNTHETIC_ROW_BLOCK 32
+
+/* Low angle background falls off over this many degrees */
+#define SYNTHETIC_AIR_SCALE 10.0
+
+/* !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+ * Structures
+ * !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!*/
+
+/* A Debye-Scherrer cone: Gaussian profile of the given FWHM [deg] and peak
+ * height above the background [gray levels] */
+struct SyntheticLine
+{
+    double twoTheta;
+    double height;
+    double fwhm;
+
+    SyntheticLine(double tt = 0.0, double h = 0.0, double w = 0.1) : twoTheta(tt), height(h), fwhm(w) {}
+};
+
+/* ***************************************************************************
+ * struct: SyntheticFilmSpec
+ * description: everything that goes into a synthetic film.  The geometry is
+ *   what FilmWidget holds once it is found: the 0 degree center in view
+ *   pixels, the camera radius [m], phi and alpha [deg].  The 180 degree
+ *   center lies pi*radius*dpm below the 0 degree one, as FilmWidget places
+ *   it.  Gray levels are given as analysed (lines bright); negative films
+ *   are written dark on light, as scanned, and FilmWidget inverts them back
+ *   when they are opened.
+ * ***************************************************************************/
+struct SyntheticFilmSpec
+{
+    int width;
+    int height;
+    double dpm;
+    double radius;
+    QPoint zeroDegreeCenter;
+    double phi;
+    double alpha;
+
+    QVector<SyntheticLine> lines;
+
+    double background;          /* flat background [gray levels] */
+    double airScatter;          /* extra background at 0 degrees */
+    double noise;               /* Gaussian noise sigma [gray levels] */
+
+    int spots;                  /* bright grains on random lines */
+    double spotHeight;
+    double spotRadius;          /* [pixels] */
+
+    double beamStopRadius;      /* shadows at both centers [m], 0 for none */
+    double beamStopLevel;       /* gray level in the shadow */
+
+    bool negative;
+    unsigned int seed;
+
+    SyntheticFilmSpec();
+
+    /* 35 mm wide film at dpi, the 0 degree center 55 mm from the top and
+     * the 180 degree center as far from the bottom, so the symmetry regions
+     * (reaching two inches from a center) lie on the film */
+    static SyntheticFilmSpec standard(int dpi, double radius = 0.1146/2.0);
+};
+
+/* The geometry of a synthetic film as FilmWidget would hold it */
+struct SyntheticTruth
+{
+    QPoint zeroDegreeCenter;
+    QPoint oneEightyDegreeCenter;
+    double radius;
+    double phi;
+    double alpha;
+    double dpm;
+
+    SyntheticTruth() : radius(0.0), phi(0.0), alpha(0.0), dpm(0.0) {}
+};
+
+/* !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+ * Functions
+ * !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!*/
+
+/* Strongest lines of quartz (Cu K alpha) */
+QVector<SyntheticLine> quartzLines();
+
+/* Ground truth of spec */
+SyntheticTruth syntheticTruth(const SyntheticFilmSpec &spec);
+
+/* FilmWidget::updateIntArea for the true centers: one inch wide, from the
+ * 0 degree center to the 180 degree center */
+QRect syntheticIntArea(const SyntheticFilmSpec &spec);
+
+/* The parameters FilmWidget::integrate uses on the film at the true
+ * geometry, which are also those the film is rendered with */
+KernelParams syntheticKernelParams(const SyntheticFilmSpec &spec);
+
+/* Renders spec into an 8 bit gray image (in parallel over blocks of rows)
+ * carrying spec.dpm as its resolution.  Each film pixel is taken back
+ * through the alpha rotation of AffineMap and given the 2theta of the
+ * integration kernel, so integrating at the true geometry recovers the
+ * lines exactly. */
+QImage renderSyntheticFilm(const SyntheticFilmSpec &spec);
+
+/* Ground truth as a ConfigFile (key = value) */
+bool writeSyntheticTruth(const SyntheticFilmSpec &spec, const QString &fileName);
+bool readSyntheticTruth(const QString &fileName, SyntheticTruth &truth);
+
+#endif
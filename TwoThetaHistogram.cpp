@@ -0,0 +1,355 @@
+/* ***************************************************************************
+ * TwoThetaHistogram.cpp: implements the master 2theta histogram
+ * ***************************************************************************/
+
+/* !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+ * Headers, definitions, etc.
+ * !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!*/
+
+#include "TwoThetaHistogram.h"
+
+#include <QtConcurrentMap>
+
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+/* Output bins handed to each robust estimation task */
+#define ROBUST_BLOCK 256
+
+/* ***************************************************************************
+ * method: sketchQuantile
+ * description: estimates quantile q from a bucket sketch holding n values by
+ *   interpolating linearly inside the bucket that contains it, then clamps
+ *   to the exact min and max.
+ * ***************************************************************************/
+static double sketchQuantile(const quint32 *buckets, double n, double q, double lo, double hi)
+{
+    double target = q*n;
+    double cum = 0.0;
+    int width = 1 << SKETCH_SHIFT;
+
+    for (int b = 0; b < SKETCH_BUCKETS; b++)
+    {
+        if (buckets[b] == 0) continue;
+
+        if (cum + buckets[b] >= target)
+        {
+            double v = b*width + width*(target - cum)/buckets[b];
+            return qBound(lo, v, hi);
+        }
+
+        cum += buckets[b];
+    }
+
+    return hi;
+}
+
+/* Median of v[0..n), reordering v */
+static double selectMedian(quint8 *v, int n)
+{
+    std::nth_element(v, v + n/2, v + n);
+    double m = v[n/2];
+
+    if (n % 2 == 0)
+        m = 0.5*(m + *std::max_element(v, v + n/2));
+
+    return m;
+}
+
+/* ***************************************************************************
+ * method: clippedMean
+ * description: iterative sigma clipping about the median.  Values further
+ *   than k standard deviations from the median are moved to the end and
+ *   dropped, until none are rejected; returns the mean of the rest and sets
+ *   esd to its standard error.
+ * ***************************************************************************/
+static double clippedMean(quint8 *v, int n, double k, double &esd)
+{
+    for (int iter = 0; iter < CLIP_MAX_ITERATIONS; iter++)
+    {
+        double centre = selectMedian(v, n);
+
+        double sum = 0.0;
+        double sum2 = 0.0;
+        for (int i = 0; i < n; i++)
+        {
+            sum += v[i];
+            sum2 += double(v[i])*v[i];
+        }
+        double mean = sum/n;
+        double sd = sqrt(qMax(sum2/n - mean*mean, 0.0));
+        if (sd == 0.0) break;
+
+        double limit = k*sd;
+        int kept = 0;
+        for (int i = 0; i < n; i++)
+        {
+            if (fabs(v[i] - centre) <= limit)
+                v[kept++] = v[i];
+        }
+
+        if (kept == n || kept == 0) break;
+        n = kept;
+    }
+
+    double sum = 0.0;
+    for (int i = 0; i < n; i++)
+        sum += v[i];
+    double mean = sum/n;
+
+    double m2 = 0.0;
+    for (int i = 0; i < n; i++)
+        m2 += (v[i] - mean)*(v[i] - mean);
+    esd = (n > 1) ? sqrt(m2/(n - 1.0)/n) : 0.0;
+
+    return mean;
+}
+
+/* A range of output bins for one robust estimation task */
+struct RobustBlock
+{
+    int first;
+    int last;
+};
+
+/* ***************************************************************************
+ * class: RobustEstimator
+ * description: function object used with QtConcurrent::map.  Each output
+ *   bin's samples are copied from the arena into scratch space and reduced
+ *   with nth_element based selection rather than a full sort.
+ * ***************************************************************************/
+struct RobustEstimator
+{
+    typedef void result_type;
+
+    const quint8 *arena;
+    const int *offsets;
+    const int *kLo;
+    const int *kHi;
+    double *centre;
+    double *esd;            /* clipped mode: standard error of the kept samples */
+    int mode;
+    double clipSigma;
+
+    void operator()(const RobustBlock &b) const
+    {
+        QVector<quint8> scratch;
+
+        for (int i = b.first; i < b.last; i++)
+        {
+            if (kLo[i] < 0) continue;
+
+            int begin = offsets[kLo[i]];
+            int n = offsets[kHi[i]+1] - begin;
+            if (n == 0) continue;
+
+            scratch.resize(n);
+            memcpy(scratch.data(), arena + begin, n);
+
+            if (mode == MedianIntegration)
+                centre[i] = selectMedian(scratch.data(), n);
+            else
+                centre[i] = clippedMean(scratch.data(), n, clipSigma, esd[i]);
+        }
+    }
+};
+
+/* ***************************************************************************
+ * method: reset
+ * description: uses MASTER_STEP when the requested resolution rebins from it
+ *   exactly, otherwise half the resolution (which always does).
+ * ***************************************************************************/
+void TwoThetaHistogram::reset(double resolution, int mode, double clipSigma)
+{
+    this->mode = mode;
+    this->clipSigma = clipSigma;
+
+    double ratio = resolution/(2.0*MASTER_STEP);
+    if (ratio >= 1.0 && fabs(ratio - floor(ratio + 0.5)) < 1e-6)
+        step = MASTER_STEP;
+    else
+        step = 0.5*resolution;
+
+    size = int(180.0/step + 0.5) + 1;
+
+    counts.fill(0.0, size);
+    means.fill(0.0, size);
+    m2s.fill(0.0, size);
+    mins.fill(255, size);
+    maxs.fill(0, size);
+    sketch.fill(0, size*SKETCH_BUCKETS);
+
+    sampleBins.clear();
+    sampleValues.clear();
+    arena.clear();
+    offsets.clear();
+}
+
+/* ***************************************************************************
+ * method: finish
+ * description: counting sort of the kept samples into the arena using the
+ *   bin counts as offsets.  The unsorted samples are released.
+ * ***************************************************************************/
+void TwoThetaHistogram::finish()
+{
+    if (mode == MeanIntegration)
+        return;
+
+    offsets.resize(size+1);
+    offsets[0] = 0;
+    for (int k = 0; k < size; k++)
+        offsets[k+1] = offsets[k] + int(counts[k]);
+
+    arena.resize(offsets[size]);
+    QVector<int> next = offsets;
+    for (int j = 0; j < sampleBins.size(); j++)
+        arena[next[sampleBins[j]]++] = sampleValues[j];
+
+    sampleBins = QVector<int>();
+    sampleValues = QVector<quint8>();
+}
+
+bool TwoThetaHistogram::isExact(double resolution) const
+{
+    double ratio = resolution/(2.0*step);
+    return ratio >= 1.0 && fabs(ratio - floor(ratio + 0.5)) < 1e-6;
+}
+
+/* ***************************************************************************
+ * method: result
+ * description: each master bin is merged into the output bin containing its
+ *   centre.  For exact steps this is the same as merging the master bins
+ *   between the output bin edges.  In the robust modes the bin intensity is
+ *   then replaced by the median or clipped mean, in parallel over blocks of
+ *   bins.
+ * ***************************************************************************/
+IntegrationResult TwoThetaHistogram::result(double resolution) const
+{
+    IntegrationResult r;
+    r.step = resolution;
+    r.exact = isExact(resolution);
+
+    int n = binCount(resolution);
+    r.x.resize(n);
+    r.mean.resize(n);
+    r.count.fill(0.0, n);
+    r.variance.resize(n);
+    r.esd.resize(n);
+    r.min.resize(n);
+    r.max.resize(n);
+    r.q05.resize(n);
+    r.q50.resize(n);
+    r.q95.resize(n);
+
+    QVector<double> mu(n, 0.0);
+    QVector<double> m2(n, 0.0);
+    QVector<int> lo(n, 255);
+    QVector<int> hi(n, 0);
+    QVector<quint32> sk(n*SKETCH_BUCKETS, 0);
+    QVector<int> kLo(n, -1);
+    QVector<int> kHi(n, -1);
+
+    for (int k = 0; k < size; k++)
+    {
+        int i = int(floor((k + 0.5)*step/resolution + 0.5));
+        if (i >= n) continue;
+
+        if (kLo[i] < 0) kLo[i] = k;
+        kHi[i] = k;
+
+        if (counts[k] == 0.0) continue;
+
+        /* Chan et al. merge of (count, mean, M2) */
+        double na = r.count[i];
+        double nb = counts[k];
+        double nab = na + nb;
+        double delta = means[k] - mu[i];
+        mu[i] += delta*nb/nab;
+        m2[i] += m2s[k] + delta*delta*na*nb/nab;
+        r.count[i] = nab;
+        lo[i] = qMin(lo[i], mins[k]);
+        hi[i] = qMax(hi[i], maxs[k]);
+
+        const quint32 *src = sketch.constData() + k*SKETCH_BUCKETS;
+        quint32 *dst = sk.data() + i*SKETCH_BUCKETS;
+        for (int b = 0; b < SKETCH_BUCKETS; b++)
+            dst[b] += src[b];
+    }
+
+    bool robust = (mode != MeanIntegration && offsets.size() == size+1);
+    QVector<double> centre;
+    QVector<double> clippedEsd;
+
+    if (robust)
+    {
+        centre.fill(0.0, n);
+        clippedEsd.fill(0.0, n);
+
+        QVector<RobustBlock> blocks;
+        for (int i = 0; i < n; i += ROBUST_BLOCK)
+        {
+            RobustBlock b;
+            b.first = i;
+            b.last = qMin(i + ROBUST_BLOCK, n);
+            blocks.append(b);
+        }
+
+        RobustEstimator estimator;
+        estimator.arena = arena.constData();
+        estimator.offsets = offsets.constData();
+        estimator.kLo = kLo.constData();
+        estimator.kHi = kHi.constData();
+        estimator.centre = centre.data();
+        estimator.esd = clippedEsd.data();
+        estimator.mode = mode;
+        estimator.clipSigma = clipSigma;
+
+        QtConcurrent::blockingMap(blocks, estimator);
+    }
+
+    for (int i = 0; i < n; i++)
+    {
+        r.x[i] = i*resolution;
+
+        if (r.count[i] != 0.0)
+        {
+            r.mean[i] = robust ? centre[i] : mu[i];
+            r.variance[i] = (r.count[i] > 1.0) ? m2[i]/(r.count[i] - 1.0) : 0.0;
+            r.esd[i] = sqrt(r.variance[i]/r.count[i]);
+            if (mode == MedianIntegration) r.esd[i] *= MEDIAN_ESD_FACTOR;
+            if (robust && mode == ClippedIntegration) r.esd[i] = clippedEsd[i];
+            r.min[i] = lo[i];
+            r.max[i] = hi[i];
+
+            const quint32 *b = sk.constData() + i*SKETCH_BUCKETS;
+            r.q05[i] = sketchQuantile(b, r.count[i], 0.05, lo[i], hi[i]);
+            r.q50[i] = sketchQuantile(b, r.count[i], 0.50, lo[i], hi[i]);
+            r.q95[i] = sketchQuantile(b, r.count[i], 0.95, lo[i], hi[i]);
+        }
+        else if (i > 0)
+        {
+            r.mean[i] = r.mean[i-1];
+            r.variance[i] = r.variance[i-1];
+            r.esd[i] = r.esd[i-1];
+            r.min[i] = r.min[i-1];
+            r.max[i] = r.max[i-1];
+            r.q05[i] = r.q05[i-1];
+            r.q50[i] = r.q50[i-1];
+            r.q95[i] = r.q95[i-1];
+        }
+        else
+        {
+            r.mean[i] = 0.0;
+            r.variance[i] = 0.0;
+            r.esd[i] = 0.0;
+            r.min[i] = 0.0;
+            r.max[i] = 0.0;
+            r.q05[i] = 0.0;
+            r.q50[i] = 0.0;
+            r.q95[i] = 0.0;
+        }
+    }
+
+    return r;
+}
@@ -0,0 +1,152 @@
+/* ***************************************************************************
+ * TwoThetaHistogram.h: defines a fine master histogram of film intensities
+ *   against 2theta that can be rebinned to any coarser step
+ * ***************************************************************************/
+#ifndef TwoThetaHistogram_H
+#define TwoThetaHistogram_H
+
+/* !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+ * Headers, definitions, etc.
+ * !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!*/
+
+/* Qt related headers */
+#include <QVector>
+
+/* Preferred master bin width [deg].  Any step that is an even multiple of it
+ * (0.005, 0.01, 0.02, 0.025, 0.05, ...) is rebinned exactly. */
+#define MASTER_STEP 0.0025
+
+/* How the intensity of a bin is estimated from its pixels */
+#define MeanIntegration 0
+#define MedianIntegration 1
+#define ClippedIntegration 2
+
+/* Standard error of a median relative to that of a mean (sqrt(pi/2)) */
+#define MEDIAN_ESD_FACTOR 1.2533
+
+/* Sigma clipping stops after this many rejection passes */
+#define CLIP_MAX_ITERATIONS 5
+
+/* Gray levels are sketched in buckets of 8 (256/32) for the quantiles */
+#define SKETCH_BUCKETS 32
+#define SKETCH_SHIFT 3
+
+/* !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+ * Structures
+ * !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!*/
+
+/* An integrated pattern at one step size.  Empty bins repeat the previous
+ * bin's values (count stays zero). */
+struct IntegrationResult
+{
+    double step;
+    bool exact;             /* true if rebinned exactly from the master bins */
+
+    QVector<double> x;      /* bin centres [deg] */
+    QVector<double> mean;
+    QVector<double> count;
+    QVector<double> variance;   /* sample variance of the pixels */
+    QVector<double> esd;        /* standard error of the bin intensity, from
+                                 * the kept samples when clipped */
+    QVector<double> min;
+    QVector<double> max;
+    QVector<double> q05;    /* 5%, 50% and 95% quantiles from the sketch */
+    QVector<double> q50;
+    QVector<double> q95;
+
+    IntegrationResult() : step(0.0), exact(false) {}
+    int size() const { return x.size(); }
+};
+
+/* !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+ * Main class definition
+ * !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!*/
+
+/* ***************************************************************************
+ * class: TwoThetaHistogram
+ * description: count, mean and sum of squared deviations (Welford), min,
+ *   max and a bucketed gray level sketch of the pixel intensities in master
+ *   bins [k*step, (k+1)*step).  Every statistic merges (the moments with
+ *   Chan's pairwise update), so any output step can be built from the
+ *   master bins in one sweep.  Output bins of a step R are centred on
+ *   i*R (as the plot and exports expect), so their edges fall on master
+ *   edges whenever R/(2*step) is an integer and the rebinning is then exact.
+ *   The arrays are implicitly shared, so copies are cheap.
+ *
+ *   For the median and sigma-clipped modes every pixel value is also kept.
+ *   finish() counting-sorts them into one arena ordered by master bin, so
+ *   the samples of any output bin are a contiguous slice of it.
+ * ***************************************************************************/
+class TwoThetaHistogram
+{
+public:
+    TwoThetaHistogram() : step(MASTER_STEP), size(0), mode(MeanIntegration), clipSigma(3.0) {}
+
+    /* Clears the histogram, choosing a master step that rebins to
+     * resolution exactly */
+    void reset(double resolution, int mode = MeanIntegration, double clipSigma = 3.0);
+
+    /* Makes room for the samples of up to pixels calls to add(), so the
+     * robust modes do not grow their arrays pixel by pixel */
+    void reserveSamples(int pixels)
+    {
+        if (mode == MeanIntegration || pixels <= 0) return;
+
+        sampleBins.reserve(pixels);
+        sampleValues.reserve(pixels);
+    }
+
+    /* Call once all pixels have been added */
+    void finish();
+
+    void add(double twoTheta, int gray)
+    {
+        int k = int(twoTheta/step);
+        if (k < 0 || k >= size) return;
+
+        counts[k] += 1.0;
+        double delta = gray - means[k];
+        means[k] += delta/counts[k];
+        m2s[k] += delta*(gray - means[k]);
+        if (gray < mins[k]) mins[k] = gray;
+        if (gray > maxs[k]) maxs[k] = gray;
+        sketch[k*SKETCH_BUCKETS + (gray >> SKETCH_SHIFT)]++;
+
+        if (mode != MeanIntegration)
+        {
+            sampleBins.append(k);
+            sampleValues.append(gray);
+        }
+    }
+
+    bool isEmpty() const { return size == 0; }
+    double getStep() const { return step; }
+    int getSize() const { return size; }
+    bool isExact(double resolution) const;
+    int getMode() const { return mode; }
+
+    /* Number of output bins for a step, matching the plot arrays */
+    static int binCount(double resolution) { return int(180.0/resolution); }
+
+    /* Rebins the master histogram to the given step */
+    IntegrationResult result(double resolution) const;
+
+private:
+    double step;
+    int size;
+    QVector<double> counts;
+    QVector<double> means;
+    QVector<double> m2s;
+    QVector<int> mins;
+    QVector<int> maxs;
+    QVector<quint32> sketch;
+
+    int mode;
+    double clipSigma;
+    QVector<int> sampleBins;
+    QVector<quint8> sampleValues;
+    QVector<quint8> arena;
+    QVector<int> offsets;       /* master bin k is arena[offsets[k]..offsets[k+1]) */
+};
+
+#endif
@@ -32,11 +32,29 @@ TwoThetaPlot::TwoThetaPlot(QWidget *parent, AppConfig &_appConfig) : QwtPlot(par
     cDataMax->attach(this);
     cDataMax->hide();
 
+    // 5%/95% quantiles dashed, median dotted, shown with min/max
+    cDataQ05 = new QwtPlotCurve("2Theta Data 5%");
+    cDataQ05->setPen(QPen(Qt::darkCyan, 0, Qt::DashLine));
+    cDataQ05->attach(this);
+    cDataQ05->hide();
+
+    cDataQ50 = new QwtPlotCurve("2Theta Data Median");
+    cDataQ50->setPen(QPen(Qt::darkGreen, 0, Qt::DotLine));
+    cDataQ50->attach(this);
+    cDataQ50->hide();
+
+    cDataQ95 = new QwtPlotCurve("2Theta Data 95%");
+    cDataQ95->setPen(QPen(Qt::darkCyan, 0, Qt::DashLine));
+    cDataQ95->attach(this);
+    cDataQ95->hide();
+
     first = true;
 }
 
 void TwoThetaPlot::setXYData(double *_xd, double *_yd, int _s, double sx, double ex)
 {
+    ScopedTimer timer("plot");
+
     if (first)
     {
         ydo = new double[_s];
@@ -62,27 +80,32 @@ void TwoThetaPlot::setXYData(double *_xd, double *_yd, int _s, double sx, double
     int ss = ceil(m/pow(10.0,nZeros(m)) + 0.5)*pow(10.0,nZeros(m)-1);
     setAxisScale(QwtPlot::yLeft, 0, my, ss);
 
-    cout << " Circle Radius = " << appConfig->getCircleRadius() << endl;
+    TRACE(TracePlot, QString("Circle Radius = %1").arg(appConfig->getCircleRadius()));
 
     this->doBackgroundSubtraction(appConfig->getCircleRadius());
     connect(appConfig, SIGNAL(circleRadiusChanged()), this, SLOT(updateBackgroundSubtraction()));
     this->replot();
 }
 
-void TwoThetaPlot::setYMinData(double *_yd)
+void TwoThetaPlot::setEnvelopeData(const IntegrationResult &r)
 {
-    ydmin = _yd;
-    cDataMin->setData(xd, ydmin, size);
+    ScopedTimer timer("plot");
+
+    // setData copies, so the result does not need to outlive the call
+    cDataMin->setData(r.x.constData(), r.min.constData(), r.size());
+    cDataMax->setData(r.x.constData(), r.max.constData(), r.size());
+    cDataQ05->setData(r.x.constData(), r.q05.constData(), r.size());
+    cDataQ50->setData(r.x.constData(), r.q50.constData(), r.size());
+    cDataQ95->setData(r.x.constData(), r.q95.constData(), r.size());
 
     this->replot();
 }
 
-void TwoThetaPlot::setYMaxData(double *_yd)
+void TwoThetaPlot::setStatistics(const IntegrationResult &r)
 {
-    ydmax = _yd;
-    cDataMax->setData(xd, ydmax, size);
-
-    this->replot();
+    counts = r.count;
+    esd = r.esd;
+    esdo = r.esd;
 }
 
 void TwoThetaPlot::resetYRange(double x1, double x2)
@@ -125,161 +148,23 @@ double TwoThetaPlot::maxYinRange(double start, double end)
 
 void TwoThetaPlot::doBackgroundSubtraction(double cR)
 {
-    cout << "cR being forced to 2" << endl; cR = 2.0;
-    cout << "Doing bgs with cR = " << cR << endl;
-    double **indata; /* 2D array of input data */
-    double **outdata; /* 2D array of output data */
-
-    double cX; /* Circle x-coordinate */
-    double cY; /* Circle y-coordinate */
-
-    double sP = 1.0;
-    double oP = 0.0;
+    ScopedTimer timer("background");
+    TRACE(TracePlot, "cR being forced to 2"); cR = 2.0;
+    TRACE(TracePlot, QString("Doing bgs with cR = %1").arg(cR));
     int N = this->size;
 
-    /* Allocate input and output data array */
-    indata = (double **) malloc(N*sizeof(double));
-    outdata = (double **) malloc(N*sizeof(double));
-    for (int i = 0; i < N; i++)
-    {
-        indata[i] = (double *) malloc(2*sizeof(double));
-        outdata[i] = (double *) malloc(2*sizeof(double));
-    }
-
-    for (int i = 0; i < N; i++)
-    {
-        outdata[i][0] = 0.0;
-        outdata[i][1] = 1e20;
-    }
-
-    /* Copy cData to indata */
-    for (int i = 0; i < N; i++)
-    {
-        indata[i][0] = cData->data().x(i);
-        indata[i][1] = cData->data().y(i);
-    }
-
-    //for (int i = 0; i < N; i++)
-    //    cout << indata[i][0] << " " << indata[i][1] << endl;
-
-
-    /* Normalize data so that h/w = 1 for minimal useful signal */
-    sP = (maxY(indata, N) - minY(indata,N))/maxY(indata, N);
-    oP = minY(indata,N);
-
-    for (int i = 0; i < N; i++)
-            indata[i][1] = sP*(indata[i][1] - oP);
-
-    /* Loop through each data point */
+    QVector<double> x(N);
+    QVector<double> y(N);
     for (int i = 0; i < N; i++)
     {
-            /* Calculate analyzing circle location */
-            cX = indata[i][0];
-            cY = findCircleY(indata, N, cX, cR);
-
-            int starti = floor( (cX - cR - indata[0][0])/(indata[1][0] - indata[0][0]) + 0.5 );
-            if (starti < 0) starti = 0;
-            if (starti > N-1) starti = N-1;
-
-            int endi = floor( (cX + cR - indata[0][0])/(indata[1][0] - indata[0][0]) + 0.5 );
-            if (endi > N-1) endi = N-1;
-            if (endi < 0) endi = 0;
-
-            /* Calculate differences between data and circles upper arc */
-            for (int xi = starti; xi <= endi; xi++)
-            {
-                    double diff = indata[xi][1] - (sqrt(pow(cR,2.0) - pow(indata[xi][0]-cX,2.0)) + cY);
-
-                    if (diff < outdata[xi][1])
-                            outdata[xi][1] = diff;
-
-            }
-    }
-
-    for (int i = 0; i < N; i++)
-    {
-            outdata[i][0] = indata[i][0];
-            outdata[i][1] = (outdata[i][1]/sP);
+        x[i] = cData->data().x(i);
+        y[i] = cData->data().y(i);
     }
 
-    double *xdbgs = new double[N];
-    double *ydbgs = new double[N];
+    QVector<double> bgs = subtractCircleBackground(x.constData(), y.constData(), N, cR);
 
-    /* Save outdata as cDataBGS */
-    for (int i = 0; i < N; i++)
-    {
-        xdbgs[i] = outdata[i][0];
-        ydbgs[i] = outdata[i][1];
-    }
-
-    cDataBGS->setData(xdbgs, ydbgs, N);
+    cDataBGS->setData(x, bgs);
     this->replot();
 }
 
-double TwoThetaPlot::findCircleY(double **d, int N, double cX, double cR)
-{
-
-    double cY = -cR;
-
-    //cout << "Circle starting at (" << cX << ", " << cY << ")" << endl;
-
-    int starti = floor( (cX - cR - d[0][0])/(d[1][0] - d[0][0]) + 0.5 );
-    if (starti < 0) starti = 0;
-    if (starti > N-1) starti = N-1;
-
-    int endi = floor( (cX + cR-d[0][0])/(d[1][0] - d[0][0]) + 0.5 );
-    if (endi > N-1) endi = N-1;
-    if (endi < 0) endi = 0;
-
-    //cout << "Start i = " << starti << ", End i = " << endi << endl;
-
-    double *diffs = new double[endi-starti + 1];
-
-    for (int i = starti; i <= endi; i++)
-    {
-            double y = sqrt( pow(cR, 2.0) - pow(d[i][0]- cX, 2.0) ) + cY;
-
-            diffs[i-starti] = d[i][1] - y;
-    }
-
-    double mindiff = 1e20;
-
-    for (int i = 0; i < endi-starti+1; i++)
-    {
-            if (diffs[i] < mindiff)
-            {
-                    mindiff = diffs[i];
-            }
-    }
-
-    cY = cY + mindiff;
-
-    return cY;
-}
-
-
-double TwoThetaPlot::minY(double **d, int N)
-{
-        double min = 1e20;
-        for (int i = 0; i < N; i++)
-        {
-                if (d[i][1] < min)
-                        min = d[i][1];
-        }
-
-        return min;
-}
-
-double TwoThetaPlot::maxY(double **d, int N)
-{
-        double max = 0.0;
-        for (int i = 0; i < N; i++)
-        {
-                if (d[i][1] > max)
-                        max = d[i][1];
-        }
-
-        return max;
-}
-
 
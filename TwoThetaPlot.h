@@ -64,6 +64,10 @@
 #include <ctime>
 
 #include "AppConfig.h"
+#include "TwoThetaHistogram.h"
+#include "Background.h"
+#include "Instrumentation.h"
+#include "Log.h"
 
 using namespace std;
 
@@ -78,11 +82,11 @@ public:
     TwoThetaPlot(QWidget *parent, AppConfig &_appConfig);
 
     void setXYData(double *_xd, double *_yd, int _s, double sx= 0, double ex = 180.0);
-    void setYMinData(double *_yd);
-    void setYMaxData(double *_yd);
+    void setEnvelopeData(const IntegrationResult &r);
+    void setStatistics(const IntegrationResult &r);
 
-    void mmOn() { cDataMin->show(); cDataMax->show(); this->replot(); }
-    void mmOff() { cDataMin->hide(); cDataMax->hide(); this->replot(); }
+    void mmOn() { cDataMin->show(); cDataMax->show(); cDataQ05->show(); cDataQ50->show(); cDataQ95->show(); this->replot(); }
+    void mmOff() { cDataMin->hide(); cDataMax->hide(); cDataQ05->hide(); cDataQ50->hide(); cDataQ95->hide(); this->replot(); }
 
     void bgsOn() { cDataBGS->show(); cData->hide(); this->replot(); }
     void bgsOff() { cDataBGS->hide(); cData->show(); this->replot(); }
@@ -92,6 +96,15 @@ public:
     void resetYRange(double x1 = 0.0, double x2 = 180.0);
     double* getXValues() { return xd; }
     double* getYValues() { return yd; }
+    bool hasEsd() { return esd.size() == size; }
+    const double* getEsdValues() { return esd.constData(); }
+    /* Pixels in each bin; scaling and reset() leave them as integrated */
+    const double* getCountValues() { return counts.constData(); }
+    void scaleEsd(double s)
+    {
+        for (int i = 0; i < esd.size(); i++)
+            esd[i] = esd[i]*fabs(s);
+    }
     int nZeros(double v);
 
     double maxYinRange(double start, double end);
@@ -99,14 +112,19 @@ public:
     QwtPlotCurve* getData() { return cData; }
     QwtPlotCurve* getDataBGS() { return cDataBGS; }
     void doBackgroundSubtraction(double cR);
-    double findCircleY(double **d, int N, double cX, double cR);
-    double minY(double **d, int N);
-    double maxY(double **d, int N);
 
     void reset()
     {
         for (int i = 0; i < size; i ++)
             yd[i] = ydo[i];
+        esd = esdo;
+    }
+
+    /* The next setXYData becomes the data reset() returns to */
+    void clearOriginal()
+    {
+        if (!first) delete [] ydo;
+        first = true;
     }
 
 protected slots:
@@ -117,15 +135,19 @@ private:
     AppConfig *appConfig;
     double *xd;
     double *yd;
-    double *ydmin;
-    double *ydmax;
     double *ydo;
     int size;
+    QVector<double> counts;
+    QVector<double> esd;
+    QVector<double> esdo;
 
     QwtPlotCurve *cData;
     QwtPlotCurve *cDataBGS;
     QwtPlotCurve *cDataMin;
     QwtPlotCurve *cDataMax;
+    QwtPlotCurve *cDataQ05;
+    QwtPlotCurve *cDataQ50;
+    QwtPlotCurve *cDataQ95;
 
     bool first;
 
@@ -13,8 +13,14 @@ TwoThetaWindow::TwoThetaWindow(QWidget *parent, AppConfig &_appConfig) : QMainWi
     appConfig = &_appConfig;
     start2Theta = 0.0;
     end2Theta = 180.0;
+    peaksStale = true;
+    peaksLambda = 0.0;
     //QVBoxLayout *layout = new QVBoxLayout(this);
-    initializeDB();
+
+    /* Parse the mineral database on a worker thread so that the main window
+     * does not have to wait for it.  mindb is only touched by the GUI once
+     * dbFuture has finished (see waitForDB). */
+    dbFuture = QtConcurrent::run(this, &TwoThetaWindow::initializeDB);
     sb = statusBar();
     twoThetaXYPlot = new TwoThetaPlot(this, *appConfig);
     this->setCentralWidget(twoThetaXYPlot);
@@ -70,7 +76,43 @@ TwoThetaWindow::TwoThetaWindow(QWidget *parent, AppConfig &_appConfig) : QMainWi
     //connect(UiD.listMatches, SIGNAL(itemClicked(QListWidgetItem*)), this, SLOT(showMineralLines(QListWidgetItem*)));
     //connect(UiD.listMatches, SIGNAL(itemChanged(QListWidgetItem*)), this, SLOT(showMineralLines(QListWidgetItem*)));
     connect(UiD.listMatches, SIGNAL(currentRowChanged(int)), this, SLOT(showMineralLines(int)));
+    connect(UiD.btnSearch, SIGNAL(clicked()), this, SLOT(searchClicked()));
     searchDialog->setSizePolicy(QSizePolicy::Expanding,QSizePolicy::Expanding);
+
+    /* Show a loading state until the database is ready */
+    UiD.btnSearch->setEnabled(false);
+    UiD.btnSearch->setText(tr("Loading database..."));
+    connect(&dbWatcher, SIGNAL(finished()), this, SLOT(databaseLoaded()));
+    dbWatcher.setFuture(dbFuture);
+}
+
+TwoThetaWindow::~TwoThetaWindow()
+{
+    /* Don't let the loader write into a destroyed window */
+    dbFuture.waitForFinished();
+}
+
+void TwoThetaWindow::databaseLoaded()
+{
+    UiD.btnSearch->setText(tr("Search"));
+    UiD.btnSearch->setEnabled(true);
+    TRACE(TraceSearch, QString("Mineral database loaded (%1 minerals).").arg(mindb.count()));
+}
+
+/* waitForDB
+ * Blocks until the background database load has finished.  Anything that
+ * reads mindb from the GUI thread must call this first.
+ */
+void TwoThetaWindow::waitForDB()
+{
+    if (dbFuture.isFinished())
+        return;
+
+    sb->showMessage(tr("Waiting for the mineral database to load..."));
+    QApplication::setOverrideCursor(Qt::WaitCursor);
+    dbFuture.waitForFinished();
+    QApplication::restoreOverrideCursor();
+    sb->clearMessage();
 }
 
 void TwoThetaWindow::createToolbar()
@@ -205,9 +247,7 @@ void TwoThetaWindow::showMineralLines(int i)
 
 void TwoThetaWindow::contextMenuEvent(QContextMenuEvent *event)
 {
-    cout << "Context menu event" << endl;
-    cout << toolbar->frameGeometry().x() << " " << toolbar->frameGeometry().y() << " " << toolbar->frameGeometry().width() << " " << toolbar->frameGeometry().height() << endl;
-    cout << event->pos().x() << " " << event->pos().y() << endl;
+    TRACE(TracePlot, QString("Context menu event at %1 %2").arg(event->pos().x()).arg(event->pos().y()));
 
     if (toolbar->frameGeometry().contains(event->pos()))
     {
@@ -216,6 +256,9 @@ void TwoThetaWindow::contextMenuEvent(QContextMenuEvent *event)
 
 
         contextMenu->addAction("Add macro", this, SLOT(addMacro()));
+        contextMenu->addAction("Save peak list", this, SLOT(savePeakList()));
+        if (!histogram.isEmpty())
+            contextMenu->addAction("Change step size", this, SLOT(rebin()));
 
         contextMenu->popup( QCursor::pos() );
         contextMenu->exec ();
@@ -251,15 +294,17 @@ void TwoThetaWindow::addMacro()
 
 void TwoThetaWindow::showMineralLines(QListWidgetItem *lwi)
 {
-    cout << "Current mineral = " << currentMineral.toStdString() << ", text = " << lwi->text().toStdString() << endl;
+    TRACE(TraceSearch, QString("Current mineral = %1, text = %2").arg(currentMineral, lwi->text()));
 
     if (UiD.listMatches->count() == 0) return;
 
+    waitForDB();
 
     minSymbol.setStyle(QwtSymbol::DTriangle);
     minSymbol.setSize(11,11);
 
-    QString sMineral = lwi->text();
+    /* Full pattern matches carry the mineral name as item data */
+    QString sMineral = lwi->data(Qt::UserRole).isValid() ? lwi->data(Qt::UserRole).toString() : lwi->text();
     if (sMineral == currentMineral)
     {
         for (int i = 0; i < minMarkers.count(); i++)
@@ -275,7 +320,7 @@ void TwoThetaWindow::showMineralLines(QListWidgetItem *lwi)
     }
 
     Mineral mineral = mindb[sMineral];
-    cout << "Trying to show " << mineral.name.toStdString() << " with " << mineral.nLines << " lines" << endl;
+    TRACE(TraceSearch, QString("Trying to show %1 with %2 lines").arg(mineral.name).arg(mineral.nLines));
 
     for (int i = 0; i < mineral.lines.count(); i++)
     {
@@ -333,7 +378,6 @@ void TwoThetaWindow::printData()
 
 void TwoThetaWindow::doMacro(QAction * qa)
 {
-    cout << "Do Macro Called" << endl;
     MineralMacro mm = appConfig->getMineralMacro(qa->data().toString());
     QToolMacro *qtm = NULL;
 
@@ -347,7 +391,7 @@ void TwoThetaWindow::doMacro(QAction * qa)
         return;
 
     bool rightButton = qtm->isRightClick();
-    cout << "rightButton = " << rightButton << endl;
+    TRACE(TraceSearch, QString("Macro %1, rightButton = %2").arg(mm.title).arg(rightButton));
     // Left button click => execute the macro
     if (! rightButton)
     {
@@ -391,7 +435,7 @@ void TwoThetaWindow::doMacro(QAction * qa)
 
 void TwoThetaWindow::deleteMacro()
 {
-    cout << "Removing " << UiMacro.leTitle->text().toStdString() << endl;
+    TRACE(TraceSearch, QString("Removing %1").arg(UiMacro.leTitle->text()));
     appConfig->deleteMacro(UiMacro.leTitle->text());
     appConfig->saveConfig();
     macroDialog->hide();
@@ -407,6 +451,30 @@ void TwoThetaWindow::reset()
     end2Theta = 180.0;
 }
 
+/* setIntegration
+ * Shows a new integration; it also becomes the data Reset returns to.
+ */
+void TwoThetaWindow::setIntegration(const IntegrationResult &r)
+{
+    integration = r;
+
+    // The plot keeps and edits these arrays in place
+    int n = r.size();
+    double *xd = new double[n];
+    double *yd = new double[n];
+    for (int i = 0; i < n; i++)
+    {
+        xd[i] = r.x[i];
+        yd[i] = r.mean[i];
+    }
+
+    twoThetaXYPlot->clearOriginal();
+    twoThetaXYPlot->setStatistics(r);
+    peaksStale = true;
+    this->setXYData(xd, yd, n, start2Theta, end2Theta);
+    twoThetaXYPlot->setEnvelopeData(r);
+}
+
 void TwoThetaWindow::setXYData(double *xd, double *yd, int s, int sx, int ex) {
     twoThetaXYPlot->setXYData(xd,yd, s, sx, ex);
     QwtPlotZoomer *oldZoomer = zoomer;
@@ -475,10 +543,10 @@ void TwoThetaWindow::initializeDB()
             string line;
             chemfile >> line;
             QString qline = QString::fromStdString(line);
-            QStringList entry = qline.split(",");
-            QList<QString> list = getElementsFromString(qline.section(",", 1));
-            mindb[qline.section(",", 0, 0)].formula = qline.section(",", 1).remove("\"");
-            mindb[qline.section(",", 0, 0)].elements = list;
+            QString formula = qline.section(",", 1).remove("\"");
+            Mineral &m = mindb[qline.section(",", 0, 0)];
+            m.formula = formula;
+            m.elements = getElementsFromString(formula);
 
         }
     }
@@ -486,54 +554,99 @@ void TwoThetaWindow::initializeDB()
 
 }
 
-QList<QString> TwoThetaWindow::getElementsFromString(QString s)
+/* Element symbols, in the order used for ElementSet bit positions */
+static const char *elementSymbols[] = {
+    "H", "He", "Li", "Be", "B", "C", "N", "O", "F", "Ne",
+    "Na", "Mg", "Al", "Si", "P", "S", "Cl", "Ar",
+    "K", "Ca", "Sc", "Ti", "V", "Cr", "Mn", "Fe", "Co", "Ni", "Cu", "Zn", "Ga", "Ge", "As", "Se", "Br", "Kr",
+    "Rb", "Sr", "Y", "Zr", "Nb", "Mo", "Tc", "Ru", "Rh", "Pd", "Ag", "Cd", "In", "Sn", "Sb", "Te", "I", "Xe",
+    "Cs", "Ba", "La", "Hf", "Ta", "W", "Re", "Os", "Ir", "Pt", "Au", "Hg", "Tl", "Pb", "Bi", "Po", "At", "Rn",
+    "Fr", "Ra", "Ac", "Rf", "Db", "Sg", "Bh", "Hs", "Mt", "Ds", "Rg",
+    "Ce", "Pr", "Nd", "Pm", "Sm", "Eu", "Gd", "Tb", "Dy", "Ho", "Er", "Tm", "Yb", "Lu",
+    "Th", "Pa", "U", "Np", "Pu", "Am", "Cm", "Bk", "Cf", "Es", "Fm", "Md", "No", "Lr"
+};
+
+/* Symbol -> index lookup, indexed by [first letter][second letter + 1]
+ * (second index 0 is used for one letter symbols).  Built once during static
+ * initialization so it is safe to use from the database loading thread. */
+struct ElementTable
 {
-    QList<QString> elements;
-    QList<QString> allElements;
-    allElements << "H" << "He" << "Li" << "Be" << "B" << "C" << "N" << "O" << "F" << "Ne";
-    allElements << "Na" << "Mg" << "Al" << "Si" << "P" << "S" << "Cl" << "Ar";
-    allElements << "K" << "Ca" << "Sc" << "Ti" << "V" << "Cr" << "Mn" << "Fe" << "Co" << "Ni" << "Cu" << "Zn" << "Ga" << "Ge" << "As" << "Se" << "Br" << "Kr";
-    allElements << "Rb" << "Sr" << "Y" << "Zr" << "Nb" << "Mo" << "Tc" << "Ru" << "Rh" << "Pd" << "Ag" << "Cd" << "In" << "Sn" << "Sb" << "Te" << "I" << "Xe";
-    allElements << "Cs" << "Ba" << "La" << "Hf" << "Ta" << "W" << "Re" << "Os" << "Is" << "Pt" << "Au" << "Hg" << "Tl" << "Pb" << "Bi" << "Po" << "At" << "Rn";
-    allElements << "Fr" << "Ra" << "Ac" << "Rf" << "Db" << "Sg" << "Bh" << "Hs" << "Mt" << "Ds" << "Rg";
-    allElements << "Ce" << "Pr" << "Nd" << "Pm" << "Sm" << "Eu" << "Gd" << "Tb" << "Dy" << "Ho" << "Er" << "Tm" << "Yb" << "Lu";
-    allElements << "Th" << "Pa" << "U" << "Np" << "Pu" << "Am" << "Cm" << "Bk" << "Cf" << "Es" << "Fm" << "Md" << "No" << "Lr";
-
-    s.remove("\"");
-
-    for (int i = 0; i < allElements.count(); i ++)
+    int index[26][27];
+
+    ElementTable()
     {
-        if (s.contains(allElements.at(i)))
+        for (int i = 0; i < 26; i++)
+            for (int j = 0; j < 27; j++)
+                index[i][j] = -1;
+
+        int n = sizeof(elementSymbols)/sizeof(elementSymbols[0]);
+        Q_ASSERT(n <= MAX_ELEMENTS);
+
+        for (int e = 0; e < n; e++)
         {
-            int j = 0;
+            const char *sym = elementSymbols[e];
+            int j = (sym[1] == '\0') ? 0 : sym[1] - 'a' + 1;
+            index[sym[0] - 'A'][j] = e;
+        }
+    }
 
-            while (j < s.length())
-            {
-                int si = s.indexOf(allElements.at(i), j);
-                if (si == -1)
-                    break;
-                else
-                    si = si + allElements.at(i).length();
-                if (si == s.length())
-                {
-                    elements.append(allElements.at(i));
-                    break;
-                } else if (! (si < s.length()))
-                    break;
-                QChar c = s.at(si);
-
-                if (c.isUpper() || c == '+' || c == ')' || c == '(' || c == '[' || c == ']' || c.isDigit() || c == ',')
-                {
-                    elements.append(allElements.at(i));
-                    break;
-                }
+    int lookup(QChar c1, QChar c2) const
+    {
+        if (c1 < 'A' || c1 > 'Z') return -1;
+        if (c2.isNull()) return index[c1.toAscii() - 'A'][0];
+        if (c2 < 'a' || c2 > 'z') return -1;
+        return index[c1.toAscii() - 'A'][c2.toAscii() - 'a' + 1];
+    }
+};
 
-                j = s.indexOf(allElements.at(i), j) + 1;
-                if (j == 0) break;
-            }
+static const ElementTable elementTable;
 
+/* elementIndex
+ * Returns the ElementSet bit position of an element symbol (case insensitive),
+ * or -1 if the symbol is not an element.
+ */
+int TwoThetaWindow::elementIndex(const QString &symbol)
+{
+    QString s = symbol.trimmed();
+    if (s.length() < 1 || s.length() > 2)
+        return -1;
+
+    QChar c1 = s.at(0).toUpper();
+    QChar c2 = (s.length() == 2) ? s.at(1).toLower() : QChar();
+
+    return elementTable.lookup(c1, c2);
+}
+
+/* getElementsFromString
+ * Builds the element set of a chemical formula in a single left to right scan.
+ * An element symbol is an upper case letter optionally followed by a lower case
+ * letter; the two letter form is preferred when it is a valid symbol.
+ */
+ElementSet TwoThetaWindow::getElementsFromString(const QString &s)
+{
+    ElementSet elements;
+    int n = s.length();
+
+    for (int i = 0; i < n; i++)
+    {
+        QChar c = s.at(i);
+        if (!c.isUpper())
+            continue;
 
+        if (i + 1 < n && s.at(i+1).isLower())
+        {
+            int e = elementTable.lookup(c, s.at(i+1));
+            if (e >= 0)
+            {
+                elements.insert(e);
+                i++;
+                continue;
+            }
         }
+
+        int e = elementTable.lookup(c, QChar());
+        if (e >= 0)
+            elements.insert(e);
     }
 
     return elements;
@@ -541,9 +654,31 @@ QList<QString> TwoThetaWindow::getElementsFromString(QString s)
 
 void TwoThetaWindow::findPrimarySpacings()
 {
-    QwtPlotCurve *data = twoThetaXYPlot->getDataBGS();
-    double lambda = appConfig->getLambda();
+    /* All peaks over the whole curve are fitted and used by the full pattern
+     * search and the peak list export.  Scaling, offsets and resets do not
+     * move them, so the fit is only redone for a new integration or step,
+     * or after the wavelength was changed. */
+    if (peaksStale || peaksLambda != appConfig->getLambda())
+    {
+        QwtPlotCurve *data = twoThetaXYPlot->getDataBGS();
+
+        int n = data->dataSize();
+        QVector<double> x(n);
+        QVector<double> y(n);
+        for (int i = 0; i < n; i++)
+        {
+            x[i] = data->x(i);
+            y[i] = data->y(i);
+        }
+
+        peaksLambda = appConfig->getLambda();
+        peaks = findPeaks(x.data(), y.data(), n, peaksLambda);
+        peaksStale = false;
+        TRACE(TraceSearch, QString("Found %1 peaks.").arg(peaks.count()));
+    }
 
+    /* The three strongest in the first half of the curve are offered for
+     * the primary spacings search */
     double d1 = 0.0;
     double I1 = 0.0;
     double d2 = 0.0;
@@ -551,56 +686,50 @@ void TwoThetaWindow::findPrimarySpacings()
     double d3 = 0.0;
     double I3 = 0.0;
 
-    for (int i = 1; i < data->dataSize()/2; i++)
+    for (int i = 0; i < peaks.count(); i++)
     {
+        if (peaks[i].twoTheta > 90.0) continue;
 
-        if (data->y(i-1) < data->y(i) && data->y(i+1) < data->y(i))
+        double I = peaks[i].intensity;
+        if (I > I1)
         {
-            if (data->y(i) > I1)
-            {
-                d3 = d2;
-                I3 = I2;
-                d2 = d1;
-                I2 = I1;
-                d1 = data->x(i);
-                I1 = data->y(i);
-            }
-            else if (data->y(i) > I2)
-            {
-                d3 = d2;
-                I3 = I2;
-                d2 = data->x(i);
-                I2 = data->y(i);
-            }
-            else if (data->y(i) > I3)
-            {
-                d3 = data->x(i);
-                I3 = data->y(i);
-            }
+            d3 = d2;
+            I3 = I2;
+            d2 = d1;
+            I2 = I1;
+            d1 = peaks[i].d;
+            I1 = I;
+        }
+        else if (I > I2)
+        {
+            d3 = d2;
+            I3 = I2;
+            d2 = peaks[i].d;
+            I2 = I;
+        }
+        else if (I > I3)
+        {
+            d3 = peaks[i].d;
+            I3 = I;
         }
     }
 
-    // Convert 2theta into d spacings
-    d1 = 1e10*lambda/(2.0*sin((M_PI/180.0)*0.5*d1));
-    d2 = 1e10*lambda/(2.0*sin((M_PI/180.0)*0.5*d2));
-    d3 = 1e10*lambda/(2.0*sin((M_PI/180.0)*0.5*d3));
-
-    cout << "d1 = " << d1 << ", I1 = " << I1 << endl;
-    cout << "d2 = " << d2 << ", I2 = " << I2 << endl;
-    cout << "d3 = " << d3 << ", I3 = " << I3 << endl;
+    TRACE(TraceSearch, QString("d1 = %1, I1 = %2").arg(d1).arg(I1));
+    TRACE(TraceSearch, QString("d2 = %1, I2 = %2").arg(d2).arg(I2));
+    TRACE(TraceSearch, QString("d3 = %1, I3 = %2").arg(d3).arg(I3));
 
     UiD.leD1->setText(QString::number(d1));
     UiD.leD2->setText(QString::number(d2));
     UiD.leD3->setText(QString::number(d3));
     UiD.sbTolerance->setValue(0.02);
 
-    connect(UiD.btnSearch, SIGNAL(clicked()), this, SLOT(searchClicked()));
-
     searchDialog->show();
 }
 
 void TwoThetaWindow::searchClicked()
 {
+    waitForDB();
+
     disconnect(UiD.listMatches, SIGNAL(itemClicked(QListWidgetItem*)), this, SLOT(showMineralLines(QListWidgetItem*)));
     disconnect(UiD.listMatches, SIGNAL(itemChanged(QListWidgetItem*)), this, SLOT(showMineralLines(QListWidgetItem*)));
     disconnect(UiD.listMatches, SIGNAL(currentRowChanged(int)), this, SLOT(showMineralLines(int)));
@@ -610,21 +739,91 @@ void TwoThetaWindow::searchClicked()
     connect(UiD.listMatches, SIGNAL(currentRowChanged(int)), this, SLOT(showMineralLines(int)));
     mineralUrls.clear();
 
-    double l1 = UiD.leD1->text().toDouble();
-    double l2 = UiD.leD2->text().toDouble();
-    double l3 = UiD.leD3->text().toDouble();
+    /* Chemistry constraints: "Cu,S" requires Cu and S, "-Fe" (or "!Fe") excludes Fe */
+    ElementSet reqElements;
+    ElementSet excElements;
+    if (!UiD.leElements->text().isEmpty())
+    {
+        QStringList symbols = UiD.leElements->text().split(",", QString::SkipEmptyParts);
+        for (int i = 0; i < symbols.count(); i ++)
+        {
+            QString sym = symbols.at(i).trimmed();
+            bool exclude = sym.startsWith("-") || sym.startsWith("!");
+            if (exclude) sym.remove(0, 1);
+
+            int e = elementIndex(sym);
+            if (e < 0)
+            {
+                sb->showMessage(tr("Unknown element: %1").arg(sym));
+                continue;
+            }
+
+            if (exclude)
+                excElements.insert(e);
+            else
+                reqElements.insert(e);
+        }
+    }
+
+    if (UiD.cbFullPattern->isChecked())
+        searchFullPattern(reqElements, excElements);
+    else
+        searchPrimarySpacings(reqElements, excElements);
+}
+
+/* searchFullPattern
+ * Scores every database phase against all detected peaks and lists them
+ * best first with their figure of merit.
+ */
+void TwoThetaWindow::searchFullPattern(const ElementSet &required, const ElementSet &excluded)
+{
+    double lambda = appConfig->getLambda();
     double tol = UiD.sbTolerance->value();
 
-    QStringList reqElements;
-    if (!UiD.leElements->text().isEmpty())
+    /* Only reference lines inside the measured (truncated) range count */
+    double ttMin = qMax(start2Theta, 2.0);
+    double ttMax = qMin(end2Theta, 178.0);
+    double dMax = 1e10*lambda/(2.0*sin((M_PI/180.0)*0.5*ttMin));
+    double dMin = 1e10*lambda/(2.0*sin((M_PI/180.0)*0.5*ttMax));
+
+    QVector<Peak> inRange;
+    for (int i = 0; i < peaks.count(); i++)
     {
-        reqElements = UiD.leElements->text().split(",");
-        cout << "Required elements: ";
-        for (int i = 0; i < reqElements.count(); i ++)
-            cout << reqElements.at(i).toStdString() << ", ";
-        cout << endl;
+        if (peaks[i].twoTheta >= ttMin && peaks[i].twoTheta <= ttMax)
+            inRange.append(peaks[i]);
     }
 
+    QList<SearchMatch> matches = searchMatch(mindb, inRange, dMin, dMax, tol, required, excluded);
+
+    for (int i = 0; i < matches.count(); i++)
+    {
+        QListWidgetItem *item = new QListWidgetItem(tr("%1 (%2)").arg(matches[i].name).arg(matches[i].fom, 0, 'f', 1));
+        item->setData(Qt::UserRole, matches[i].name);
+        item->setToolTip(tr("%1\nLines found: %2 of %3\nIntensity agreement: %4")
+                         .arg(mindb[matches[i].name].formula)
+                         .arg(matches[i].nMatched)
+                         .arg(matches[i].nExpected)
+                         .arg(matches[i].intensityAgreement, 0, 'f', 2));
+        UiD.listMatches->addItem(item);
+    }
+
+    if (matches.count() == 0)
+    {
+        cout << "No Matches found." << endl;
+        UiD.listMatches->addItem("No matches found.");
+    }
+}
+
+/* searchPrimarySpacings
+ * Lists the phases that have lines within tolerance of all of D1, D2 and D3.
+ */
+void TwoThetaWindow::searchPrimarySpacings(const ElementSet &required, const ElementSet &excluded)
+{
+    double l1 = UiD.leD1->text().toDouble();
+    double l2 = UiD.leD2->text().toDouble();
+    double l3 = UiD.leD3->text().toDouble();
+    double tol = UiD.sbTolerance->value();
+
     bool l1sat, l2sat, l3sat;
     l1sat = false;
     l2sat = false;
@@ -637,6 +836,11 @@ void TwoThetaWindow::searchClicked()
     while (mindbIter.hasNext()) {
         mindbIter.next();
 
+        /* Chemistry is a couple of AND/ANDNOT operations, so reject on it first */
+        const ElementSet &elements = mindbIter.value().elements;
+        if (!elements.containsAll(required) || elements.intersects(excluded))
+            continue;
+
         l1sat = false;
         l2sat = false;
         l3sat = false;
@@ -656,24 +860,11 @@ void TwoThetaWindow::searchClicked()
         }
 
         if (l1sat && l2sat && l3sat)
-        {
-            bool hasElements = true;
-            cout << "Considering " << mindbIter.value().name.toStdString() << endl;
-            for (int w = 0; w < reqElements.count(); w++)
-            {
-                if (!mindbIter.value().elements.contains(reqElements.at(w)))
-                    hasElements = false;
-            }
-
-            if (hasElements)
-                matches << mindbIter.value().name;// + " " + mindbIter.value().formula;
-        }
-
+            matches << mindbIter.value().name;// + " " + mindbIter.value().formula;
     }
 
     for (int i = 0; i < matches.count(); i++)
     {
-        cout << matches[i].toStdString() << endl;
         QListWidgetItem *item = new QListWidgetItem(matches[i]);
         item->setToolTip(mindb[matches[i]].formula);
         UiD.listMatches->addItem(item);
@@ -736,7 +927,7 @@ void TwoThetaWindow::saveCSV()
     //AppConfig c(this);
     QDir p = QDir(QString::fromStdString(appConfig->getLastPath()));
     QString suggest = QString::fromStdString(appConfig->getLastPath()).append(suggestedName).append(".csv");
-    cout << "suggest = " << suggest.toStdString() << endl;
+    TRACE(TracePlot, QString("suggest = %1").arg(suggest));
     QFileDialog qfd(this, tr("Save CSV file as..."), QString::fromStdString(appConfig->getLastPath()), tr("*.csv"));
 
     qfd.selectFile(tr("").append(suggestedName).append(".csv"));
@@ -747,6 +938,7 @@ void TwoThetaWindow::saveCSV()
     if (res == QFileDialog::Accepted)
     {
         csvFilename = qfd.selectedFiles().at(0);
+        ScopedTimer timer("export.csv");
 
         QwtPlotCurve *data = twoThetaXYPlot->getData();
         double intResolution = data->x(2)-data->x(1);
@@ -760,8 +952,60 @@ void TwoThetaWindow::saveCSV()
             appConfig->setLastPath(csvFilename.section('/', 0, -2).toStdString());
             appConfig->saveConfig();
 
+            bool writeEsd = appConfig->getExportEsd() && twoThetaXYPlot->hasEsd();
+            const double *esd = twoThetaXYPlot->getEsdValues();
+
             for (int row = starti; row <= endi; row++) {
-                dataFile << data->x(row) << ", " << data->y(row) << "\n";
+                dataFile << data->x(row) << ", " << data->y(row);
+                if (writeEsd && row < data->dataSize())
+                    dataFile << ", " << esd[row];
+                dataFile << "\n";
+            }
+            dataFile.close();
+        }
+        else {
+            cout << "Unable to save file..." << endl;
+        }
+    }
+}
+
+/* savePeakList
+ * Writes the fitted peaks (position, d, FWHM, area and their esds) as CSV.
+ */
+void TwoThetaWindow::savePeakList()
+{
+    QFileDialog qfd(this, tr("Save peak list as..."), QString::fromStdString(appConfig->getLastPath()), tr("*.csv"));
+
+    qfd.selectFile(tr("").append(suggestedName).append("_peaks.csv"));
+    qfd.setAcceptMode(QFileDialog::AcceptSave);
+    QString csvFilename;
+    int res = qfd.exec();
+
+    if (res == QFileDialog::Accepted)
+    {
+        csvFilename = qfd.selectedFiles().at(0);
+        ScopedTimer timer("export.peaks");
+
+        ofstream dataFile (csvFilename.toAscii());
+        if (dataFile.is_open())
+        {
+            appConfig->setLastPath(csvFilename.section('/', 0, -2).toStdString());
+            appConfig->saveConfig();
+
+            dataFile << "2theta, esd, d, esd, fwhm, esd, area, esd, eta, I/I0, fitted\n";
+
+            /* Peaks are kept in d order; list them in 2theta order */
+            for (int i = peaks.count()-1; i >= 0; i--)
+            {
+                const Peak &pk = peaks[i];
+                if (pk.twoTheta < start2Theta || pk.twoTheta > end2Theta) continue;
+
+                dataFile << pk.twoTheta << ", " << pk.twoThetaEsd << ", "
+                         << pk.d << ", " << pk.dEsd << ", "
+                         << pk.fwhm << ", " << pk.fwhmEsd << ", "
+                         << pk.area << ", " << pk.areaEsd << ", "
+                         << pk.eta << ", " << 100.0*pk.intensity << ", "
+                         << (pk.fitted ? 1 : 0) << "\n";
             }
             dataFile.close();
         }
@@ -796,7 +1040,7 @@ void TwoThetaWindow::saveUDF()
 {
     QDir p = QDir(QString::fromStdString(appConfig->getLastPath()));
     QString suggest = QString::fromStdString(appConfig->getLastPath()).append(suggestedName).append(".udf");
-    cout << "suggest = " << suggest.toStdString() << endl;
+    TRACE(TracePlot, QString("suggest = %1").arg(suggest));
     QFileDialog qfd(this, tr("Save UDF file as..."), QString::fromStdString(appConfig->getLastPath()), tr("*.udf"));
     //qfd.setNameFilter(suggest);
     qfd.selectFile(tr("").append(suggestedName).append(".udf"));
@@ -807,11 +1051,12 @@ void TwoThetaWindow::saveUDF()
     if (res == QFileDialog::Accepted)
     {
         udfFilename = qfd.selectedFiles().at(0);
+        ScopedTimer timer("export.udf");
 
         QwtPlotCurve *data = twoThetaXYPlot->getData();
 
         double intResolution = data->x(2)-data->x(1);
-        cout << "Saving UDF file with resolution: " << intResolution << endl;
+        TRACE(TracePlot, QString("Saving UDF file with resolution: %1").arg(intResolution));
 
         QDateTime now(QDate::currentDate(), QTime::currentTime());
         QString fullDate = now.toString("dd-MMM-yyyy hh:mm:ss AP");
@@ -858,6 +1103,23 @@ void TwoThetaWindow::saveUDF()
 
             udfFile << "/" << endl;
 
+            // Not part of the UDF format, so only written when asked for
+            if (appConfig->getExportEsd() && twoThetaXYPlot->hasEsd())
+            {
+                const double *esd = twoThetaXYPlot->getEsdValues();
+                udfFile << "RawScanEsd" << endl;
+
+                for (int i = starti; i <= endi && i < data->dataSize(); i++) {
+                    if ((i - (starti%8)) % 8 == 0 && (i != starti)) { udfFile << endl; }
+
+                    udfFile << "\t" << esd[i];
+
+                    if ( ((i - (starti%8)) + 1) % 8 != 0 ) udfFile << ",";
+                }
+
+                udfFile << "/" << endl;
+            }
+
         }
     }
 }
@@ -917,10 +1179,39 @@ void TwoThetaWindow::doScale(double scale)
     {
         yd[i] = yd[i]*scale;
     }
+    twoThetaXYPlot->scaleEsd(scale);
 
     this->setXYData(xd, yd, s, start2Theta, end2Theta);
 }
 
+/* rebin
+ * Replaces the plot and envelopes with the master histogram rebinned to a
+ * new step size, keeping the current truncation.  Scaling and offsets are not reapplied.
+ */
+void TwoThetaWindow::rebin(bool prompt, double step)
+{
+    if (histogram.isEmpty())
+        return;
+
+    QwtPlotCurve *data = twoThetaXYPlot->getData();
+    double current = data->x(2) - data->x(1);
+
+    if (prompt)
+    {
+        bool ok;
+        step = QInputDialog::getDouble(this, tr("Change step size"), tr("Step size: "), current, histogram.getStep(), 5.0, 4, &ok);
+        if (!ok) return;
+    }
+
+    if (step < histogram.getStep())
+        return;
+
+    if (!histogram.isExact(step))
+        sb->showMessage(tr("Step %1 is not a multiple of %2, bins are approximate.").arg(step).arg(2.0*histogram.getStep()));
+
+    setIntegration(histogram.result(step));
+}
+
 void TwoThetaWindow::truncate(bool prompt, double _start, double _stop)
 {
     if (prompt)
@@ -32,6 +32,10 @@
 #include <QPrintDialog>
 #include <QDesktopServices>
 #include <QUrl>
+#include <QApplication>
+#include <QFuture>
+#include <QFutureWatcher>
+#include <QtConcurrentRun>
 
 
 #include "ui_MacroDialog.h"
@@ -74,6 +78,8 @@
 
 #include "AppConfig.h"
 #include "TwoThetaPlot.h"
+#include "SearchMatch.h"
+#include "TwoThetaHistogram.h"
 #include "ui_MineralSearchDialog.h"
 
 using namespace std;
@@ -93,16 +99,6 @@ QT_END_NAMESPACE
 #define CuLambda 1.5418e-10
 #define CoLambda 1.7902e-10
 
-struct Mineral
-{
-    QString name;
-    QList<QString> elements;
-    QString formula;
-    QVarLengthArray<double> lines;
-    QVarLengthArray<double> intensities;
-    int nLines;
-};
-
 class QToolMacro : public QToolButton
 {
     Q_OBJECT
@@ -138,11 +134,12 @@ class TwoThetaWindow : public QMainWindow
 
 public:
     TwoThetaWindow(QWidget *parent, AppConfig &_appConfig);
+    ~TwoThetaWindow();
 
     void setXYData(double *xd, double *yd, int s, int sx = 0, int ex = 180);
-    void setYMinData(double *yd) { twoThetaXYPlot->setYMinData(yd); }
-    void setYMaxData(double *yd) { twoThetaXYPlot->setYMaxData(yd); }
+    void setIntegration(const IntegrationResult &r);
     void setSuggestedName(QString s) { suggestedName = s.split(".").at(0); }
+    void setHistogram(const TwoThetaHistogram &h) { histogram = h; }
     void doScale(double s);
     void doOffset(double o);
     void sharpness();
@@ -151,17 +148,22 @@ public:
     void createToolbar();
 
     void initializeDB();
+    void waitForDB();
 
-    QList<QString> getElementsFromString(QString s);
+    static ElementSet getElementsFromString(const QString &s);
+    static int elementIndex(const QString &symbol);
 
     void keyPressEvent(QKeyEvent *);
 
 public slots:
     void saveUDF();
     void saveCSV();
+    void savePeakList();
     void reset();
    // void finishedSlot(QNetworkReply* reply);
     void searchClicked();
+    void searchFullPattern(const ElementSet &required, const ElementSet &excluded);
+    void searchPrimarySpacings(const ElementSet &required, const ElementSet &excluded);
     void openWebMineral();
     void showMineralLines(QListWidgetItem *);
     void showMineralLines(int);
@@ -175,8 +177,10 @@ private slots:
     void intOffset(bool prompt = true, double offset = 0.0);
     void intScale(bool prompt = true, double scale = 1.0);
     void truncate(bool prompt = true, double start = 0.0, double stop = 180.0);
+    void rebin(bool prompt = true, double step = 0.0);
     void doMacro(QAction *);
     void deleteMacro();
+    void databaseLoaded();
 
     void printData();
 
@@ -194,6 +198,13 @@ private:
     QStatusBar *sb;
     QPrinter printer;
     QMap<QString, Mineral> mindb;
+    QVector<Peak> peaks;
+    bool peaksStale;        /* peaks are refitted when a new integration arrives */
+    double peaksLambda;     /* wavelength their d spacings were computed with */
+    TwoThetaHistogram histogram;
+    IntegrationResult integration;
+    QFuture<void> dbFuture;
+    QFutureWatcher<void> dbWatcher;
     QVarLengthArray<QwtPlotMarker *> minMarkers;
     QwtSymbol minSymbol;
     QString currentMineral;
@@ -216,10 +227,4 @@ private:
 };
 
 
-inline bool operator<(const Mineral &m1, const Mineral &m2)
-{
-    return m1.name < m2.name;
-}
-
-
 #endif
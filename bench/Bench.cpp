@@ -0,0 +1,539 @@
+/* ***************************************************************************
+ * Bench.cpp: timing benchmarks of the integration, optimization, background
+ *   subtraction and search-match hot paths on synthetic or real films
+ * ***************************************************************************/
+
+/* !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+ * Headers, definitions, etc.
+ * !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!*/
+
+/* Qt related headers */
+#include <QCoreApplication>
+#include <QStringList>
+#include <QImage>
+#include <QElapsedTimer>
+#include <QDateTime>
+#include <QThread>
+#include <QFile>
+#include <QTextStream>
+#include <QtAlgorithms>
+
+/* Standard c++ headers */
+#include <iostream>
+#include <fstream>
+#include <cmath>
+#include <algorithm>
+
+#ifdef Q_OS_UNIX
+#include <sys/resource.h>
+#endif
+
+/* Program headers */
+#include "FilmImage.h"
+#include "FilmSampler.h"
+#include "IntegrationKernel.h"
+#include "TwoThetaHistogram.h"
+#include "GeometryOptimizer.h"
+#include "Background.h"
+#include "PeakFinder.h"
+#include "SearchMatch.h"
+#include "SyntheticFilm.h"
+
+using namespace std;
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+/* Defaults, as in the application */
+#define BENCH_ITERATIONS 5
+#define BENCH_DPI 600
+#define BENCH_RADIUS (0.1146/2.0)
+#define BENCH_STEP 0.02
+#define BENCH_LAMBDA 1.5406e-10
+#define BENCH_PHASES 5000
+
+/* !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+ * Structures
+ * !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!*/
+
+/* A film with the geometry the benchmarks use on it.  The integration area
+ * runs from the 0 degree center (top) to the 180 degree center (bottom). */
+struct Fixture
+{
+    QString name;
+    FilmImage film;
+    double dpm;
+    double R;
+    QRect intArea;
+};
+
+/* Timings of one benchmark.  work is what one iteration processes, in unit
+ * (pixels, evaluations, points or phases). */
+struct BenchResult
+{
+    QString name;
+    QString fixture;
+    QString unit;
+    double work;
+    QVector<double> seconds;
+    long peakRssKb;
+
+    double minimum() const { return *std::min_element(seconds.begin(), seconds.end()); }
+    double median() const
+    {
+        QVector<double> s = seconds;
+        qSort(s);
+        return s.size() % 2 ? s[s.size()/2] : 0.5*(s[s.size()/2 - 1] + s[s.size()/2]);
+    }
+    double rate() const { return work/median(); }
+};
+
+/* !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+ * Fixtures
+ * !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!*/
+
+/* Peak resident memory of the process so far, -1 where unknown */
+static long peakRssKb()
+{
+#ifdef Q_OS_UNIX
+    struct rusage u;
+    getrusage(RUSAGE_SELF, &u);
+#ifdef Q_OS_MAC
+    return u.ru_maxrss/1024;
+#else
+    return u.ru_maxrss;
+#endif
+#else
+    return -1;
+#endif
+}
+
+/* ***************************************************************************
+ * function: syntheticFixture
+ * description: the standard synthetic film (quartz lines on a 35 mm wide
+ *   film covering 0 to 180 degrees) with the integration area FilmWidget
+ *   would use on it.  The noise comes from a fixed seed so every run sees
+ *   the same film.
+ * ***************************************************************************/
+static Fixture syntheticFixture(int dpi)
+{
+    SyntheticFilmSpec spec = SyntheticFilmSpec::standard(dpi, BENCH_RADIUS);
+    spec.negative = false;
+
+    Fixture f;
+    f.name = QString("synthetic-%1dpi").arg(dpi);
+    f.dpm = spec.dpm;
+    f.R = spec.radius;
+    f.intArea = syntheticIntArea(spec);
+    f.film = FilmImage(renderSyntheticFilm(spec));
+    return f;
+}
+
+/* A film from disk, inverted like FilmWidget::setFilm if it is dark at the
+ * corner, and assumed to be centered and to cover 0 to 180 degrees */
+static bool fileFixture(const QString &fileName, int dpi, Fixture &f)
+{
+    QImage image(fileName);
+    if (image.isNull()) return false;
+
+    if (qGray(image.pixel(0,0)) == 0)
+        image.invertPixels();
+
+    f.name = fileName.section('/', -1);
+    f.dpm = (dpi > 0) ? dpi/0.0254 : image.dotsPerMeterX();
+    f.R = BENCH_RADIUS;
+    f.intArea = QRect(0, 0, image.width(), qMin(image.height(), int(M_PI*f.R*f.dpm)));
+
+    image.invertPixels();
+    f.film = FilmImage(image);
+    return true;
+}
+
+/* Reference phases with random lines (fixed seed), for when no database
+ * file is given */
+static QMap<QString, Mineral> syntheticDatabase(int n)
+{
+    QMap<QString, Mineral> db;
+    unsigned int seed = 7;
+
+    for (int i = 0; i < n; i++)
+    {
+        Mineral m;
+        m.name = QString("Phase%1").arg(i, 5, 10, QChar('0'));
+        m.nLines = 0;
+
+        int nLines = 5 + int(i % 25);
+        for (int k = 0; k < nLines; k++)
+        {
+            seed = seed*1103515245u + 12345u;
+            double d = 1.0 + 4.0*((seed >> 8) & 0xffff)/65535.0;
+            seed = seed*1103515245u + 12345u;
+            double I = 1.0 + 99.0*((seed >> 8) & 0xffff)/65535.0;
+
+            m.lines.append(d);
+            m.intensities.append(I);
+            m.nLines++;
+        }
+
+        db.insert(m.name, m);
+    }
+
+    return db;
+}
+
+/* The xraydb.csv format read by TwoThetaWindow: name,d,I per line */
+static QMap<QString, Mineral> fileDatabase(const QString &fileName)
+{
+    QMap<QString, Mineral> db;
+    ifstream dbfile(fileName.toStdString().c_str());
+
+    string line;
+    while (dbfile >> line)
+    {
+        QStringList entry = QString::fromStdString(line).split(",");
+        if (entry.count() < 3) break;
+
+        Mineral &m = db[entry.at(0)];
+        if (m.name.isEmpty())
+        {
+            m.name = entry.at(0);
+            m.nLines = 0;
+        }
+
+        m.lines.append(entry.at(1).toDouble());
+        m.intensities.append(entry.at(2).toDouble());
+        m.nLines++;
+    }
+
+    return db;
+}
+
+/* !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+ * Benchmarks
+ * !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!*/
+
+/* ***************************************************************************
+ * function: runBench
+ * description: one untimed warm up run, then iterations timed runs of f.
+ * ***************************************************************************/
+template <class F>
+static BenchResult runBench(const QString &name, const Fixture &fixture, int iterations,
+                            double work, const QString &unit, F f)
+{
+    BenchResult r;
+    r.name = name;
+    r.fixture = fixture.name;
+    r.unit = unit;
+    r.work = work;
+
+    f();
+
+    QElapsedTimer timer;
+    for (int i = 0; i < iterations; i++)
+    {
+        timer.start();
+        f();
+        r.seconds.append(timer.nsecsElapsed()*1e-9);
+    }
+
+    r.peakRssKb = peakRssKb();
+    cerr << qPrintable(name) << " [" << qPrintable(fixture.name) << "]: "
+         << r.median() << " s, " << r.rate() << " " << qPrintable(unit) << "/s" << endl;
+
+    return r;
+}
+
+/* Kernel parameters for the whole integration area, as FilmWidget::integrate */
+static KernelParams integrateParams(const Fixture &f, const FilmSampler &s, double phi, double alpha)
+{
+    KernelParams p;
+    p.loop = f.intArea;
+    p.cOffset = f.intArea.x() + f.intArea.width()/2.0;
+    p.LOffset = f.intArea.y();
+    p.foldL = f.intArea.height()/(2.0*f.dpm);
+    p.dpm = f.dpm;
+    p.R = f.R;
+    p.setAngles(phi, alpha, s.height());
+
+    return p;
+}
+
+/* FilmWidget::integrate: kernel into the master histogram, then rebinned */
+struct IntegrateBench
+{
+    const Fixture *f;
+    double phi;
+    double alpha;
+    IntegrationResult *result;
+
+    void operator()() const
+    {
+        FilmSampler s(&f->film);
+        KernelParams p = integrateParams(*f, s, phi, alpha);
+
+        TwoThetaHistogram histogram;
+        histogram.reset(BENCH_STEP);
+        HistogramSink sink;
+        sink.histogram = &histogram;
+        runIntegrationKernel(s, p, selectKernel(phi, alpha), sink);
+
+        histogram.finish();
+        *result = histogram.result(BENCH_STEP);
+    }
+};
+
+/* GeometryOptimizer::integrateRegion: the sharpness objective of the center
+ * and radius searches */
+struct IntegrateRegionBench
+{
+    GeometryOptimizer *optimizer;
+
+    void operator()() const
+    {
+        volatile double r = optimizer->integrateRegion(0.025, 0, 0, optimizer->regions.sharpness);
+        (void)r;
+    }
+};
+
+/* GeometryOptimizer::residual: symmetry of the regions either side of the
+ * 0 degree center */
+struct ResidualBench
+{
+    GeometryOptimizer *optimizer;
+
+    void operator()() const
+    {
+        volatile double r = optimizer->residual(0, 0, ZERO_DEGREES);
+        (void)r;
+    }
+};
+
+/* TwoThetaPlot::doBackgroundSubtraction with the forced radius of 2 */
+struct BackgroundBench
+{
+    const IntegrationResult *pattern;
+
+    void operator()() const
+    {
+        QVector<double> bgs = subtractCircleBackground(pattern->x.constData(), pattern->mean.constData(), pattern->size(), 2.0);
+        (void)bgs;
+    }
+};
+
+/* TwoThetaWindow::searchClicked (full pattern search) */
+struct SearchBench
+{
+    const QMap<QString, Mineral> *db;
+    const QVector<Peak> *peaks;
+
+    void operator()() const
+    {
+        QList<SearchMatch> matches = searchMatch(*db, *peaks, 1.0, 5.0, 0.02, ElementSet(), ElementSet());
+        (void)matches;
+    }
+};
+
+/* ***************************************************************************
+ * function: benchFixture
+ * description: runs every benchmark on one film.  The optimizer objectives
+ *   are timed on a GeometryOptimizer with the centers at the ends of the
+ *   integration area and the regions it places around them, as after the
+ *   first center clicks.
+ * ***************************************************************************/
+static void benchFixture(const Fixture &f, int iterations, const QMap<QString, Mineral> &db,
+                         const QString &filter, QList<BenchResult> &results)
+{
+    double pixels = double(f.intArea.width())*f.intArea.height();
+
+    IntegrationResult pattern;
+    IntegrateBench integrate;
+    integrate.f = &f;
+    integrate.phi = 0.0;
+    integrate.alpha = 0.0;
+    integrate.result = &pattern;
+
+    /* The pattern is needed by the later benchmarks whatever the filter */
+    integrate();
+    if (filter.isEmpty() || QString("integrate").contains(filter))
+        results.append(runBench("integrate", f, iterations, pixels, "pixels", integrate));
+
+    if (filter.isEmpty() || QString("integrate_tilted").contains(filter))
+    {
+        IntegrationResult tilted;
+        IntegrateBench b = integrate;
+        b.phi = 0.2;
+        b.alpha = 0.1;
+        b.result = &tilted;
+        results.append(runBench("integrate_tilted", f, iterations, pixels, "pixels", b));
+    }
+
+    GeometryOptimizer optimizer(FilmSampler(&f.film), f.dpm);
+    optimizer.geometry.zeroDegreeCenter = QPoint(f.intArea.x() + f.intArea.width()/2, f.intArea.y());
+    optimizer.geometry.oneEightyDegreeCenter = optimizer.geometry.zeroDegreeCenter + QPoint(0, int(M_PI*f.R*f.dpm));
+    optimizer.geometry.radius = f.R;
+    optimizer.placeRegions();
+
+    if (filter.isEmpty() || QString("integrateRegion").contains(filter))
+    {
+        IntegrateRegionBench r;
+        r.optimizer = &optimizer;
+        QRect sharpness = optimizer.regions.sharpness;
+        results.append(runBench("integrateRegion", f, iterations, double(sharpness.width())*sharpness.height(), "pixels", r));
+    }
+
+    if (filter.isEmpty() || QString("residual").contains(filter))
+    {
+        ResidualBench r;
+        r.optimizer = &optimizer;
+        results.append(runBench("residual", f, iterations, 1.0, "evaluations", r));
+    }
+
+    if (filter.isEmpty() || QString("backgroundSubtraction").contains(filter))
+    {
+        BackgroundBench r;
+        r.pattern = &pattern;
+        results.append(runBench("backgroundSubtraction", f, iterations, pattern.size(), "points", r));
+    }
+
+    if (filter.isEmpty() || QString("searchMatch").contains(filter))
+    {
+        QVector<Peak> peaks = findPeaks(pattern.x.constData(), pattern.mean.constData(), pattern.size(), BENCH_LAMBDA);
+
+        SearchBench r;
+        r.db = &db;
+        r.peaks = &peaks;
+        results.append(runBench("searchMatch", f, iterations, db.count(), "phases", r));
+    }
+}
+
+/* !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+ * Output
+ * !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!*/
+
+static QString jsonString(const QString &s)
+{
+    QString e = s;
+    e.replace("\\", "\\\\").replace("\"", "\\\"");
+    return "\"" + e + "\"";
+}
+
+/* ***************************************************************************
+ * function: writeJson
+ * description: one object per run with an entry per benchmark and fixture,
+ *   meant to be appended to a history and compared across builds.
+ * ***************************************************************************/
+static void writeJson(QTextStream &out, const QList<BenchResult> &results, int iterations)
+{
+    out << "{\n";
+    out << "  \"suite\": \"diis-bench\",\n";
+    out << "  \"timestamp\": " << jsonString(QDateTime::currentDateTime().toString(Qt::ISODate)) << ",\n";
+    out << "  \"qt\": " << jsonString(qVersion()) << ",\n";
+    out << "  \"threads\": " << QThread::idealThreadCount() << ",\n";
+    out << "  \"iterations\": " << iterations << ",\n";
+    out << "  \"results\": [\n";
+
+    for (int i = 0; i < results.size(); i++)
+    {
+        const BenchResult &r = results.at(i);
+
+        out << "    {\"name\": " << jsonString(r.name)
+            << ", \"fixture\": " << jsonString(r.fixture)
+            << ", \"unit\": " << jsonString(r.unit)
+            << ", \"work\": " << QString::number(r.work, 'g', 12)
+            << ", \"median_s\": " << QString::number(r.median(), 'g', 8)
+            << ", \"min_s\": " << QString::number(r.minimum(), 'g', 8)
+            << ", \"per_s\": " << QString::number(r.rate(), 'g', 8)
+            << ", \"peak_rss_kb\": " << r.peakRssKb
+            << ", \"seconds\": [";
+        for (int k = 0; k < r.seconds.size(); k++)
+            out << (k ? ", " : "") << QString::number(r.seconds.at(k), 'g', 8);
+        out << "]}" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+
+    out << "  ]\n}\n";
+}
+
+static void usage()
+{
+    cerr << "usage: diis-bench [--iterations n] [--dpi n] [--film file [--film-dpi n]]" << endl
+         << "                  [--db xraydb.csv] [--filter name] [--json file|-]" << endl
+         << "Times integrate, integrate_tilted, integrateRegion, residual," << endl
+         << "backgroundSubtraction and searchMatch on a synthetic film (and on" << endl
+         << "each --film given)." << endl;
+}
+
+/* !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+ * Entry point
+ * !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!*/
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QStringList args = app.arguments();
+
+    int iterations = BENCH_ITERATIONS;
+    int dpi = BENCH_DPI;
+    int filmDpi = 0;
+    QStringList films;
+    QString dbFile;
+    QString filter;
+    QString jsonFile;
+
+    for (int i = 1; i < args.size(); i++)
+    {
+        QString a = args.at(i);
+        bool hasValue = (i + 1 < args.size());
+
+        if (a == "--iterations" && hasValue) iterations = qMax(1, args.at(++i).toInt());
+        else if (a == "--dpi" && hasValue) dpi = args.at(++i).toInt();
+        else if (a == "--film" && hasValue) films.append(args.at(++i));
+        else if (a == "--film-dpi" && hasValue) filmDpi = args.at(++i).toInt();
+        else if (a == "--db" && hasValue) dbFile = args.at(++i);
+        else if (a == "--filter" && hasValue) filter = args.at(++i);
+        else if (a == "--json" && hasValue) jsonFile = args.at(++i);
+        else
+        {
+            usage();
+            return 1;
+        }
+    }
+
+    QMap<QString, Mineral> db = dbFile.isEmpty() ? syntheticDatabase(BENCH_PHASES) : fileDatabase(dbFile);
+    QList<BenchResult> results;
+
+    Fixture synthetic = syntheticFixture(dpi);
+    benchFixture(synthetic, iterations, db, filter, results);
+
+    for (int i = 0; i < films.size(); i++)
+    {
+        Fixture f;
+        if (!fileFixture(films.at(i), filmDpi, f))
+        {
+            cerr << "Could not load film: " << qPrintable(films.at(i)) << endl;
+            return 1;
+        }
+
+        benchFixture(f, iterations, db, filter, results);
+    }
+
+    if (jsonFile == "-")
+    {
+        QTextStream out(stdout);
+        writeJson(out, results, iterations);
+    }
+    else if (!jsonFile.isEmpty())
+    {
+        QFile file(jsonFile);
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Text))
+        {
+            cerr << "Could not write " << qPrintable(jsonFile) << endl;
+            return 1;
+        }
+
+        QTextStream out(&file);
+        writeJson(out, results, iterations);
+    }
+
+    return 0;
+}
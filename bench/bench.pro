@@ -0,0 +1,36 @@
+# Timing benchmarks of the analysis hot paths.  Builds without Qwt or a
+# display:
+#   cd bench && qmake && make
+#   ../../bin/diis-bench --json results.json
+TEMPLATE = app
+TARGET = diis-bench
+CONFIG += console
+CONFIG -= app_bundle
+INCLUDEPATH += ..
+DEPENDPATH += ..
+QMAKE_CXXFLAGS += -O3
+
+HEADERS = ../FilmImage.h \
+    ../FilmSampler.h \
+    ../IntegrationKernel.h \
+    ../TwoThetaHistogram.h \
+    ../GeometryOptimizer.h \
+    ../Log.h \
+    ../Background.h \
+    ../PeakFinder.h \
+    ../SearchMatch.h \
+    ../SyntheticFilm.h \
+    ../Instrumentation.h \
+    ../ConfigFile/ConfigFile.h
+SOURCES = Bench.cpp \
+    ../FilmImage.cpp \
+    ../TwoThetaHistogram.cpp \
+    ../GeometryOptimizer.cpp \
+    ../Log.cpp \
+    ../Background.cpp \
+    ../PeakFinder.cpp \
+    ../SearchMatch.cpp \
+    ../SyntheticFilm.cpp \
+    ../Instrumentation.cpp \
+    ../ConfigFile/ConfigFile.cpp
+DESTDIR = ../../bin
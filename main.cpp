@@ -11,6 +11,10 @@ int main(int argc, char *argv[])
 {
     QApplication app(argc, argv);
 
+    /* Debug traces by subsystem, e.g. DIIS_TRACE=optimizer,plot (in debug
+     * builds or ones with DEFINES += DIIS_TRACE) */
+    setTraceSubsystems(parseTraceSubsystems(QString::fromLocal8Bit(qgetenv("DIIS_TRACE"))));
+
     Q_INIT_RESOURCE(AppResources);
     app.setWindowIcon(QIcon(":/icons/icon.icns"));
 
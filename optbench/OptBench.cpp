@@ -0,0 +1,383 @@
+/* ***************************************************************************
+ * OptBench.cpp: runs every geometry optimization strategy on films of known
+ *   geometry and compares the evaluations, time and final geometry error
+ * ***************************************************************************/
+
+/* !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+ * Headers, definitions, etc.
+ * !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!*/
+
+/* Qt related headers */
+#include <QCoreApplication>
+#include <QStringList>
+#include <QImage>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QTextStream>
+
+/* Standard c++ headers */
+#include <iostream>
+#include <cmath>
+
+/* Program headers */
+#include "FilmImage.h"
+#include "FilmSampler.h"
+#include "GeometryOptimizer.h"
+#include "Instrumentation.h"
+#include "SyntheticFilm.h"
+
+using namespace std;
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+/* Defaults */
+#define OPTBENCH_DPI 300
+#define OPTBENCH_OFFSET_X 6
+#define OPTBENCH_OFFSET_Y -5
+#define OPTBENCH_TOLERANCE 1.0
+
+/* !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+ * Structures
+ * !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!*/
+
+/* A film (lines bright, as analysed) and where its geometry really is */
+struct Case
+{
+    QString name;
+    FilmImage film;
+    SyntheticTruth truth;
+};
+
+/* One strategy on one film */
+struct Run
+{
+    QString film;
+    QString strategy;
+    OptimizerCounts counts;
+    double seconds;
+    double zeroError;       /* [pixels] */
+    double oneEightyError;  /* [pixels], of the implied 180 degree center */
+    double radiusError;     /* [mm] */
+    double phiError;        /* [deg] */
+    double alphaError;      /* [deg] */
+    bool converged;
+};
+
+/* !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+ * Films
+ * !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!*/
+
+static Case syntheticCase(const QString &name, const SyntheticFilmSpec &spec)
+{
+    Case c;
+    c.name = name;
+    c.film = FilmImage(renderSyntheticFilm(spec));
+    c.truth = syntheticTruth(spec);
+    return c;
+}
+
+/* Clean, noisy, grainy with beam stop shadows, and tilted quartz films */
+static QList<Case> syntheticCases(int dpi)
+{
+    QList<Case> cases;
+
+    SyntheticFilmSpec spec = SyntheticFilmSpec::standard(dpi);
+    spec.negative = false;
+
+    SyntheticFilmSpec clean = spec;
+    clean.noise = 0.0;
+    cases.append(syntheticCase("clean", clean));
+
+    SyntheticFilmSpec noisy = spec;
+    noisy.noise = 12.0;
+    cases.append(syntheticCase("noisy", noisy));
+
+    SyntheticFilmSpec grainy = spec;
+    grainy.spots = 300;
+    grainy.beamStopRadius = 0.003;
+    cases.append(syntheticCase("grainy", grainy));
+
+    SyntheticFilmSpec tilted = spec;
+    tilted.phi = 0.005;
+    cases.append(syntheticCase("tilted", tilted));
+
+    return cases;
+}
+
+/* A film with its ground truth in <file>.truth, inverted like
+ * FilmWidget::setFilm */
+static bool fileCase(const QString &fileName, Case &c)
+{
+    QImage image(fileName);
+    if (image.isNull() || !readSyntheticTruth(fileName + ".truth", c.truth))
+        return false;
+
+    if (qGray(image.pixel(0,0)) == 0)
+        image.invertPixels();
+    image.invertPixels();
+
+    c.name = fileName.section('/', -1);
+    c.film = FilmImage(image);
+    return true;
+}
+
+/* !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+ * Runs
+ * !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!*/
+
+static double distance(const QPoint &a, const QPoint &b)
+{
+    QPoint d = a - b;
+    return sqrt(double(d.x()*d.x() + d.y()*d.y()));
+}
+
+/* ***************************************************************************
+ * function: runStrategy
+ * description: starts from the true centers moved by offset (the 180 degree
+ *   one the other way), the configured radius and no tilt, places the
+ *   regions as FilmWidget does when the centers are clicked, then runs
+ *   strategy and compares the result with the truth.  The integration only
+ *   uses the 0 degree center and the radius, so the 180 degree error is
+ *   that of the center they imply, pi*radius*dpm below the 0 degree one.
+ * ***************************************************************************/
+static Run runStrategy(const Case &c, const OptimizerStrategy &strategy, const OptimizerRanges &ranges,
+                       const QPoint &offset, double tolerance)
+{
+    GeometryOptimizer o(FilmSampler(&c.film), c.truth.dpm, ranges);
+    o.geometry.zeroDegreeCenter = c.truth.zeroDegreeCenter + offset;
+    o.geometry.oneEightyDegreeCenter = c.truth.oneEightyDegreeCenter - offset;
+    o.geometry.radius = ranges.cameraRadius;
+    o.placeRegions();
+
+    QElapsedTimer timer;
+    timer.start();
+    o.run(strategy);
+
+    Run r;
+    r.film = c.name;
+    r.strategy = strategy.name;
+    r.counts = o.counts;
+    r.seconds = timer.nsecsElapsed()*1e-9;
+    r.zeroError = distance(o.geometry.zeroDegreeCenter, c.truth.zeroDegreeCenter);
+    QPoint implied(o.geometry.zeroDegreeCenter.x(), o.geometry.zeroDegreeCenter.y() + M_PI*o.geometry.radius*c.truth.dpm);
+    r.oneEightyError = distance(implied, c.truth.oneEightyDegreeCenter);
+    r.radiusError = 1000.0*(o.geometry.radius - c.truth.radius);
+    r.phiError = o.geometry.phi - c.truth.phi;
+    r.alphaError = o.geometry.alpha - c.truth.alpha;
+    r.converged = (r.zeroError <= tolerance && r.oneEightyError <= tolerance);
+
+    return r;
+}
+
+/* !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+ * Output
+ * !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!*/
+
+static QString column(const QString &s, int width) { return s.leftJustified(width) + " "; }
+static QString column(double v, int width, int precision) { return QString::number(v, 'f', precision).rightJustified(width) + " "; }
+static QString column(int v, int width) { return QString::number(v).rightJustified(width) + " "; }
+
+static void writeTable(QTextStream &out, const QList<Run> &runs)
+{
+    out << column("film", 12) << column("strategy", 32) << column("integ", 6) << column("resid", 6)
+        << column("ms", 9) << column("err0", 6) << column("err180", 6) << column("dR mm", 8)
+        << column("dphi", 8) << column("dalpha", 8) << "ok" << "\n";
+
+    for (int i = 0; i < runs.size(); i++)
+    {
+        const Run &r = runs.at(i);
+        out << column(r.film, 12) << column(r.strategy, 32)
+            << column(r.counts.integrateRegion, 6) << column(r.counts.residual, 6)
+            << column(1000.0*r.seconds, 9, 1) << column(r.zeroError, 6, 1) << column(r.oneEightyError, 6, 1)
+            << column(r.radiusError, 8, 3) << column(r.phiError, 8, 4) << column(r.alphaError, 8, 4)
+            << (r.converged ? "yes" : "no") << "\n";
+    }
+}
+
+/* ***************************************************************************
+ * function: writeSummary
+ * description: totals per strategy over all films, and the fastest strategy
+ *   that met the tolerance on every film.
+ * ***************************************************************************/
+static void writeSummary(QTextStream &out, const QList<OptimizerStrategy> &strategies,
+                         const QList<Run> &runs, double tolerance)
+{
+    out << "\n" << column("strategy", 32) << column("films ok", 9) << column("evals", 7)
+        << column("total ms", 10) << column("worst px", 9) << "\n";
+
+    QString fastest;
+    double fastestSeconds = 0.0;
+
+    for (int s = 0; s < strategies.size(); s++)
+    {
+        int films = 0, ok = 0, evals = 0;
+        double seconds = 0.0, worst = 0.0;
+
+        for (int i = 0; i < runs.size(); i++)
+        {
+            const Run &r = runs.at(i);
+            if (r.strategy != strategies.at(s).name) continue;
+
+            films++;
+            if (r.converged) ok++;
+            evals += r.counts.total();
+            seconds += r.seconds;
+            worst = qMax(worst, qMax(r.zeroError, r.oneEightyError));
+        }
+
+        out << column(strategies.at(s).name, 32) << column(QString("%1/%2").arg(ok).arg(films), 9)
+            << column(evals, 7) << column(1000.0*seconds, 10, 1) << column(worst, 9, 1) << "\n";
+
+        if (films > 0 && ok == films && (fastest.isEmpty() || seconds < fastestSeconds))
+        {
+            fastest = strategies.at(s).name;
+            fastestSeconds = seconds;
+        }
+    }
+
+    out << "\n";
+    if (fastest.isEmpty())
+        out << "No strategy found the centers within " << tolerance << " px on every film." << "\n";
+    else
+        out << "Fastest within " << tolerance << " px on every film: " << fastest << "\n";
+}
+
+static void writeCsv(QTextStream &out, const QList<Run> &runs)
+{
+    out << "film,strategy,integrate_region,residual,seconds,zero_error_px,oneeighty_error_px,"
+        << "radius_error_mm,phi_error_deg,alpha_error_deg,converged" << "\n";
+
+    for (int i = 0; i < runs.size(); i++)
+    {
+        const Run &r = runs.at(i);
+        out << r.film << "," << r.strategy << "," << r.counts.integrateRegion << "," << r.counts.residual << ","
+            << r.seconds << "," << r.zeroError << "," << r.oneEightyError << "," << r.radiusError << ","
+            << r.phiError << "," << r.alphaError << "," << (r.converged ? 1 : 0) << "\n";
+    }
+}
+
+static void usage()
+{
+    cerr << "usage: diis-optbench [--film file ...] [--dpi n] [--offset dx,dy] [--range px]" << endl
+         << "                     [--tolerance px] [--filter name] [--csv file] [--trace file]" << endl
+         << "Runs every optimization strategy from centers offset from the truth, on" << endl
+         << "synthetic quartz films at --dpi or on the films given (each with its" << endl
+         << "ground truth in <file>.truth, as written by diis-synthfilm).  --trace" << endl
+         << "writes the timeline of the runs and their probes as Chrome trace JSON." << endl;
+}
+
+/* !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+ * Entry point
+ * !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!*/
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QStringList args = app.arguments();
+
+    int dpi = OPTBENCH_DPI;
+    QPoint offset(OPTBENCH_OFFSET_X, OPTBENCH_OFFSET_Y);
+    double tolerance = OPTBENCH_TOLERANCE;
+    QStringList films;
+    QString filter;
+    QString csvFile;
+    QString traceFile;
+    OptimizerRanges ranges;
+
+    for (int i = 1; i < args.size(); i++)
+    {
+        QString a = args.at(i);
+        bool hasValue = (i + 1 < args.size());
+
+        if (a == "--film" && hasValue) films.append(args.at(++i));
+        else if (a == "--dpi" && hasValue) dpi = qMax(1, args.at(++i).toInt());
+        else if (a == "--offset" && hasValue)
+        {
+            QStringList d = args.at(++i).split(",");
+            if (d.size() != 2)
+            {
+                usage();
+                return 1;
+            }
+            offset = QPoint(d.at(0).toInt(), d.at(1).toInt());
+        }
+        else if (a == "--range" && hasValue)
+        {
+            int range = qMax(2, args.at(++i).toInt());
+            ranges.xSharpness = ranges.ySharpness = ranges.xSymmetry = ranges.ySymmetry = range;
+        }
+        else if (a == "--tolerance" && hasValue) tolerance = args.at(++i).toDouble();
+        else if (a == "--filter" && hasValue) filter = args.at(++i);
+        else if (a == "--csv" && hasValue) csvFile = args.at(++i);
+        else if (a == "--trace" && hasValue) traceFile = args.at(++i);
+        else
+        {
+            usage();
+            return 1;
+        }
+    }
+
+    QList<Case> cases;
+    if (films.isEmpty())
+        cases = syntheticCases(dpi);
+
+    for (int i = 0; i < films.size(); i++)
+    {
+        Case c;
+        if (!fileCase(films.at(i), c))
+        {
+            cerr << "Could not load film or its truth: " << qPrintable(films.at(i)) << endl;
+            return 1;
+        }
+        cases.append(c);
+    }
+
+    QList<OptimizerStrategy> strategies;
+    QList<OptimizerStrategy> all = optimizerStrategies();
+    for (int s = 0; s < all.size(); s++)
+        if (filter.isEmpty() || all.at(s).name.contains(filter))
+            strategies.append(all.at(s));
+
+    if (!traceFile.isEmpty()) setTracing(true);
+
+    QList<Run> runs;
+    for (int i = 0; i < cases.size(); i++)
+    {
+        for (int s = 0; s < strategies.size(); s++)
+        {
+            {
+                ScopedTimer timer("run");
+                runs.append(runStrategy(cases.at(i), strategies.at(s), ranges, offset, tolerance));
+            }
+            cerr << qPrintable(cases.at(i).name) << " " << qPrintable(strategies.at(s).name) << ": "
+                 << runs.last().counts.total() << " evaluations" << endl;
+        }
+    }
+
+    QTextStream out(stdout);
+    writeTable(out, runs);
+    writeSummary(out, strategies, runs, tolerance);
+
+    if (!csvFile.isEmpty())
+    {
+        QFile file(csvFile);
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Text))
+        {
+            cerr << "Could not write " << qPrintable(csvFile) << endl;
+            return 1;
+        }
+
+        QTextStream csv(&file);
+        writeCsv(csv, runs);
+    }
+
+    if (!traceFile.isEmpty() && !saveTraceJson(traceFile))
+    {
+        cerr << "Could not write " << qPrintable(traceFile) << endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,30 @@
+# Convergence of the geometry optimization strategies on films of known
+# geometry.  Builds without Qwt or a display:
+#   cd optbench && qmake && make
+#   ../../bin/diis-optbench --tolerance 1 --csv strategies.csv
+TEMPLATE = app
+TARGET = diis-optbench
+CONFIG += console
+CONFIG -= app_bundle
+INCLUDEPATH += ..
+DEPENDPATH += ..
+QMAKE_CXXFLAGS += -O3
+
+HEADERS = ../GeometryOptimizer.h \
+    ../Instrumentation.h \
+    ../Log.h \
+    ../SyntheticFilm.h \
+    ../FilmImage.h \
+    ../FilmSampler.h \
+    ../IntegrationKernel.h \
+    ../TwoThetaHistogram.h \
+    ../ConfigFile/ConfigFile.h
+SOURCES = OptBench.cpp \
+    ../GeometryOptimizer.cpp \
+    ../Instrumentation.cpp \
+    ../Log.cpp \
+    ../SyntheticFilm.cpp \
+    ../FilmImage.cpp \
+    ../TwoThetaHistogram.cpp \
+    ../ConfigFile/ConfigFile.cpp
+DESTDIR = ../../bin
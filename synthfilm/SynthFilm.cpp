@@ -0,0 +1,152 @@
+/* ***************************************************************************
+ * SynthFilm.cpp: command line front end of the synthetic film generator.
+ *   Writes the film and its ground truth geometry (<film>.truth).
+ * ***************************************************************************/
+
+/* !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+ * Headers, definitions, etc.
+ * !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!*/
+
+/* Qt related headers */
+#include <QCoreApplication>
+#include <QStringList>
+#include <QImage>
+
+/* Standard c++ headers */
+#include <iostream>
+
+/* Program headers */
+#include "SyntheticFilm.h"
+
+using namespace std;
+
+#define SYNTH_DPI 600
+
+/* !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+ * Functions
+ * !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!*/
+
+static void usage()
+{
+    cerr << "usage: diis-synthfilm --out film.tif [--dpi n] [--radius m] [--width px]" << endl
+         << "                      [--height px] [--center x,y] [--phi deg] [--alpha deg]" << endl
+         << "                      [--lines tt,h[,fwhm];...] [--background g] [--air g]" << endl
+         << "                      [--noise sigma] [--spots n] [--beamstop mm]" << endl
+         << "                      [--seed n] [--positive]" << endl
+         << "Renders quartz (or the given lines) onto a film with the 0 degree center" << endl
+         << "55 mm from the top, written dark on light like a scan unless --positive." << endl
+         << "The true geometry goes to film.tif.truth." << endl;
+}
+
+/* "tt,h[,fwhm];..." */
+static bool parseLines(const QString &text, QVector<SyntheticLine> &lines)
+{
+    lines.clear();
+
+    QStringList entries = text.split(";", QString::SkipEmptyParts);
+    for (int i = 0; i < entries.size(); i++)
+    {
+        QStringList v = entries.at(i).split(",");
+        if (v.size() < 2) return false;
+
+        SyntheticLine line(v.at(0).toDouble(), v.at(1).toDouble());
+        if (v.size() > 2) line.fwhm = v.at(2).toDouble();
+        if (line.fwhm <= 0.0) return false;
+
+        lines.append(line);
+    }
+
+    return !lines.isEmpty();
+}
+
+/* !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+ * Entry point
+ * !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!*/
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QStringList args = app.arguments();
+
+    /* The size follows dpi and radius unless given, so read those first */
+    int dpi = SYNTH_DPI;
+    double radius = 0.1146/2.0;
+    for (int i = 1; i + 1 < args.size(); i++)
+    {
+        if (args.at(i) == "--dpi") dpi = qMax(1, args.at(i + 1).toInt());
+        else if (args.at(i) == "--radius") radius = args.at(i + 1).toDouble();
+    }
+
+    SyntheticFilmSpec spec = SyntheticFilmSpec::standard(dpi, radius);
+    QString outFile;
+
+    for (int i = 1; i < args.size(); i++)
+    {
+        QString a = args.at(i);
+        bool hasValue = (i + 1 < args.size());
+
+        if (a == "--out" && hasValue) outFile = args.at(++i);
+        else if ((a == "--dpi" || a == "--radius") && hasValue) ++i;
+        else if (a == "--width" && hasValue) spec.width = args.at(++i).toInt();
+        else if (a == "--height" && hasValue) spec.height = args.at(++i).toInt();
+        else if (a == "--center" && hasValue)
+        {
+            QStringList xy = args.at(++i).split(",");
+            if (xy.size() != 2)
+            {
+                usage();
+                return 1;
+            }
+            spec.zeroDegreeCenter = QPoint(xy.at(0).toInt(), xy.at(1).toInt());
+        }
+        else if (a == "--phi" && hasValue) spec.phi = args.at(++i).toDouble();
+        else if (a == "--alpha" && hasValue) spec.alpha = args.at(++i).toDouble();
+        else if (a == "--lines" && hasValue)
+        {
+            if (!parseLines(args.at(++i), spec.lines))
+            {
+                cerr << "Could not read lines: " << qPrintable(args.at(i)) << endl;
+                return 1;
+            }
+        }
+        else if (a == "--background" && hasValue) spec.background = args.at(++i).toDouble();
+        else if (a == "--air" && hasValue) spec.airScatter = args.at(++i).toDouble();
+        else if (a == "--noise" && hasValue) spec.noise = args.at(++i).toDouble();
+        else if (a == "--spots" && hasValue) spec.spots = args.at(++i).toInt();
+        else if (a == "--beamstop" && hasValue) spec.beamStopRadius = args.at(++i).toDouble()/1000.0;
+        else if (a == "--seed" && hasValue) spec.seed = args.at(++i).toUInt();
+        else if (a == "--positive") spec.negative = false;
+        else
+        {
+            usage();
+            return 1;
+        }
+    }
+
+    if (outFile.isEmpty() || spec.width <= 0 || spec.height <= 0)
+    {
+        usage();
+        return 1;
+    }
+
+    QImage film = renderSyntheticFilm(spec);
+    if (!film.save(outFile))
+    {
+        cerr << "Could not write " << qPrintable(outFile) << endl;
+        return 1;
+    }
+
+    if (!writeSyntheticTruth(spec, outFile + ".truth"))
+    {
+        cerr << "Could not write " << qPrintable(outFile + ".truth") << endl;
+        return 1;
+    }
+
+    SyntheticTruth truth = syntheticTruth(spec);
+    cout << qPrintable(outFile) << ": " << spec.width << "x" << spec.height
+         << " px, 0 deg center (" << truth.zeroDegreeCenter.x() << "," << truth.zeroDegreeCenter.y()
+         << "), 180 deg center (" << truth.oneEightyDegreeCenter.x() << "," << truth.oneEightyDegreeCenter.y()
+         << ")" << endl;
+
+    return 0;
+}
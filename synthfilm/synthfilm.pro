@@ -0,0 +1,24 @@
+# Synthetic Gandolfi films with known geometry.  Builds without Qwt or a
+# display:
+#   cd synthfilm && qmake && make
+#   ../../bin/diis-synthfilm --out quartz.tif --dpi 600 --phi 0.5 --spots 200
+TEMPLATE = app
+TARGET = diis-synthfilm
+CONFIG += console
+CONFIG -= app_bundle
+INCLUDEPATH += ..
+DEPENDPATH += ..
+QMAKE_CXXFLAGS += -O3
+
+HEADERS = ../SyntheticFilm.h \
+    ../IntegrationKernel.h \
+    ../FilmSampler.h \
+    ../FilmImage.h \
+    ../TwoThetaHistogram.h \
+    ../ConfigFile/ConfigFile.h
+SOURCES = SynthFilm.cpp \
+    ../SyntheticFilm.cpp \
+    ../FilmImage.cpp \
+    ../TwoThetaHistogram.cpp \
+    ../ConfigFile/ConfigFile.cpp
+DESTDIR = ../../bin